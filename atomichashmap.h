@@ -0,0 +1,452 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+#ifndef ATOMICHASHMAP_H__
+#define ATOMICHASHMAP_H__
+
+// Maps from integer keys to integer values, that many threads can update at
+// the same time without locks, e.g. to count keys in parallel.
+//
+// The keys are stored in one array with linear probing. A thread puts a key by
+// claiming an empty slot with a compare-and-swap, and changes values with
+// compare-and-swap loops. Keys cannot be removed.
+// When the map grows, every thread that touches it helps to copy the old table
+// into the new one, a chunk of slots at a time. A copied slot gets the value
+// MOVED, which tells the other threads to go on in the new table. The old
+// tables are kept until NAME##Destroy(), as other threads might still read
+// them.
+
+#include "hashmap.h"
+
+// Slots copied at a time while the map grows.
+#define _ATOMIC_HASHMAP_CHUNK 1024
+#define _ATOMIC_HASHMAP_MIN_CAPACITY 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#   define _ATOMIC_HASHMAP_PAUSE() __builtin_ia32_pause()
+#else
+#   define _ATOMIC_HASHMAP_PAUSE() do {} while(0)
+#endif
+
+typedef enum {
+    AHMO_ADD,     // adds the value to the current one
+    AHMO_MAX,     // keeps the greater one of the values
+    AHMO_REPLACE, // replaces the current value
+} AtomicHashMapOp;
+
+/**
+ * Defines the types and function prototypes of an atomic map type NAME.
+ * \param NAME Name of the map type.
+ * \param KEY_TYPE Integer type of the keys, at most 8 bytes.
+ * \param VALUE_TYPE Integer type of the values, at most 8 bytes.
+ */
+#define DEFINE_ATOMIC_HASHMAP(NAME, KEY_TYPE, VALUE_TYPE)                      \
+                                                                               \
+typedef KEY_TYPE   _AtomicKey##NAME;                                           \
+typedef VALUE_TYPE _AtomicValue##NAME;                                         \
+                                                                               \
+typedef struct _##NAME##Table {                                                \
+    size_t                 capacity; /* slots, a power of 2 */                 \
+    uint8_t                shift;    /* 64 - log2(capacity) */                 \
+    struct _##NAME##Table *next;     /* table to grow into, or NULL */         \
+    struct _##NAME##Table *older;    /* table this one grew from, or NULL */   \
+    KEY_TYPE              *keys;                                               \
+    VALUE_TYPE            *values;                                             \
+    /* the counters get cache lines of their own */                            \
+    char                   _padding0[64];                                      \
+    size_t                 size;     /* claimed slots */                       \
+    char                   _padding1[64];                                      \
+    size_t                 claimed;  /* chunks claimed to be copied */         \
+    size_t                 copied;   /* chunks copied */                       \
+    char                   _padding2[64];                                      \
+} NAME##Table;                                                                 \
+                                                                               \
+typedef struct {                                                               \
+    NAME##Table *table; /* current table, or NULL */                           \
+    KEY_TYPE     empty; /* key of empty slots */                               \
+    VALUE_TYPE   moved; /* value of copied slots */                            \
+} NAME;                                                                        \
+                                                                               \
+/* Initialize a new map. Does not allocate memory.                           */\
+/* \param map Map to initialize.                                             */\
+void NAME##New(NAME *map);                                                     \
+                                                                               \
+/* Frees the internal memory of a map. No other thread may use the map.      */\
+/* \param map Map to destroy.                                                */\
+void NAME##Destroy(NAME *map);                                                 \
+                                                                               \
+/* Ensures that the map can hold capacity keys without growing. No other     */\
+/* thread may use the map, call it before you start the threads.             */\
+/* \param map Map to grow if needed.                                         */\
+/* \param capacity Number of keys the map shall hold.                        */\
+/* \return false, if could not ensure size.                                  */\
+bool NAME##EnsureSize(NAME *map,                                               \
+                      size_t capacity);                                        \
+                                                                               \
+/* Looks up a key in a map. Helps to copy the table if the map grows.        */\
+/* A key that is being put may be found with the value 0.                    */\
+/* \param map Map to search in.                                              */\
+/* \param key Key to search.                                                 */\
+/* \param value [Out] Returns the value of key. May be NULL.                 */\
+/* \return false, if could not found.                                        */\
+bool NAME##Find(NAME *map,                                                     \
+                KEY_TYPE key,                                                  \
+                VALUE_TYPE *value);                                            \
+                                                                               \
+/* Combines the value of a key with value, and puts the key if it does not   */\
+/* exist. The value of a new key starts at 0, so AHMO_MAX keeps 0 for a      */\
+/* negative value.                                                           */\
+/* \param map Map to update.                                                 */\
+/* \param key Key to update, must not be the empty key.                      */\
+/* \param value Value to combine with, the result must not be MOVED.         */\
+/* \param op How to combine the values.                                      */\
+/* \return HMPR_PUT if the key was new, HMPR_REPLACED if it existed, or      */\
+/*         HMPR_FAILED if key is the empty key, value is MOVED, or memory is */\
+/*         exhausted.                                                        */\
+HashMapPutResult NAME##Update(NAME *map,                                       \
+                              KEY_TYPE key,                                    \
+                              VALUE_TYPE value,                                \
+                              AtomicHashMapOp op);                             \
+                                                                               \
+/* Returns the number of keys. It is only exact if no other thread modifies  */\
+/* the map.                                                                  */\
+/* \param map Map to count.                                                  */\
+size_t NAME##Size(const NAME *map);
+
+/**
+ * Declares the functions of atomic map type NAME.
+ * \param NAME Name of the map type.
+ * \param EMPTY Key that marks empty slots. It cannot be put into the map.
+ * \param MOVED Value that marks copied slots. No key may get this value.
+ * \param FREE Free function to use.
+ * \param REALLOC Realloc function to use.
+ */
+#define DECLARE_ATOMIC_HASHMAP(NAME, EMPTY, MOVED, FREE, REALLOC)              \
+                                                                               \
+void NAME##New(NAME *map) {                                                    \
+    map->table = NULL;                                                         \
+    map->empty = (EMPTY);                                                      \
+    map->moved = (MOVED);                                                      \
+}                                                                              \
+                                                                               \
+static void _##NAME##TableFree(NAME##Table *table) {                           \
+    FREE(table->keys);                                                         \
+    FREE(table->values);                                                       \
+    FREE(table);                                                               \
+}                                                                              \
+                                                                               \
+void NAME##Destroy(NAME *map) {                                                \
+    NAME##Table *table = map->table;                                           \
+    if(table) {                                                                \
+        while(table->next) {                                                   \
+            table = table->next;                                               \
+        }                                                                      \
+        while(table) {                                                         \
+            NAME##Table *older = table->older;                                 \
+            _##NAME##TableFree(table);                                         \
+            table = older;                                                     \
+        }                                                                      \
+    }                                                                          \
+    NAME##New(map);                                                            \
+}                                                                              \
+                                                                               \
+/* Allocates an empty table with at least capacity slots.                    */\
+static NAME##Table *_##NAME##TableAlloc(size_t capacity) {                     \
+    size_t slots = _ATOMIC_HASHMAP_MIN_CAPACITY;                               \
+    uint8_t shift = 64 - 6;                                                    \
+    while(slots < capacity) {                                                  \
+        if(slots > SIZE_MAX / 2 / sizeof(_AtomicKey##NAME) ||                  \
+                   slots > SIZE_MAX / 2 / sizeof(_AtomicValue##NAME)) {        \
+            return NULL;                                                       \
+        }                                                                      \
+        slots *= 2;                                                            \
+        --shift;                                                               \
+    }                                                                          \
+    NAME##Table *table = (NAME##Table *) REALLOC(NULL, sizeof(NAME##Table));   \
+    if(!table) {                                                               \
+        return NULL;                                                           \
+    }                                                                          \
+    memset(table, 0, sizeof(NAME##Table));                                     \
+    table->capacity = slots;                                                   \
+    table->shift = shift;                                                      \
+    table->keys = (_AtomicKey##NAME *) REALLOC(                                \
+            NULL, slots * sizeof(_AtomicKey##NAME));                           \
+    table->values = (_AtomicValue##NAME *) REALLOC(                            \
+            NULL, slots * sizeof(_AtomicValue##NAME));                         \
+    if(!table->keys || !table->values) {                                       \
+        _##NAME##TableFree(table);                                             \
+        return NULL;                                                           \
+    }                                                                          \
+    for(size_t i = 0; i < slots; ++i) {                                        \
+        table->keys[i] = (EMPTY);                                              \
+        table->values[i] = 0;                                                  \
+    }                                                                          \
+    return table;                                                              \
+}                                                                              \
+                                                                               \
+/* Fibonacci hashing, the upper bits of the product are the home slot.       */\
+static inline size_t _##NAME##Home(const NAME##Table *table,                   \
+                                   _AtomicKey##NAME key) {                     \
+    return (size_t) (((uint64_t) key * 0x9E3779B97F4A7C15u) >> table->shift);  \
+}                                                                              \
+                                                                               \
+/* Returns the table to grow into, allocates it if needed.                   */\
+/* \return NULL, if memory is exhausted.                                     */\
+static NAME##Table *_##NAME##Grow(NAME##Table *table,                          \
+                                  size_t capacity) {                           \
+    NAME##Table *next = __atomic_load_n(&table->next, __ATOMIC_ACQUIRE);       \
+    if(next) {                                                                 \
+        return next;                                                           \
+    }                                                                          \
+    NAME##Table *fresh = _##NAME##TableAlloc(capacity);                        \
+    if(!fresh) {                                                               \
+        return NULL;                                                           \
+    }                                                                          \
+    fresh->older = table;                                                      \
+    if(!__atomic_compare_exchange_n(&table->next, &next, fresh, false,         \
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {     \
+        /* another thread was faster */                                        \
+        _##NAME##TableFree(fresh);                                             \
+        return next;                                                           \
+    }                                                                          \
+    return fresh;                                                              \
+}                                                                              \
+                                                                               \
+/* Helps to copy table into next, and waits until all chunks are copied.     */\
+/* \return next.                                                             */\
+static NAME##Table *_##NAME##Help(NAME *map,                                   \
+                                  NAME##Table *table,                          \
+                                  NAME##Table *next) {                         \
+    size_t chunk = table->capacity < _ATOMIC_HASHMAP_CHUNK ?                   \
+                   table->capacity : _ATOMIC_HASHMAP_CHUNK;                    \
+    size_t chunks = table->capacity / chunk;                                   \
+    for(size_t c; (c = __atomic_fetch_add(&table->claimed, 1,                  \
+                                          __ATOMIC_RELAXED)) < chunks; ) {     \
+        size_t copied = 0;                                                     \
+        for(size_t i = c * chunk; i < (c+1) * chunk; ++i) {                    \
+            /* a slot is frozen before its key is read: a thread that */       \
+            /* claims the slot afterwards sees MOVED and uses next */          \
+            _AtomicValue##NAME value = __atomic_exchange_n(                    \
+                    &table->values[i], (MOVED), __ATOMIC_SEQ_CST);             \
+            _AtomicKey##NAME key = __atomic_load_n(&table->keys[i],            \
+                                                   __ATOMIC_SEQ_CST);          \
+            if(key == (EMPTY)) {                                               \
+                continue;                                                      \
+            }                                                                  \
+            /* the keys are distinct, a copy takes the first empty slot */     \
+            size_t mask = next->capacity - 1;                                  \
+            for(size_t j = _##NAME##Home(next, key); ; j = (j+1) & mask) {     \
+                _AtomicKey##NAME empty = (EMPTY);                              \
+                if(__atomic_compare_exchange_n(&next->keys[j], &empty, key,    \
+                                               false, __ATOMIC_RELAXED,        \
+                                               __ATOMIC_RELAXED)) {            \
+                    __atomic_store_n(&next->values[j], value,                  \
+                                     __ATOMIC_RELAXED);                        \
+                    break;                                                     \
+                }                                                              \
+            }                                                                  \
+            ++copied;                                                          \
+        }                                                                      \
+        __atomic_fetch_add(&next->size, copied, __ATOMIC_RELAXED);             \
+        if(__atomic_add_fetch(&table->copied, 1, __ATOMIC_ACQ_REL) == chunks) {\
+            NAME##Table *expected = table;                                     \
+            __atomic_compare_exchange_n(&map->table, &expected, next, false,   \
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);   \
+        }                                                                      \
+    }                                                                          \
+    while(__atomic_load_n(&table->copied, __ATOMIC_ACQUIRE) < chunks) {        \
+        _ATOMIC_HASHMAP_PAUSE();                                               \
+    }                                                                          \
+    return next;                                                               \
+}                                                                              \
+                                                                               \
+/* Returns the current table, allocates the first one if needed.             */\
+static NAME##Table *_##NAME##Current(NAME *map) {                              \
+    NAME##Table *table = __atomic_load_n(&map->table, __ATOMIC_ACQUIRE);       \
+    if(table) {                                                                \
+        return table;                                                          \
+    }                                                                          \
+    NAME##Table *fresh = _##NAME##TableAlloc(_ATOMIC_HASHMAP_MIN_CAPACITY);    \
+    if(!fresh) {                                                               \
+        return NULL;                                                           \
+    }                                                                          \
+    if(!__atomic_compare_exchange_n(&map->table, &table, fresh, false,         \
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {     \
+        _##NAME##TableFree(fresh);                                             \
+        return table;                                                          \
+    }                                                                          \
+    return fresh;                                                              \
+}                                                                              \
+                                                                               \
+bool NAME##EnsureSize(NAME *map,                                               \
+                      size_t capacity) {                                       \
+    if(capacity > SIZE_MAX / 2) {                                              \
+        return false;                                                          \
+    }                                                                          \
+    /* at most 3/4 of the slots get used */                                    \
+    capacity += capacity / 3 + 1;                                              \
+    NAME##Table *table = map->table;                                           \
+    if(!table) {                                                               \
+        map->table = _##NAME##TableAlloc(capacity);                            \
+        return map->table != NULL;                                             \
+    }                                                                          \
+    /* a pending growth may be into a smaller table, then grow again */        \
+    while(table->capacity < capacity) {                                        \
+        NAME##Table *next = _##NAME##Grow(table, capacity);                    \
+        if(!next) {                                                            \
+            return false;                                                      \
+        }                                                                      \
+        table = _##NAME##Help(map, table, next);                               \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##Find(NAME *map,                                                     \
+                _AtomicKey##NAME key,                                          \
+                _AtomicValue##NAME *value) {                                   \
+    NAME##Table *table = __atomic_load_n(&map->table, __ATOMIC_ACQUIRE);       \
+    if(!table || key == (EMPTY)) {                                             \
+        return false;                                                          \
+    }                                                                          \
+    for(;;) {                                                                  \
+        NAME##Table *next = __atomic_load_n(&table->next, __ATOMIC_ACQUIRE);   \
+        if(next) {                                                             \
+            table = _##NAME##Help(map, table, next);                           \
+            continue;                                                          \
+        }                                                                      \
+        size_t mask = table->capacity - 1, i = _##NAME##Home(table, key);      \
+        for(size_t probes = 0; ; i = (i+1) & mask) {                           \
+            _AtomicKey##NAME current = __atomic_load_n(&table->keys[i],        \
+                                                       __ATOMIC_SEQ_CST);      \
+            if(current == key) {                                               \
+                break;                                                         \
+            }                                                                  \
+            if(current == (EMPTY) || ++probes == table->capacity) {            \
+                return false;                                                  \
+            }                                                                  \
+        }                                                                      \
+        _AtomicValue##NAME current = __atomic_load_n(&table->values[i],        \
+                                                     __ATOMIC_SEQ_CST);        \
+        if(current != (MOVED)) {                                               \
+            if(value) {                                                        \
+                *value = current;                                              \
+            }                                                                  \
+            return true;                                                       \
+        }                                                                      \
+        /* the slot was copied, table->next is set */                          \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+HashMapPutResult NAME##Update(NAME *map,                                       \
+                              _AtomicKey##NAME key,                            \
+                              _AtomicValue##NAME value,                        \
+                              AtomicHashMapOp op) {                            \
+    if(key == (EMPTY) || value == (MOVED)) {                                   \
+        return HMPR_FAILED;                                                    \
+    }                                                                          \
+    NAME##Table *table = _##NAME##Current(map);                                \
+    if(!table) {                                                               \
+        return HMPR_FAILED;                                                    \
+    }                                                                          \
+    HashMapPutResult result = HMPR_REPLACED;                                   \
+    for(;;) {                                                                  \
+        NAME##Table *next = __atomic_load_n(&table->next, __ATOMIC_ACQUIRE);   \
+        if(next) {                                                             \
+            table = _##NAME##Help(map, table, next);                           \
+            continue;                                                          \
+        }                                                                      \
+        size_t mask = table->capacity - 1, i = _##NAME##Home(table, key);      \
+        bool full = false;                                                     \
+        for(size_t probes = 0; ; i = (i+1) & mask) {                           \
+            _AtomicKey##NAME current = __atomic_load_n(&table->keys[i],        \
+                                                       __ATOMIC_SEQ_CST);      \
+            if(current == (EMPTY) &&                                           \
+                    __atomic_compare_exchange_n(&table->keys[i], &current,     \
+                                                key, false, __ATOMIC_SEQ_CST,  \
+                                                __ATOMIC_SEQ_CST)) {           \
+                result = HMPR_PUT;                                             \
+                size_t size = __atomic_add_fetch(&table->size, 1,              \
+                                                 __ATOMIC_RELAXED);            \
+                if(size > table->capacity / 4 * 3) {                           \
+                    /* if the map cannot grow, it gets fuller */               \
+                    _##NAME##Grow(table, 2 * table->capacity);                 \
+                }                                                              \
+                break;                                                         \
+            }                                                                  \
+            if(current == key) {                                               \
+                break;                                                         \
+            }                                                                  \
+            if(++probes == table->capacity) {                                  \
+                full = true;                                                   \
+                break;                                                         \
+            }                                                                  \
+        }                                                                      \
+        if(full) {                                                             \
+            if(!_##NAME##Grow(table, 2 * table->capacity)) {                   \
+                return HMPR_FAILED;                                            \
+            }                                                                  \
+            continue;                                                          \
+        }                                                                      \
+                                                                               \
+        _AtomicValue##NAME current = __atomic_load_n(&table->values[i],        \
+                                                     __ATOMIC_SEQ_CST);        \
+        while(current != (MOVED)) {                                            \
+            _AtomicValue##NAME desired;                                        \
+            switch(op) {                                                       \
+                case AHMO_ADD:                                                 \
+                    desired = current + value;                                 \
+                    break;                                                     \
+                case AHMO_MAX:                                                 \
+                    if(current >= value) {                                     \
+                        return result;                                         \
+                    }                                                          \
+                    desired = value;                                           \
+                    break;                                                     \
+                default:                                                       \
+                    desired = value;                                           \
+                    break;                                                     \
+            }                                                                  \
+            if(__atomic_compare_exchange_n(&table->values[i], &current,        \
+                                           desired, false, __ATOMIC_SEQ_CST,   \
+                                           __ATOMIC_SEQ_CST)) {                \
+                return result;                                                 \
+            }                                                                  \
+        }                                                                      \
+        /* the slot was copied, table->next is set */                          \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+size_t NAME##Size(const NAME *map) {                                           \
+    NAME##Table *table = __atomic_load_n(&map->table, __ATOMIC_ACQUIRE);       \
+    return table ? __atomic_load_n(&table->size, __ATOMIC_RELAXED) : 0;        \
+}
+
+/**
+ * Iterates over all keys of an atomic map. No other thread may modify the map.
+ * \param NAME Name of the map type.
+ * \param KEY KEY_TYPE variable to assign the keys to.
+ * \param VALUE VALUE_TYPE variable to assign the values to.
+ * \param MAP The map.
+ */
+#define ATOMIC_HASHMAP_FOR_EACH(NAME, KEY, VALUE, MAP)                         \
+    for(size_t __i = 0, __broke = 0; !__broke && (MAP).table &&                \
+                                    __i < (MAP).table->capacity; ++__i) {      \
+        if((MAP).table->keys[__i] == (MAP).empty ||                            \
+                (MAP).table->values[__i] == (MAP).moved) {                     \
+            continue;                                                          \
+        }                                                                      \
+        KEY = (MAP).table->keys[__i];                                          \
+        VALUE = (MAP).table->values[__i];                                      \
+        __broke = 1;                                                           \
+        do
+
+/**
+ * Closes an ATOMIC_HASHMAP_FOR_EACH(...)
+ */
+#define ATOMIC_HASHMAP_FOR_EACH_END                                            \
+        while( __broke = 0, __broke );                                         \
+    }
+
+#endif // ifndef ATOMICHASHMAP_H__
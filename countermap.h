@@ -0,0 +1,184 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+#ifndef COUNTERMAP_H__
+#define COUNTERMAP_H__
+
+// Maps from keys to counters, e.g. to count words. A counter map is a
+// DEFINE_HASHMAP map of NAME##Entry, so NAME##New(), NAME##Destroy(),
+// HASHMAP_FOR_EACH(...) etc. work as usual.
+
+#include "hashmap.h"
+
+/**
+ * Defines the types and function prototypes of a counter map type NAME.
+ * \param NAME Name of the map type.
+ * \param KEY_TYPE Type of the keys to count.
+ */
+#define DEFINE_COUNTER_MAP(NAME, KEY_TYPE)                                     \
+                                                                               \
+typedef KEY_TYPE _CounterKey##NAME;                                            \
+                                                                               \
+typedef struct {                                                               \
+    KEY_TYPE key;                                                              \
+    int64_t  count;                                                            \
+} NAME##Entry;                                                                 \
+                                                                               \
+DEFINE_HASHMAP(NAME, NAME##Entry)                                              \
+                                                                               \
+/* Adds delta to the counter of *key. Finding an existing key takes a single */\
+/* lookup, a new key is put in without looking it up again.                  */\
+/* A new entry gets a copy of *key and starts at 0. If you count keys you do */\
+/* not own, e.g. strings in a reused buffer, replace a new entry's key by a  */\
+/* copy you own.                                                             */\
+/* \param map Map to count in.                                               */\
+/* \param key Key to count.                                                  */\
+/* \param delta Value to add to the counter.                                 */\
+/* \return the entry of *key, or NULL if memory is exhausted.                */\
+NAME##Entry *NAME##Increment(NAME *map,                                        \
+                             KEY_TYPE *key,                                    \
+                             int64_t delta);                                   \
+                                                                               \
+/* Adds all counters of a map to another one.                                */\
+/* \param map Map to add to.                                                 */\
+/* \param from Map to add.                                                   */\
+/* \return false, if memory is exhausted. The counters are partly added.     */\
+bool NAME##Merge(NAME *map,                                                    \
+                 const NAME *from);                                            \
+                                                                               \
+/* Copies the k entries with the highest counters into out, highest first.   */\
+/* Uses a heap of k entries in out, so it takes O(n log k) time for n        */\
+/* entries and no extra memory. Entries with the same count are in no        */\
+/* particular order.                                                         */\
+/* \param map Map to search in.                                              */\
+/* \param k Number of entries to find.                                       */\
+/* \param out [Out] Array of at least k entries.                             */\
+/* \return number of entries copied, less than k if the map is smaller.      */\
+size_t NAME##TopK(const NAME *map,                                             \
+                  size_t k,                                                    \
+                  NAME##Entry *out);
+
+/**
+ * Declares the functions of counter map type NAME.
+ * The parameters are the same as for DECLARE_HASHMAP(...), CMP and GET_HASH
+ * get KEY_TYPE* arguments.
+ */
+#define DECLARE_COUNTER_MAP(NAME, CMP, GET_HASH, FREE, REALLOC)                \
+                                                                               \
+static inline int _##NAME##EntryCmp(NAME##Entry *left,                         \
+                                    NAME##Entry *right) {                      \
+    return (CMP((&left->key), (&right->key))) != 0;                            \
+}                                                                              \
+                                                                               \
+static inline size_t _##NAME##EntryHash(NAME##Entry *entry) {                  \
+    return (size_t)(GET_HASH((&entry->key)));                                  \
+}                                                                              \
+                                                                               \
+DECLARE_HASHMAP(NAME, _##NAME##EntryCmp, _##NAME##EntryHash, FREE, REALLOC)    \
+                                                                               \
+NAME##Entry *NAME##Increment(NAME *map,                                        \
+                             _CounterKey##NAME *key,                           \
+                             int64_t delta) {                                  \
+    NAME##Entry entry = { .key = *key, .count = 0 };                           \
+    NAME##Entry *found = &entry;                                               \
+    if(map->snapshot) {                                                        \
+        /* the bucket has to be unshared first */                              \
+        if(NAME##Put(map, &found, HMDR_FIND) == HMPR_FAILED) {                 \
+            return NULL;                                                       \
+        }                                                                      \
+        found->count += delta;                                                 \
+        return found;                                                          \
+    }                                                                          \
+    size_t hash = (size_t)(GET_HASH(key));                                     \
+    if(map->entries && (!map->filter ||                                        \
+                        _hashmapFilterMayContain(map->filter, hash))) {        \
+        NAME##Bucket *bucket = &map->entries[hash %                            \
+                                             _##NAME##Primes[map->nth_prime]]; \
+        NAME##Entry *entries = _HASHMAP_ENTRIES(NAME, *bucket);                \
+        for(size_t h = 0; h < bucket->size; ++h) {                             \
+            if((CMP((&entries[h].key), key)) == 0) {                           \
+                entries[h].count += delta;                                     \
+                return &entries[h];                                            \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+    if(!NAME##EnsureSize(map, map->size+1)) {                                  \
+        return NULL;                                                           \
+    }                                                                          \
+    found = _##NAME##PutReal(map, &entry);                                     \
+    if(!found) {                                                               \
+        return NULL;                                                           \
+    }                                                                          \
+    if(map->filter) {                                                          \
+        _hashmapFilterAdd(map->filter, hash);                                  \
+    }                                                                          \
+    ++map->size;                                                               \
+    found->count += delta;                                                     \
+    return found;                                                              \
+}                                                                              \
+                                                                               \
+bool NAME##Merge(NAME *map,                                                    \
+                 const NAME *from) {                                           \
+    NAME##Entry *iter;                                                         \
+    bool result = true;                                                        \
+    HASHMAP_FOR_EACH(NAME, iter, *from) {                                      \
+        if(!NAME##Increment(map, &iter->key, iter->count)) {                   \
+            result = false;                                                    \
+            break;                                                             \
+        }                                                                      \
+    } HASHMAP_FOR_EACH_END                                                     \
+    return result;                                                             \
+}                                                                              \
+                                                                               \
+/* Moves heap[i] down the min-heap heap[0..size).                            */\
+static void _##NAME##SiftDown(NAME##Entry *heap,                               \
+                              size_t size,                                     \
+                              size_t i) {                                      \
+    NAME##Entry entry = heap[i];                                               \
+    for(size_t child; (child = 2*i + 1) < size; i = child) {                   \
+        if(child + 1 < size && heap[child+1].count < heap[child].count) {      \
+            ++child;                                                           \
+        }                                                                      \
+        if(entry.count <= heap[child].count) {                                 \
+            break;                                                             \
+        }                                                                      \
+        heap[i] = heap[child];                                                 \
+    }                                                                          \
+    heap[i] = entry;                                                           \
+}                                                                              \
+                                                                               \
+size_t NAME##TopK(const NAME *map,                                             \
+                  size_t k,                                                    \
+                  NAME##Entry *out) {                                          \
+    size_t size = 0;                                                           \
+    if(!k) {                                                                   \
+        return 0;                                                              \
+    }                                                                          \
+    NAME##Entry *iter;                                                         \
+    HASHMAP_FOR_EACH(NAME, iter, *map) {                                       \
+        if(size < k) {                                                         \
+            /* sift up */                                                      \
+            size_t i = size++;                                                 \
+            while(i && out[(i-1)/2].count > iter->count) {                     \
+                out[i] = out[(i-1)/2];                                         \
+                i = (i-1)/2;                                                   \
+            }                                                                  \
+            out[i] = *iter;                                                    \
+        } else if(iter->count > out[0].count) {                                \
+            out[0] = *iter;                                                    \
+            _##NAME##SiftDown(out, size, 0);                                   \
+        }                                                                      \
+    } HASHMAP_FOR_EACH_END                                                     \
+    /* heap sort: the smallest entry goes last */                              \
+    for(size_t end = size; end > 1; --end) {                                   \
+        NAME##Entry smallest = out[0];                                         \
+        out[0] = out[end-1];                                                   \
+        _##NAME##SiftDown(out, end-1, 0);                                      \
+        out[end-1] = smallest;                                                 \
+    }                                                                          \
+    return size;                                                               \
+}
+
+#endif // ifndef COUNTERMAP_H__
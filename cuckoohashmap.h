@@ -0,0 +1,544 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+#ifndef CUCKOOHASHMAP_H__
+#define CUCKOOHASHMAP_H__
+
+// Maps with a bounded lookup, for when the tail latency of NAME##Find()
+// matters more than the time to put entries.
+//
+// Bucketized cuckoo hashing: every entry has two buckets of
+// _CUCKOO_HASHMAP_SLOTS slots, and is stored in one of them. Every slot has a
+// tag, a byte of the hash, so a lookup compares only the entries with a
+// matching tag. A lookup prefetches the second bucket while it searches the
+// first one. The buckets are aligned, so a bucket takes one cache line if it
+// fits into 64 bytes, i.e. if the entries have up to 15 bytes.
+//
+// The second bucket is computed from the first one and the tag (partial-key
+// cuckoo hashing), so an entry can move to its other bucket without calling
+// GET_HASH. If both buckets of a new entry are full, it takes the slot of a
+// random entry of them, which moves to its other bucket, and so on, for at most
+// _CUCKOO_HASHMAP_MAX_KICKS entries. The entry that is left over after that
+// goes into a small stash, which lookups only search if it is not empty. If the
+// stash is full, the walk is undone, and the map grows unless it is loaded by
+// less than 1/8. It grows, too, if it is loaded by more than 90%.
+
+#include "hashmap.h"
+
+#define _CUCKOO_HASHMAP_SLOTS 4
+#define _CUCKOO_HASHMAP_STASH 4
+#define _CUCKOO_HASHMAP_MAX_KICKS 256
+#define _CUCKOO_HASHMAP_MIN_BUCKETS 4
+
+/**
+ * Alignment of a bucket of SIZE bytes, so that it spans as few cache lines as
+ * possible.
+ */
+#define _CUCKOO_HASHMAP_ALIGN(SIZE)                                            \
+    ((SIZE) > 32 ? 64 : (SIZE) > 16 ? 32 : (SIZE) > 8 ? 16 : 8)
+
+/**
+ * murmur3's finalizer, the map's hash is often the identity.
+ */
+static inline uint64_t _cuckooHashMapMix(size_t hash) {
+    uint64_t h = (uint64_t) hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdu;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53u;
+    return h ^ (h >> 33);
+}
+
+/**
+ * The tag of a mixed hash. Tag 0 marks empty slots.
+ */
+static inline uint8_t _cuckooHashMapTag(uint64_t hash) {
+    uint8_t tag = (uint8_t) (hash >> 56);
+    return tag ? tag : 1;
+}
+
+/**
+ * The other bucket of an entry with tag in bucket index. It is never index
+ * itself, and the other bucket of the other bucket is index again.
+ * \param mask Number of buckets - 1, at least 1.
+ */
+static inline size_t _cuckooHashMapOther(size_t index,
+                                         uint8_t tag,
+                                         size_t mask) {
+    return index ^ (((size_t) (tag * 0xc6a4a7935bd1e995u) & mask) | 1);
+}
+
+// http://xorshift.di.unimi.it/xorshift64star.c, without the multiplication
+static inline uint64_t _cuckooHashMapRandom(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1du;
+}
+
+/**
+ * Defines the types and function prototypes of a cuckoo map type NAME.
+ * \param NAME Name of the map type.
+ * \param TYPE Type of the values to store.
+ */
+#define DEFINE_CUCKOO_HASHMAP(NAME, TYPE)                                      \
+                                                                               \
+typedef TYPE _CuckooType##NAME;                                                \
+                                                                               \
+typedef struct {                                                               \
+    uint8_t tags[_CUCKOO_HASHMAP_SLOTS];                                       \
+    TYPE    entries[_CUCKOO_HASHMAP_SLOTS];                                    \
+} _##NAME##RawBucket;                                                          \
+                                                                               \
+/* A bucket, tag 0 marks an empty slot.                                      */\
+typedef struct {                                                               \
+    uint8_t tags[_CUCKOO_HASHMAP_SLOTS];                                       \
+    TYPE    entries[_CUCKOO_HASHMAP_SLOTS];                                    \
+} __attribute__((aligned(_CUCKOO_HASHMAP_ALIGN(sizeof(_##NAME##RawBucket)))))  \
+NAME##Bucket;                                                                  \
+                                                                               \
+typedef struct {                                                               \
+    size_t        size;      /* entries, including the stash */                \
+    size_t        mask;      /* buckets - 1, buckets is a power of 2 */        \
+    NAME##Bucket *buckets;   /* NULL, or mask+1 aligned buckets */             \
+    void         *memory;    /* allocation of the buckets */                   \
+    uint64_t      random;    /* state of the random walks */                   \
+    size_t        stashSize;                                                   \
+    uint64_t      stashHashes[_CUCKOO_HASHMAP_STASH]; /* mixed hashes */       \
+    TYPE          stash[_CUCKOO_HASHMAP_STASH];                                \
+} NAME;                                                                        \
+                                                                               \
+/* Initialize a new map.                                                     */\
+/* \param map Map to initialize.                                             */\
+void NAME##New(NAME *map);                                                     \
+                                                                               \
+/* Frees the internal memory of a map.                                       */\
+/* \param map Map to destroy.                                                */\
+void NAME##Destroy(NAME *map);                                                 \
+                                                                               \
+/* Ensures that the map can hold capacity entries without growing, unless    */\
+/* the stash overflows.                                                      */\
+/* \param map Map to grow if needed.                                         */\
+/* \param capacity Number of entries the map shall hold.                     */\
+/* \return false, if could not ensure size.                                  */\
+bool NAME##EnsureSize(NAME *map,                                               \
+                      size_t capacity);                                        \
+                                                                               \
+/* Looks up an entry in a map. Searches two buckets, and the stash if it is  */\
+/* not empty.                                                                */\
+/* \param map Map to search in.                                              */\
+/* \param entry [In/Out] Entry to search, returns pointer to found item      */\
+/* \return false, if could not found.                                        */\
+bool NAME##Find(const NAME *map,                                               \
+                TYPE **entry);                                                 \
+                                                                               \
+/* Adds an entry into a map. Other entries may move, so pointers into the    */\
+/* map are invalid afterwards, except the returned one.                      */\
+/* \param map Map to add to.                                                 */\
+/* \param entry [In/Out] Entry add. If duplicate, return pointer to it in    */\
+/*              here.                                                        */\
+/* \param dr What to do with duplicates. HMDR_STACK is not supported.        */\
+/* \return HMPR_FAILED if dr is HMDR_FAIL or HMDR_STACK and the entry        */\
+/*         existed, or if memory is exhausted.                               */\
+HashMapPutResult NAME##Put(NAME *map,                                          \
+                           TYPE **entry,                                       \
+                           HashMapDuplicateResolution dr);                     \
+                                                                               \
+/* Removes an entry for the list.                                            */\
+/* \param map Map to remove from.                                            */\
+/* \param entry [In/out] Entry to remove, returns removed entry.             */\
+/* \return false, if did not exist                                           */\
+bool NAME##Remove(NAME *map,                                                   \
+                  TYPE *entry);
+
+
+/**
+ * Declares the functions of cuckoo map type NAME.
+ * \param NAME Name of the map type.
+ * \param CMP int (*cmp)(TYPE *left, TYPE *right), returns 0 if equal, as for
+ *            DECLARE_HASHMAP(...).
+ * \param GET_HASH size_t (*getHash)(TYPE *entry).
+ * \param FREE Free function to use.
+ * \param REALLOC Realloc function to use.
+ */
+#define DECLARE_CUCKOO_HASHMAP(NAME, CMP, GET_HASH, FREE, REALLOC)             \
+                                                                               \
+void NAME##New(NAME *map) {                                                    \
+    map->size = 0;                                                             \
+    map->mask = 0;                                                             \
+    map->buckets = NULL;                                                       \
+    map->memory = NULL;                                                        \
+    map->random = 0x9e3779b97f4a7c15u;                                         \
+    map->stashSize = 0;                                                        \
+}                                                                              \
+                                                                               \
+void NAME##Destroy(NAME *map) {                                                \
+    if(map->memory) {                                                          \
+        FREE(map->memory);                                                     \
+    }                                                                          \
+    NAME##New(map);                                                            \
+}                                                                              \
+                                                                               \
+/* Allocates empty buckets, the entries have to be put again.                */\
+static bool _##NAME##Alloc(NAME *map,                                          \
+                           size_t buckets) {                                   \
+    size_t align = __alignof__(NAME##Bucket);                                  \
+    if(buckets > (SIZE_MAX - align) / sizeof(NAME##Bucket)) {                  \
+        return false;                                                          \
+    }                                                                          \
+    void *memory = REALLOC(NULL, sizeof(NAME##Bucket[buckets]) + align - 1);   \
+    if(!memory) {                                                              \
+        return false;                                                          \
+    }                                                                          \
+    NAME##Bucket *aligned = (NAME##Bucket*) (((uintptr_t) memory + align - 1) &\
+                                             ~(uintptr_t) (align - 1));        \
+    for(size_t i = 0; i < buckets; ++i) {                                      \
+        memset(aligned[i].tags, 0, sizeof(aligned[i].tags));                   \
+    }                                                                          \
+    map->size = 0;                                                             \
+    map->mask = buckets - 1;                                                   \
+    map->buckets = aligned;                                                    \
+    map->memory = memory;                                                      \
+    map->stashSize = 0;                                                        \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Mixed hash of an entry.                                                   */\
+static inline uint64_t _##NAME##Hash(_CuckooType##NAME *entry) {               \
+    return _cuckooHashMapMix((size_t) (GET_HASH(entry)));                      \
+}                                                                              \
+                                                                               \
+/* Finds an entry equal to *entry.                                           */\
+/* \param hash Mixed hash of entry.                                          */\
+/* \param where [Out] slot of the found entry, bucket * SLOTS + slot, or the */\
+/*              number of slots + the index in the stash.                    */\
+/* \return false, if could not found.                                        */\
+static inline bool _##NAME##Lookup(const NAME *map,                            \
+                                   _CuckooType##NAME *entry,                   \
+                                   uint64_t hash,                              \
+                                   size_t *where) {                            \
+    uint8_t tag = _cuckooHashMapTag(hash);                                     \
+    size_t index = (size_t) hash & map->mask;                                  \
+    size_t other = _cuckooHashMapOther(index, tag, map->mask);                 \
+    __builtin_prefetch(&map->buckets[other]);                                  \
+    const size_t indices[2] = { index, other };                                \
+    for(size_t b = 0; b < 2; ++b) {                                            \
+        NAME##Bucket *bucket = &map->buckets[indices[b]];                      \
+        for(size_t s = 0; s < _CUCKOO_HASHMAP_SLOTS; ++s) {                    \
+            if(bucket->tags[s] == tag &&                                       \
+               (CMP((&bucket->entries[s]), (entry))) == 0) {                   \
+                *where = indices[b] * _CUCKOO_HASHMAP_SLOTS + s;               \
+                return true;                                                   \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+    for(size_t i = 0; i < map->stashSize; ++i) {                               \
+        if(map->stashHashes[i] == hash &&                                      \
+           (CMP(((_CuckooType##NAME*) &map->stash[i]), (entry))) == 0) {       \
+            *where = (map->mask + 1) * _CUCKOO_HASHMAP_SLOTS + i;              \
+            return true;                                                       \
+        }                                                                      \
+    }                                                                          \
+    return false;                                                              \
+}                                                                              \
+                                                                               \
+/* Pointer to a slot returned by _##NAME##Lookup().                          */\
+static inline _CuckooType##NAME *_##NAME##At(const NAME *map,                  \
+                                             size_t where) {                   \
+    size_t slots = (map->mask + 1) * _CUCKOO_HASHMAP_SLOTS;                    \
+    if(where >= slots) {                                                       \
+        return (_CuckooType##NAME*) &map->stash[where - slots];                \
+    }                                                                          \
+    return &map->buckets[where / _CUCKOO_HASHMAP_SLOTS]                        \
+                       .entries[where % _CUCKOO_HASHMAP_SLOTS];                \
+}                                                                              \
+                                                                               \
+/* Puts an entry into a free slot of bucket.                                 */\
+/* \return the slot, NULL if the bucket is full.                             */\
+static inline _CuckooType##NAME *_##NAME##PutInto(NAME##Bucket *bucket,        \
+                                                  _CuckooType##NAME *entry,    \
+                                                  uint8_t tag) {               \
+    for(size_t s = 0; s < _CUCKOO_HASHMAP_SLOTS; ++s) {                        \
+        if(!bucket->tags[s]) {                                                 \
+            bucket->tags[s] = tag;                                             \
+            bucket->entries[s] = *entry;                                       \
+            return &bucket->entries[s];                                        \
+        }                                                                      \
+    }                                                                          \
+    return NULL;                                                               \
+}                                                                              \
+                                                                               \
+/* Puts an entry that is not in the map. If both of its buckets are full,    */\
+/* the entries are moved on a random walk, and the entry that is left over   */\
+/* at the end of it is stashed. If the stash is full, the entries are moved  */\
+/* back instead, and the map is unchanged.                                   */\
+/* \param hash Mixed hash of entry.                                          */\
+/* \return the slot of entry, NULL if neither the walk nor the stash had a   */\
+/*         free slot.                                                        */\
+static _CuckooType##NAME *_##NAME##Place(NAME *map,                            \
+                                         _CuckooType##NAME *entry,             \
+                                         uint64_t hash) {                      \
+    uint8_t tag = _cuckooHashMapTag(hash);                                     \
+    size_t index = (size_t) hash & map->mask;                                  \
+    size_t other = _cuckooHashMapOther(index, tag, map->mask);                 \
+    _CuckooType##NAME *placed = _##NAME##PutInto(&map->buckets[index],         \
+                                                 entry, tag);                  \
+    if(!placed) {                                                              \
+        placed = _##NAME##PutInto(&map->buckets[other], entry, tag);           \
+    }                                                                          \
+    if(placed) {                                                               \
+        return placed;                                                         \
+    }                                                                          \
+    /* carried is the entry without slot, placed the slot of entry */          \
+    _CuckooType##NAME carried = *entry;                                        \
+    NAME##Bucket *path[_CUCKOO_HASHMAP_MAX_KICKS];                             \
+    size_t pathSlots[_CUCKOO_HASHMAP_MAX_KICKS];                               \
+    bool carriesEntry = true;                                                  \
+    uint64_t random = _cuckooHashMapRandom(&map->random);                      \
+    index = random & 1 ? other : index;                                        \
+    for(size_t kicks = 0; kicks < _CUCKOO_HASHMAP_MAX_KICKS; ++kicks) {        \
+        random = _cuckooHashMapRandom(&map->random);                           \
+        NAME##Bucket *bucket = &map->buckets[index];                           \
+        size_t s = (size_t) (random >> 32) % _CUCKOO_HASHMAP_SLOTS;            \
+        path[kicks] = bucket;                                                  \
+        pathSlots[kicks] = s;                                                  \
+        _CuckooType##NAME kicked = bucket->entries[s];                         \
+        uint8_t kickedTag = bucket->tags[s];                                   \
+        bucket->entries[s] = carried;                                          \
+        bucket->tags[s] = tag;                                                 \
+        if(carriesEntry) {                                                     \
+            placed = &bucket->entries[s];                                      \
+            carriesEntry = false;                                              \
+        } else if(placed == &bucket->entries[s]) {                             \
+            carriesEntry = true;                                               \
+        }                                                                      \
+        carried = kicked;                                                      \
+        tag = kickedTag;                                                       \
+        index = _cuckooHashMapOther(index, tag, map->mask);                    \
+        _CuckooType##NAME *slot = _##NAME##PutInto(&map->buckets[index],       \
+                                                   &carried, tag);             \
+        if(slot) {                                                             \
+            return carriesEntry ? slot : placed;                               \
+        }                                                                      \
+    }                                                                          \
+    if(map->stashSize == _CUCKOO_HASHMAP_STASH) {                              \
+        /* walk back, every kicked entry returns to its slot */                \
+        for(size_t kicks = _CUCKOO_HASHMAP_MAX_KICKS; kicks--; ) {             \
+            NAME##Bucket *bucket = path[kicks];                                \
+            size_t s = pathSlots[kicks];                                       \
+            _CuckooType##NAME kicked = bucket->entries[s];                     \
+            uint8_t kickedTag = bucket->tags[s];                               \
+            bucket->entries[s] = carried;                                      \
+            bucket->tags[s] = tag;                                             \
+            carried = kicked;                                                  \
+            tag = kickedTag;                                                   \
+        }                                                                      \
+        return NULL;                                                           \
+    }                                                                          \
+    map->stash[map->stashSize] = carried;                                      \
+    map->stashHashes[map->stashSize] = carriesEntry ? hash                     \
+                                                 : _##NAME##Hash(&carried);    \
+    _CuckooType##NAME *slot = &map->stash[map->stashSize++];                   \
+    return carriesEntry ? slot : placed;                                       \
+}                                                                              \
+                                                                               \
+/* Whether a map whose stash overflowed may grow to twice its buckets. If    */\
+/* the map is loaded less than 1/8, the stash overflowed because too many    */\
+/* entries have equal hashes, and growing does not help.                     */\
+static inline bool _##NAME##MayGrow(const NAME *map,                           \
+                                    size_t buckets) {                          \
+    return map->size >= buckets * _CUCKOO_HASHMAP_SLOTS / 16;                  \
+}                                                                              \
+                                                                               \
+/* Moves all entries into the given number of empty buckets, or more, if     */\
+/* the stash overflows.                                                      */\
+static bool _##NAME##Rehash(NAME *map,                                         \
+                            size_t buckets) {                                  \
+    NAME old = *map;                                                           \
+    size_t oldSlots = old.buckets ? (old.mask + 1) * _CUCKOO_HASHMAP_SLOTS : 0;\
+    for(;;) {                                                                  \
+        if(!_##NAME##Alloc(map, buckets)) {                                    \
+            *map = old;                                                        \
+            return false;                                                      \
+        }                                                                      \
+        size_t i = 0;                                                          \
+        for(; i < oldSlots + old.stashSize; ++i) {                             \
+            _CuckooType##NAME *entry = _##NAME##At(&old, i);                   \
+            uint64_t hash;                                                     \
+            if(i >= oldSlots) {                                                \
+                hash = old.stashHashes[i - oldSlots];                          \
+            } else if(old.buckets[i / _CUCKOO_HASHMAP_SLOTS]                   \
+                                 .tags[i % _CUCKOO_HASHMAP_SLOTS]) {           \
+                hash = _##NAME##Hash(entry);                                   \
+            } else {                                                           \
+                continue;                                                      \
+            }                                                                  \
+            if(!_##NAME##Place(map, entry, hash)) {                            \
+                break;                                                         \
+            }                                                                  \
+            ++map->size;                                                       \
+        }                                                                      \
+        if(i == oldSlots + old.stashSize) {                                    \
+            break;                                                             \
+        }                                                                      \
+        /* overflowed the stash, try again with twice the buckets */           \
+        FREE(map->memory);                                                     \
+        buckets *= 2;                                                          \
+        if(!_##NAME##MayGrow(&old, buckets)) {                                 \
+            *map = old;                                                        \
+            return false;                                                      \
+        }                                                                      \
+    }                                                                          \
+    if(old.memory) {                                                           \
+        FREE(old.memory);                                                      \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##EnsureSize(NAME *map,                                               \
+                      size_t capacity) {                                       \
+    if(capacity > SIZE_MAX / 10) {                                             \
+        return false;                                                          \
+    }                                                                          \
+    capacity = (capacity*10 + 8) / 9; /* load factor = 0.9 */                  \
+    size_t buckets = map->buckets ? map->mask + 1 : 0;                         \
+    if(capacity <= buckets * _CUCKOO_HASHMAP_SLOTS) {                          \
+        return true;                                                           \
+    }                                                                          \
+    size_t newBuckets = buckets ? buckets : _CUCKOO_HASHMAP_MIN_BUCKETS;       \
+    while(newBuckets * _CUCKOO_HASHMAP_SLOTS < capacity) {                     \
+        newBuckets *= 2;                                                       \
+    }                                                                          \
+    return _##NAME##Rehash(map, newBuckets);                                   \
+}                                                                              \
+                                                                               \
+bool NAME##Find(const NAME *map,                                               \
+                _CuckooType##NAME **entry) {                                   \
+    size_t where;                                                              \
+    if(!map->buckets || !_##NAME##Lookup(map, *entry, _##NAME##Hash(*entry),   \
+                                         &where)) {                            \
+        return false;                                                          \
+    }                                                                          \
+    *entry = _##NAME##At(map, where);                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+HashMapPutResult NAME##Put(NAME *map,                                          \
+                           _CuckooType##NAME **entry,                          \
+                           HashMapDuplicateResolution dr) {                    \
+    if(!NAME##EnsureSize(map, map->size+1)) {                                  \
+        return HMPR_FAILED;                                                    \
+    }                                                                          \
+    uint64_t hash = _##NAME##Hash(*entry);                                     \
+    size_t where;                                                              \
+    if(_##NAME##Lookup(map, *entry, hash, &where)) {                           \
+        _CuckooType##NAME *current = _##NAME##At(map, where);                  \
+        switch(dr) {                                                           \
+            case HMDR_FIND:                                                    \
+                *entry = current;                                              \
+                return HMPR_FOUND;                                             \
+            case HMDR_REPLACE:                                                 \
+                *current = **entry;                                            \
+                *entry = current;                                              \
+                return HMPR_REPLACED;                                          \
+            case HMDR_SWAP: {                                                  \
+                _CuckooType##NAME tmp = *current;                              \
+                *current = **entry;                                            \
+                **entry = tmp;                                                 \
+                *entry = current;                                              \
+                return HMPR_SWAPPED;                                           \
+            }                                                                  \
+            default:                                                           \
+                *entry = current;                                              \
+                return HMPR_FAILED;                                            \
+        }                                                                      \
+    }                                                                          \
+    _CuckooType##NAME *placed;                                                 \
+    while(!(placed = _##NAME##Place(map, *entry, hash))) {                     \
+        if(!_##NAME##MayGrow(map, (map->mask + 1) * 2) ||                      \
+                   !_##NAME##Rehash(map, (map->mask + 1) * 2)) {               \
+            return HMPR_FAILED;                                                \
+        }                                                                      \
+    }                                                                          \
+    *entry = placed;                                                           \
+    ++map->size;                                                               \
+    return HMPR_PUT;                                                           \
+}                                                                              \
+                                                                               \
+bool NAME##Remove(NAME *map,                                                   \
+                  _CuckooType##NAME *entry) {                                  \
+    size_t where;                                                              \
+    if(!map->buckets || !_##NAME##Lookup(map, entry, _##NAME##Hash(entry),     \
+                                         &where)) {                            \
+        return false;                                                          \
+    }                                                                          \
+    *entry = *_##NAME##At(map, where);                                         \
+    --map->size;                                                               \
+    size_t slots = (map->mask + 1) * _CUCKOO_HASHMAP_SLOTS;                    \
+    if(where >= slots) {                                                       \
+        size_t i = where - slots, last = --map->stashSize;                     \
+        map->stash[i] = map->stash[last];                                      \
+        map->stashHashes[i] = map->stashHashes[last];                          \
+        return true;                                                           \
+    }                                                                          \
+    size_t index = where / _CUCKOO_HASHMAP_SLOTS;                              \
+    NAME##Bucket *bucket = &map->buckets[index];                               \
+    bucket->tags[where % _CUCKOO_HASHMAP_SLOTS] = 0;                           \
+    /* move a stashed entry into the free slot, if it belongs there */         \
+    for(size_t i = 0; i < map->stashSize; ++i) {                               \
+        uint64_t hash = map->stashHashes[i];                                   \
+        uint8_t tag = _cuckooHashMapTag(hash);                                 \
+        size_t home = (size_t) hash & map->mask;                               \
+        if(home == index ||                                                    \
+                   _cuckooHashMapOther(home, tag, map->mask) == index) {       \
+            _##NAME##PutInto(bucket, &map->stash[i], tag);                     \
+            size_t last = --map->stashSize;                                    \
+            map->stash[i] = map->stash[last];                                  \
+            map->stashHashes[i] = map->stashHashes[last];                      \
+            break;                                                             \
+        }                                                                      \
+    }                                                                          \
+    return true;                                                               \
+}
+
+
+/**
+ * Iterates over all entries of a cuckoo map.
+ * You must not insert or delete elements in this loop.
+ * You can use continue and break as in usual for-loops.
+ *
+ *     CUCKOO_HASHMAP_FOR_EACH(NAME, iter, map) {
+ *         do_something(iter);
+ *     } CUCKOO_HASHMAP_FOR_EACH_END
+ *
+ * \param NAME Defined name of map
+ * \param ITER TYPE* variable for the current entry.
+ * \param MAP Map to iterate over.
+ */
+#define CUCKOO_HASHMAP_FOR_EACH(NAME, ITER, MAP)                               \
+    for(size_t __i = 0, __broke = 0, __slots = (MAP).buckets ?                 \
+                           ((MAP).mask + 1) * _CUCKOO_HASHMAP_SLOTS : 0;       \
+        !__broke && __i < __slots + (MAP).stashSize; ++__i) {                  \
+        if(__i < __slots && !(MAP).buckets[__i / _CUCKOO_HASHMAP_SLOTS]        \
+                                   .tags[__i % _CUCKOO_HASHMAP_SLOTS]) {       \
+            continue;                                                          \
+        }                                                                      \
+        ITER = __i < __slots ? &(MAP).buckets[__i / _CUCKOO_HASHMAP_SLOTS]     \
+                                   .entries[__i % _CUCKOO_HASHMAP_SLOTS]       \
+                             : &(MAP).stash[__i - __slots];                    \
+        __broke = 1;                                                           \
+        do
+
+
+/**
+ * Closes a CUCKOO_HASHMAP_FOR_EACH(...)
+ */
+#define CUCKOO_HASHMAP_FOR_EACH_END                                            \
+        while( __broke = 0, __broke );                                         \
+    }
+
+#endif // ifndef CUCKOOHASHMAP_H__
@@ -0,0 +1,57 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Counts the C keywords of stdin, using a static map generated from
+// keywords.txt.
+//
+// Generate and compile:
+// ../tools/staticHashMapGen keywordMap keywords < keywords.txt > keywords.inc
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 keywords.c -o keywords
+
+#include "../statichashmap.h"
+#include <stdio.h>
+
+typedef enum {
+	KW_AUTO, KW_BREAK, KW_CASE, KW_CHAR, KW_CONST, KW_CONTINUE, KW_DEFAULT,
+	KW_DO, KW_DOUBLE, KW_ELSE, KW_ENUM, KW_EXTERN, KW_FLOAT, KW_FOR, KW_GOTO,
+	KW_IF, KW_INLINE, KW_INT, KW_LONG, KW_REGISTER, KW_RESTRICT, KW_RETURN,
+	KW_SHORT, KW_SIGNED, KW_SIZEOF, KW_STATIC, KW_STRUCT, KW_SWITCH,
+	KW_TYPEDEF, KW_UNION, KW_UNSIGNED, KW_VOID, KW_VOLATILE, KW_WHILE,
+	KW_COUNT,
+} KeywordToken;
+
+typedef struct {
+	const char   *name;
+	KeywordToken  token;
+} Keyword;
+
+#define KEYWORD_CMP(left, right) strcmp((left)->name, (right)->name)
+#define KEYWORD_HASH(entry) staticHashMapStringHash((entry)->name)
+
+DEFINE_STATIC_HASHMAP(keywordMap, Keyword)
+DECLARE_STATIC_HASHMAP(keywordMap, KEYWORD_CMP, KEYWORD_HASH)
+
+#include "keywords.inc"
+
+int main() {
+	size_t counts[KW_COUNT] = { 0 };
+
+	char word[129];
+	while(scanf("%*[^a-z]"), scanf("%128[a-z]", word) == 1) {
+		Keyword key = { .name = word }, *found = &key;
+		if(keywordMapFind(&keywords, &found)) {
+			++counts[found->token];
+		}
+	}
+
+	const Keyword *iter;
+	STATIC_HASHMAP_FOR_EACH(keywordMap, iter, keywords) {
+		if(counts[iter->token]) {
+			printf("%8zu %s\n", counts[iter->token], iter->name);
+		}
+	} STATIC_HASHMAP_FOR_EACH_END
+
+	return 0;
+}
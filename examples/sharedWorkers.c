@@ -0,0 +1,119 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Pre-forked workers that look up prices in a map the parent process keeps
+// updating. The map lives in a memfd_create(2) file, so there is one copy of
+// it for all processes, and the workers never lock.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 sharedWorkers.c -o sharedWorkers
+//
+// Usage: ./sharedWorkers [workers] [products] [seconds]
+
+#define _GNU_SOURCE
+#include "../sharedhashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+
+typedef struct {
+	uint64_t product;
+	uint64_t price;
+	uint64_t cents; // always price % 100, to check for torn reads
+} Price;
+
+#define PRICE_CMP(left, right) ((left)->product != (right)->product)
+#define PRICE_GET_HASH(entry) ((size_t) mix((entry)->product))
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+DEFINE_SHARED_HASHMAP(PriceMap, Price)
+DECLARE_SHARED_HASHMAP(PriceMap, PRICE_CMP, PRICE_GET_HASH)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int work(int fd, int worker, uint64_t products, double until) {
+	PriceMap map;
+	if(!PriceMapAttach(&map, fd, false)) {
+		return 1;
+	}
+	uint64_t lookups = 0, state = worker;
+	while(now() < until) {
+		for(int i = 0; i < 1024; ++i) {
+			Price price = { .product = mix(++state) % products };
+			if(!PriceMapFind(&map, &price) || price.price % 100 != price.cents) {
+				fprintf(stderr, "worker %d: bad price of %llu\n", worker,
+				        (unsigned long long) price.product);
+				return 1;
+			}
+		}
+		lookups += 1024;
+	}
+	printf("worker %d: %llu lookups\n", worker, (unsigned long long) lookups);
+	PriceMapDetach(&map);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int workers = argc > 1 ? atoi(argv[1]) : 4;
+	uint64_t products = argc > 2 ? strtoull(argv[2], NULL, 0) : 1000000;
+	double seconds = argc > 3 ? atof(argv[3]) : 2;
+
+	int fd = memfd_create("prices", 0);
+	PriceMap map;
+	if(fd < 0 || !PriceMapCreate(&map, fd, 256 << 20) ||
+	             !PriceMapEnsureSize(&map, products)) {
+		perror("PriceMapCreate");
+		return 1;
+	}
+	for(uint64_t i = 0; i < products; ++i) {
+		Price price = { i, 1000 + i % 9000, (1000 + i % 9000) % 100 };
+		if(PriceMapPut(&map, &price, HMDR_FAIL) != HMPR_PUT) {
+			fprintf(stderr, "the region is too small\n");
+			return 1;
+		}
+	}
+
+	double until = now() + seconds;
+	for(int i = 0; i < workers; ++i) {
+		pid_t pid = fork();
+		if(pid == 0) {
+			exit(work(fd, i, products, until));
+		} else if(pid < 0) {
+			perror("fork");
+			return 1;
+		}
+	}
+
+	uint64_t updates = 0, state = 0;
+	while(now() < until) {
+		for(int i = 0; i < 1024; ++i) {
+			uint64_t random = mix(--state);
+			Price price = { random % products, random >> 40, 0 };
+			price.cents = price.price % 100;
+			PriceMapPut(&map, &price, HMDR_REPLACE);
+		}
+		updates += 1024;
+	}
+	printf("parent: %llu updates\n", (unsigned long long) updates);
+
+	int failed = 0, status;
+	while(wait(&status) > 0) {
+		failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+	}
+	PriceMapDetach(&map);
+	close(fd);
+	return failed;
+}
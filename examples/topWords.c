@@ -0,0 +1,65 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Prints the 10 most frequent words of stdin.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 topWords.c -o topWords
+
+#include "../countermap.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TOP 10
+
+// http://www.cse.yorku.ca/~oz/hash.html
+static uint64_t djb2(char *str) {
+	unsigned long hash = 5381;
+	char c;
+	while( (c = *str++) ) {
+		hash = ((hash << 5) + hash) + c;
+	}
+	return hash;
+}
+
+#define STRING_CMP(left, right) strcmp(*left, *right)
+#define STRING_HASH(entry) djb2(*entry)
+
+DEFINE_COUNTER_MAP(wordCounter, char*)
+DECLARE_COUNTER_MAP(wordCounter, STRING_CMP, STRING_HASH, free, realloc)
+
+int main() {
+	wordCounter map;
+	wordCounterNew(&map);
+
+	char line[129], *word = line;
+	while(scanf("%128s", line) == 1) {
+		wordCounterEntry *entry = wordCounterIncrement(&map, &word, 1);
+		if(!entry) {
+			return 1;
+		}
+		if(entry->key == line) {
+			// new word, the map must not keep our buffer
+			entry->key = strdup(line);
+			if(!entry->key) {
+				return 1;
+			}
+		}
+	}
+
+	wordCounterEntry top[TOP];
+	size_t count = wordCounterTopK(&map, TOP, top);
+	for(size_t i = 0; i < count; ++i) {
+		printf("%.5lld %s\n", (long long) top[i].count, top[i].key);
+	}
+
+	wordCounterEntry *iter;
+	HASHMAP_FOR_EACH(wordCounter, iter, map) {
+		free(iter->key);
+	} HASHMAP_FOR_EACH_END
+	wordCounterDestroy(&map);
+
+	return 0;
+}
@@ -10,6 +10,11 @@
 #include <stdbool.h>
 #include <string.h>
 
+#ifdef HASHMAP_HUGE_PAGES
+#   include <stdlib.h>
+#   include <sys/mman.h>
+#endif
+
 typedef enum {
     HMDR_FAIL = 0, // returns old entry in parameter entry, lets NAME##Put()
                    // "fail", i.e. return HMPR_FAILED
@@ -17,7 +22,8 @@ typedef enum {
     HMDR_REPLACE,  // puts new entry, replaces current entry if exists
     HMDR_SWAP,     // puts new entry, swappes old entry with *entry otherwise
     HMDR_STACK,    // put an duplicate input the map (later you have to call
-                   // delete multiple times)
+                   // delete multiple times), right after the other
+                   // duplicates, see NAME##FindAll()
 } HashMapDuplicateResolution;
 
 typedef enum {
@@ -35,22 +41,196 @@ typedef enum {
     _HMNPR_GREW,
 } _HashMapNextPrimeResult;
 
+// Number of entries a set operation hashes and prefetches at once, see
+// NAME##Union(...).
+#define _HASHMAP_SET_BATCH 16
+
+// The marks of a set operation start a new word every this many buckets, so
+// threads can mark chunks of buckets independently.
+#define _HASHMAP_SET_CHUNK 1024
+
+// How many buckets ahead NAME##Clone(...) prefetches the bucket arrays.
+#define _HASHMAP_CLONE_PREFETCH 16
+
+/**
+ * Growth policy of a map, see DECLARE_HASHMAP_EX(...).
+ */
+typedef struct {
+    unsigned      maxLoad;     // entries per 100 buckets, before the table
+                               // grows, e.g. 75 for a load factor of 0.75
+    unsigned      growth;      // the table grows at least by this percentage,
+                               // it always grows to the next table size, which
+                               // is roughly twice as large
+    const size_t *bucketSizes; // ascending capacities of the bucket arrays,
+                               // starting with 1, terminated by 0, or NULL for
+                               // the primes of _HASHMAP_PRIMES
+} HashMapPolicy;
+
+/**
+ * Creates a HashMapPolicy for DECLARE_HASHMAP_EX(...).
+ */
+#define HASHMAP_POLICY(MAX_LOAD, GROWTH, BUCKET_SIZES)                         \
+    ((HashMapPolicy) { (MAX_LOAD), (GROWTH), (BUCKET_SIZES) })
+
+/**
+ * The policy of DECLARE_HASHMAP(...).
+ */
+#define HASHMAP_DEFAULT_POLICY HASHMAP_POLICY(75, 100, NULL)
+
 // http://oeis.org/A014234
 // Buckets should mostly contain one element (if the hash function is good), so
 // I put in 1 instead of 2.
-#define _HASHMAP_PRIMES 1, 3, 7, 13, 31, 61, 127, 251, 509, 1021, 2039,        \
+#define _HASHMAP_PRIMES_32                                                     \
+                        1, 3, 7, 13, 31, 61, 127, 251, 509, 1021, 2039,        \
                         4093, 8191, 16381, 32749, 65521, 131071, 262139,       \
                         524287, 1048573, 2097143, 4194301, 8388593, 16777213,  \
                         33554393, 67108859, 134217689, 268435399, 536870909,   \
                         1073741789, 2147483647
 
-#define _HashStructure(VALUE_TYPE)                                             \
+#if SIZE_MAX > 0xFFFFFFFFu
+#   define _HASHMAP_PRIMES _HASHMAP_PRIMES_32,                                 \
+                        4294967291u, 8589934583u, 17179869143u, 34359738337u,  \
+                        68719476731u, 137438953447u, 274877906899u,            \
+                        549755813881u, 1099511627689u, 2199023255531u,         \
+                        4398046511093u, 8796093022151u, 17592186044399u,       \
+                        35184372088777u, 70368744177643u, 140737488355213u,    \
+                        281474976710597u, 562949953421231u,                    \
+                        1125899906842597u, 2251799813685119u,                  \
+                        4503599627370449u, 9007199254740881u,                  \
+                        18014398509481951u, 36028797018963913u,                \
+                        72057594037927931u, 144115188075855859u,               \
+                        288230376151711717u, 576460752303423433u,              \
+                        1152921504606846883u, 2305843009213693951u,            \
+                        4611686018427387847u, 9223372036854775783u
+#else
+#   define _HASHMAP_PRIMES _HASHMAP_PRIMES_32
+#endif
+
+/**
+ * Blocked Bloom filter, see NAME##FilterNew(...).
+ * Every hash sets 4 bits in one 512 bit block, so a lookup touches a single
+ * cache line.
+ */
+typedef struct {
+    size_t    blocks;  // number of blocks
+    size_t    removed; // entries removed since the last rebuild
+    uint64_t *bits;    // blocks * 8 words, cache line aligned
+} HashMapFilter;
+
+#define _HASHMAP_FILTER_BLOCK_WORDS 8
+
+// A block per 48 buckets gives about 14 bits per entry at a load factor of
+// 0.75, i.e. about 0.5% false positives.
+#define _HASHMAP_FILTER_BUCKETS_PER_BLOCK 48
+
+// Rebuild the filter after this many removes per block.
+#define _HASHMAP_FILTER_REMOVED_PER_BLOCK 8
+
+/**
+ * Size of a filter allocation for a table of the given capacity, including
+ * the alignment slack.
+ */
+static inline size_t _hashmapFilterSize(size_t capacity, size_t *blocks) {
+    *blocks = capacity / _HASHMAP_FILTER_BUCKETS_PER_BLOCK + 1;
+    return sizeof(HashMapFilter) + 63 +
+           *blocks * sizeof(uint64_t[_HASHMAP_FILTER_BLOCK_WORDS]);
+}
+
+/**
+ * Initializes a freshly allocated filter, see _hashmapFilterSize(...).
+ */
+static inline void _hashmapFilterInit(HashMapFilter *filter, size_t blocks) {
+    uintptr_t bits = (uintptr_t) (filter + 1);
+    filter->blocks = blocks;
+    filter->removed = 0;
+    filter->bits = (uint64_t*) ((bits + 63) & ~(uintptr_t) 63);
+    memset(filter->bits, 0,
+           blocks * sizeof(uint64_t[_HASHMAP_FILTER_BLOCK_WORDS]));
+}
+
+/**
+ * murmur3's finalizer, the map's hash is often the identity.
+ */
+static inline uint64_t _hashmapFilterMix(size_t hash) {
+    uint64_t h = (uint64_t) hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdu;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53u;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline void _hashmapFilterAdd(HashMapFilter *filter, size_t hash) {
+    uint64_t h = _hashmapFilterMix(hash);
+    uint64_t *block = &filter->bits[(h % filter->blocks) *
+                                    _HASHMAP_FILTER_BLOCK_WORDS];
+    for(int k = 0; k < 4; ++k, h >>= 9) {
+        block[(h >> 34) & 7] |= (uint64_t) 1 << ((h >> 28) & 63);
+    }
+}
+
+/**
+ * \return false, if no entry with the hash is in the map.
+ */
+static inline bool _hashmapFilterMayContain(const HashMapFilter *filter,
+                                            size_t hash) {
+    uint64_t h = _hashmapFilterMix(hash);
+    const uint64_t *block = &filter->bits[(h % filter->blocks) *
+                                          _HASHMAP_FILTER_BLOCK_WORDS];
+    for(int k = 0; k < 4; ++k, h >>= 9) {
+        if(!(block[(h >> 34) & 7] & ((uint64_t) 1 << ((h >> 28) & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// shared: the table belongs to the newest snapshot, see NAME##SnapshotNew().
+// filter: NULL, unless NAME##FilterNew(...) was called.
+#define _HashStructure(VALUE_TYPE, SNAPSHOT_TYPE)                              \
 struct {                                                                       \
-    size_t      size;                                                          \
+    size_t         size;                                                       \
+    uint8_t        nth_prime;                                                  \
+    bool           shared;                                                     \
+    VALUE_TYPE    *entries;                                                    \
+    SNAPSHOT_TYPE *snapshot;                                                   \
+    HashMapFilter *filter;                                                     \
+}
+
+// A bucket takes two words on 64-bit platforms. If an entry fits into the
+// entries pointer, a bucket of capacity 1 stores it in there instead of
+// allocating an array, see _HASHMAP_ENTRIES(...).
+// borrowed: the array belongs to an older snapshot, see NAME##SnapshotNew().
+#define _HashBucketStructure(VALUE_TYPE)                                       \
+struct {                                                                       \
+    uint32_t    size;                                                          \
     uint8_t     nth_prime;                                                     \
+    uint8_t     borrowed;                                                      \
     VALUE_TYPE *entries;                                                       \
 }
 
+/**
+ * True if BUCKET stores its only entry inline, i.e. has no array to free.
+ */
+#define _HASHMAP_IS_INLINE(NAME, BUCKET)                                       \
+    (_##NAME##Inline && (BUCKET).nth_prime == 0)
+
+/**
+ * True if BUCKET has an array that has to be freed with its table.
+ */
+#define _HASHMAP_OWNS_ENTRIES(NAME, BUCKET)                                    \
+    (!_HASHMAP_IS_INLINE(NAME, BUCKET) && (BUCKET).entries &&                  \
+                                          !(BUCKET).borrowed)
+
+/**
+ * Pointer to the entries of BUCKET.
+ */
+#define _HASHMAP_ENTRIES(NAME, BUCKET)                                         \
+    (_HASHMAP_IS_INLINE(NAME, BUCKET)                                          \
+            ? (_HashType##NAME*) (void*) &(BUCKET).entries                     \
+            : (BUCKET).entries)
+
 /**
  * Defines hashmap helper functions for type NAME.
  * \param NAME Typedef'd name of the HashMap type.
@@ -61,8 +241,24 @@ struct {                                                                       \
 extern const size_t _##NAME##Primes[];                                         \
                                                                                \
 typedef TYPE _HashType##NAME;                                                  \
-typedef _HashStructure(_HashType##NAME) NAME##Bucket;                          \
-typedef _HashStructure(NAME##Bucket)    NAME;                                  \
+typedef _HashBucketStructure(_HashType##NAME) NAME##Bucket;                    \
+typedef _HashStructure(NAME##Bucket, struct _##NAME##Snapshot) NAME;           \
+                                                                               \
+/* A read-only view of a map, see NAME##SnapshotNew().                       */\
+/* Use NAME##Find(&snapshot.map, ...), HASHMAP_FOR_EACH(NAME, iter,          */\
+/* snapshot.map), etc. to read it.                                           */\
+typedef struct _##NAME##Snapshot {                                             \
+    NAME                      map;                                             \
+    NAME                     *live;                                            \
+    struct _##NAME##Snapshot *older;                                           \
+    struct _##NAME##Snapshot *newer;                                           \
+} NAME##Snapshot;                                                              \
+                                                                               \
+enum {                                                                         \
+    _##NAME##Inline = sizeof(_HashType##NAME) <= sizeof(_HashType##NAME*) &&   \
+                      __alignof__(_HashType##NAME) <=                          \
+                                            __alignof__(_HashType##NAME*),     \
+};                                                                             \
                                                                                \
 /* Initializes an empty hashmap.                                             */\
 /* An null'ed map is initalized too, but has an empty capacity (which grows  */\
@@ -103,7 +299,171 @@ HashMapPutResult NAME##Put(NAME *map,                                          \
 /* \param entry [In/out] Entry to remove, returns removed entry.             */\
 /* \return false, if did not exist                                           */\
 bool NAME##Remove(NAME *map,                                                   \
-                  _HashType##NAME *entry);
+                  _HashType##NAME *entry);                                     \
+                                                                               \
+/* Looks up all entries equal to *entry, which were put with HMDR_STACK.     */\
+/* They are stored next to each other, in the order they were put.           */\
+/* The returned range is valid until the map is modified.                    */\
+/* \param map Map to search in.                                              */\
+/* \param entry [In/Out] Entry to search, returns pointer to the first found */\
+/*              item.                                                        */\
+/* \return number of items found, 0 if could not found.                      */\
+size_t NAME##FindAll(const NAME *map,                                          \
+                     _HashType##NAME **entry);                                 \
+                                                                               \
+/* Counts the entries equal to *entry.                                       */\
+/* \param map Map to search in.                                              */\
+/* \param entry Entry to search.                                             */\
+/* \return number of items found.                                            */\
+size_t NAME##Count(const NAME *map,                                            \
+                   _HashType##NAME *entry);                                    \
+                                                                               \
+/* Removes all entries equal to *entry.                                      */\
+/* \param map Map to remove from.                                            */\
+/* \param entry Entry to remove.                                             */\
+/* \return number of items removed.                                          */\
+size_t NAME##RemoveAll(NAME *map,                                              \
+                       _HashType##NAME *entry);                                \
+                                                                               \
+/* Takes a consistent read-only view of a map in O(1). The snapshot shares   */\
+/* the buckets with the map. The map copies its top-level bucket array with  */\
+/* the first modification after the snapshot, and a bucket array the first   */\
+/* time it modifies the bucket, so the memory grows with the number of       */\
+/* modified buckets only.                                                    */\
+/* While snapshots exist, you must not move map or snapshot, and you must    */\
+/* not modify entries through pointers you got from NAME##Find().            */\
+/* Pointers returned by NAME##Put() are safe to modify.                      */\
+/* Other threads may read the snapshot while the map is modified, but        */\
+/* taking and destroying snapshots counts as modifying the map.              */\
+/* \param map Map to take the snapshot of.                                   */\
+/* \param snapshot [Out] Snapshot to initialize.                             */\
+void NAME##SnapshotNew(NAME *map,                                              \
+                       NAME##Snapshot *snapshot);                              \
+                                                                               \
+/* Destroys a snapshot. Snapshots may be destroyed in any order, before or   */\
+/* after their map was destroyed.                                            */\
+/* \param snapshot Snapshot to destroy.                                      */\
+void NAME##SnapshotDestroy(NAME##Snapshot *snapshot);                          \
+                                                                               \
+/* Puts a Bloom filter in front of the map, so that most lookups of missing  */\
+/* entries cost a single cache line access. Worth it if most lookups miss.   */\
+/* The filter needs about 1/48 of the memory of the map's top-level array.   */\
+/* \param map Map to filter.                                                 */\
+/* \return false, if memory is exhausted.                                    */\
+bool NAME##FilterNew(NAME *map);                                               \
+                                                                               \
+/* Removes the Bloom filter from the map, see NAME##FilterNew().             */\
+/* \param map Map to remove the filter from.                                 */\
+void NAME##FilterDestroy(NAME *map);                                           \
+                                                                               \
+/* A position in a map, see NAME##IterBegin().                               */\
+typedef struct {                                                               \
+    NAME   *map;                                                               \
+    size_t  bucket;                                                            \
+    size_t  nth;                                                               \
+} NAME##Iter;                                                                  \
+                                                                               \
+/* Starts iterating over all entries of a map. You must not put entries      */\
+/* during the iteration, but you may erase the current entry with            */\
+/* NAME##IterErase().                                                        */\
+/* \param map Map to iterate over.                                           */\
+/* \param iter [Out] Iterator to initialize.                                 */\
+/* \return the first entry, NULL if the map is empty.                        */\
+_HashType##NAME *NAME##IterBegin(NAME *map,                                    \
+                                 NAME##Iter *iter);                            \
+                                                                               \
+/* Advances an iterator.                                                     */\
+/* \param iter Iterator to advance.                                          */\
+/* \return the next entry, NULL if there are no more entries.                */\
+_HashType##NAME *NAME##IterNext(NAME##Iter *iter);                             \
+                                                                               \
+/* Removes the current entry of an iterator in O(1) without hashing it. The  */\
+/* last entry of its bucket takes its place, unless one of them is stacked   */\
+/* (HMDR_STACK), then the rest of the bucket moves up. Either way            */\
+/* NAME##IterNext() continues with the entries not visited yet.              */\
+/* \param iter Iterator pointing to the entry to remove.                     */\
+/* \param entry [Out] Removed entry, may be NULL.                            */\
+/* \return false, if iter points to no entry, or if memory is exhausted      */\
+/*         while copying the bucket from a snapshot.                         */\
+bool NAME##IterErase(NAME##Iter *iter,                                         \
+                     _HashType##NAME *entry);                                  \
+                                                                               \
+/* Position of a scan, see NAME##Scan(). Zero it to start a scan.            */\
+typedef struct {                                                               \
+    NAME##Snapshot snapshot; /* the map as the scan started                  */\
+    size_t         bucket;   /* next bucket of the snapshot to scan          */\
+    bool           started;                                                    \
+} NAME##ScanCursor;                                                            \
+                                                                               \
+/* Scans a map a few buckets at a time, like SCAN of Redis. You may put and  */\
+/* remove entries between the calls, and fn may remove its entry with        */\
+/* NAME##Remove(), but must not put entries. Every entry that is in the map  */\
+/* for the whole scan is visited at least once, entries put during the scan  */\
+/* may be visited, too.                                                      */\
+/* The scan takes a snapshot of the map when it starts, and walks its        */\
+/* buckets, so it ends after as many buckets as the map had then, however    */\
+/* much it grows. While the map keeps that size, fn gets the entries of the  */\
+/* same bucket of the map. Once it grew, the entries of each bucket of the   */\
+/* snapshot are looked up in the map, and fn gets the entries equal to them. */\
+/* The snapshot makes the map copy the buckets it modifies during the scan,  */\
+/* see NAME##SnapshotNew(). You must not move the map or the cursor while    */\
+/* the scan runs. Use NAME##ScanStop() to end it early.                      */\
+/* \param map Map to scan.                                                   */\
+/* \param cursor [In/Out] Position of the scan, zeroed to start a new one.   */\
+/*               It is zeroed again when the scan is complete.               */\
+/* \param budget Visits buckets until about budget buckets and entries were  */\
+/*               visited, but at least one bucket.                           */\
+/* \param fn Function to call for each visited entry.                        */\
+/* \param ctx Passed to fn.                                                  */\
+/* \return false, if the scan is complete.                                   */\
+bool NAME##Scan(NAME *map,                                                     \
+                NAME##ScanCursor *cursor,                                      \
+                size_t budget,                                                 \
+                void (*fn)(_HashType##NAME *entry, void *ctx),                 \
+                void *ctx);                                                    \
+                                                                               \
+/* Ends a scan before NAME##Scan() returned false, and zeroes the cursor.    */\
+/* May be called after the map was destroyed.                                */\
+/* \param cursor Position of the scan.                                       */\
+void NAME##ScanStop(NAME##ScanCursor *cursor);                                 \
+                                                                               \
+/* Set operations: Entries are equal if CMP says so. Stacked entries count   */\
+/* as separate entries of the same key. The result is put into out, which    */\
+/* may be left to compute it in place, or e.g. a new map, then out keeps     */\
+/* the entries it had, and the entries put into it are stacked behind equal  */\
+/* ones as with HMDR_STACK. The entries of the result are copied from left,  */\
+/* or from right if there is no equal entry in left.                         */\
+/* The smaller operand is iterated where possible, and the other one is      */\
+/* probed in prefetched batches. See hashmapParallel.h for multi-threaded    */\
+/* variants.                                                                 */\
+/* out must not be right, unless it is left, too.                            */\
+/* \return false, if memory is exhausted. out may hold a partial result.     */\
+/*                                                                           */\
+/* Puts the entries of left and the entries of right that have no equal      */\
+/* entry in left into out.                                                   */\
+bool NAME##Union(NAME *out,                                                    \
+                 const NAME *left,                                             \
+                 const NAME *right);                                           \
+                                                                               \
+/* Puts the entries of left that have an equal entry in right into out.      */\
+bool NAME##Intersect(NAME *out,                                                \
+                     const NAME *left,                                         \
+                     const NAME *right);                                       \
+                                                                               \
+/* Puts the entries of left that have no equal entry in right into out.      */\
+bool NAME##Difference(NAME *out,                                               \
+                      const NAME *left,                                        \
+                      const NAME *right);                                      \
+                                                                               \
+/* Copies a map without hashing or comparing its entries: the table and      */\
+/* every bucket array are copied as they are, so that it costs about a       */\
+/* memcpy() of the map. The filter is copied, too, but not the snapshots.    */\
+/* src may be a snapshot's map.                                              */\
+/* \param dst [Out] Map to initialize as a copy.                             */\
+/* \param src Map to copy.                                                   */\
+/* \return false, if memory is exhausted. dst is empty then.                 */\
+bool NAME##Clone(NAME *dst,                                                    \
+                 const NAME *src);
 
 /**
  * To iterate over all entries in order they are saved in the map.
@@ -127,12 +487,12 @@ bool NAME##Remove(NAME *map,                                                   \
         }                                                                      \
         for(size_t __i = 0, __broke = 0; !__broke &&                           \
                                __i < _##NAME##Primes[(MAP).nth_prime]; ++__i) {\
-            if(!(MAP).entries[__i].entries) {                                  \
+            if(!(MAP).entries[__i].size) {                                     \
                 continue;                                                      \
             }                                                                  \
             for(size_t __h = 0; !__broke && __h < (MAP).entries[__i].size;     \
                                                                       ++__h) { \
-                ITER = &(MAP).entries[__i].entries[__h];                       \
+                ITER = &_HASHMAP_ENTRIES(NAME, (MAP).entries[__i])[__h];       \
                 __broke = 1;                                                   \
                 do
 
@@ -146,8 +506,11 @@ bool NAME##Remove(NAME *map,                                                   \
     } while(0);
 
 /**
- * Like HASHMAP_FOR_EACH(ITER, MAP), but you are safe to delete elements during
- * the loop. You deleted elements may or may not show up during the for-loop!
+ * Like HASHMAP_FOR_EACH(ITER, MAP), but you are safe to delete ITER with
+ * NAME##Remove(...) during the loop. The entries of each bucket are visited
+ * back to front, so removing ITER moves no entry that was not visited yet.
+ * Other entries you delete may or may not show up during the for-loop!
+ * Use NAME##IterBegin(...) to remove entries without hashing them again.
  */
 #define HASHMAP_FOR_EACH_SAFE_TO_DELETE(NAME, ITER, MAP)                       \
     do {                                                                       \
@@ -156,15 +519,12 @@ bool NAME##Remove(NAME *map,                                                   \
         }                                                                      \
         for(size_t __i = 0, __broke = 0; !__broke &&                           \
                                __i < _##NAME##Primes[(MAP).nth_prime]; ++__i) {\
-            if(!(MAP).entries[__i].entries) {                                  \
-                continue;                                                      \
-            }                                                                  \
-            const size_t __size = map.entries[__i].size;                       \
-            _HashType##NAME __entries[__size];                                 \
-            memcpy(__entries, &(MAP).entries[__i].entries, sizeof(__entries)); \
-            for(size_t __h = 0; !__broke && __h < __size; ++__h) {             \
-                ITER = &(MAP).entries[__i].entries[__h];                       \
-                __broke = true;                                                \
+            for(size_t __h = (MAP).entries[__i].size; !__broke && __h--; ) {   \
+                if(__h >= (MAP).entries[__i].size) {                           \
+                    continue;                                                  \
+                }                                                              \
+                ITER = &_HASHMAP_ENTRIES(NAME, (MAP).entries[__i])[__h];       \
+                __broke = 1;                                                   \
                 do
 
 /**
@@ -172,6 +532,67 @@ bool NAME##Remove(NAME *map,                                                   \
  */
 #define HASHMAP_FOR_EACH_SAFE_TO_DELETE_END HASHMAP_FOR_EACH_END
 
+#ifdef HASHMAP_HUGE_PAGES
+
+// Tables smaller than this are allocated with hashmapAlignedTableAlloc().
+#ifndef HASHMAP_HUGE_PAGES_THRESHOLD
+#   define HASHMAP_HUGE_PAGES_THRESHOLD (2 << 20)
+#endif
+
+#define _HASHMAP_CACHE_LINE 64
+
+/**
+ * TABLE_ALLOC for DECLARE_HASHMAP_ALIGNED(...): cache line aligned malloc().
+ */
+static inline void *hashmapAlignedTableAlloc(size_t size) {
+    void *table;
+    if(posix_memalign(&table, _HASHMAP_CACHE_LINE, size) != 0) {
+        return NULL;
+    }
+    return table;
+}
+
+/**
+ * TABLE_FREE for hashmapAlignedTableAlloc().
+ */
+static inline void hashmapAlignedTableFree(void *table, size_t size) {
+    (void) size;
+    free(table);
+}
+
+/**
+ * TABLE_ALLOC for DECLARE_HASHMAP_ALIGNED(...): tables of at least
+ * HASHMAP_HUGE_PAGES_THRESHOLD bytes are mmap'd and advised to be backed by
+ * transparent huge pages, smaller ones are cache line aligned.
+ */
+static inline void *hashmapHugeTableAlloc(size_t size) {
+    if(size < HASHMAP_HUGE_PAGES_THRESHOLD) {
+        return hashmapAlignedTableAlloc(size);
+    }
+    void *table = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(table == MAP_FAILED) {
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(table, size, MADV_HUGEPAGE);
+#endif
+    return table;
+}
+
+/**
+ * TABLE_FREE for hashmapHugeTableAlloc().
+ */
+static inline void hashmapHugeTableFree(void *table, size_t size) {
+    if(size < HASHMAP_HUGE_PAGES_THRESHOLD) {
+        hashmapAlignedTableFree(table, size);
+    } else {
+        munmap(table, size);
+    }
+}
+
+#endif // ifdef HASHMAP_HUGE_PAGES
+
 /**
  * Declares the hash map functions.
  * \param NAME Typedef'd name of the HashMap type.
@@ -185,47 +606,248 @@ bool NAME##Remove(NAME *map,                                                   \
  *                realloc(NULL, size) behaves as malloc(size).
  */
 #define DECLARE_HASHMAP(NAME, CMP, GET_HASH, FREE, REALLOC)                    \
+    DECLARE_HASHMAP_EX(NAME, CMP, GET_HASH, FREE, REALLOC,                     \
+                       HASHMAP_DEFAULT_POLICY)
+
+/**
+ * Like DECLARE_HASHMAP(...), but the top-level bucket array is allocated with
+ * TABLE_ALLOC, e.g. to align it, to back it with huge pages, or to place it on
+ * a chosen NUMA node. The bucket arrays are still allocated with REALLOC.
+ * \param TABLE_ALLOC void *(*tableAlloc)(size_t size). Needs not to zero the
+ *                    memory.
+ * \param TABLE_FREE void (*tableFree)(void *table, size_t size). Gets the same
+ *                   size that was passed to TABLE_ALLOC.
+ *
+ * If HASHMAP_HUGE_PAGES is defined before including hashmap.h, you can use
+ * hashmapAlignedTableAlloc/hashmapAlignedTableFree or
+ * hashmapHugeTableAlloc/hashmapHugeTableFree.
+ */
+#define DECLARE_HASHMAP_ALIGNED(NAME, CMP, GET_HASH, FREE, REALLOC,            \
+                                TABLE_ALLOC, TABLE_FREE)                       \
+    _DECLARE_HASHMAP(NAME, CMP, GET_HASH, FREE, REALLOC,                       \
+                     TABLE_ALLOC, TABLE_FREE, HASHMAP_DEFAULT_POLICY)
+
+/**
+ * Like DECLARE_HASHMAP(...), with a growth policy instead of the default one.
+ * \param POLICY A HashMapPolicy, e.g. HASHMAP_POLICY(90, 100, NULL) for a
+ *               load factor of 0.9. Pass HASHMAP_POLICY(...) or the name of a
+ *               static const HashMapPolicy, so that the compiler can fold it.
+ *
+ * A higher maxLoad or fewer bucket sizes save memory, a lower maxLoad makes
+ * lookups faster, a higher growth means fewer rehashes. NAME##Put() fails with
+ * HMPR_FAILED if maxLoad is 0, or if a bucket would outgrow the largest of the
+ * bucketSizes, e.g. for { 1, 0 } as soon as a second entry hits a bucket.
+ */
+#define DECLARE_HASHMAP_EX(NAME, CMP, GET_HASH, FREE, REALLOC, POLICY)         \
+                                                                               \
+static void *_##NAME##DefaultTableAlloc(size_t size) {                         \
+    return REALLOC(NULL, size);                                                \
+}                                                                              \
+                                                                               \
+static void _##NAME##DefaultTableFree(void *table, size_t size) {              \
+    (void) size;                                                               \
+    FREE(table);                                                               \
+}                                                                              \
+                                                                               \
+_DECLARE_HASHMAP(NAME, CMP, GET_HASH, FREE, REALLOC,                           \
+                 _##NAME##DefaultTableAlloc, _##NAME##DefaultTableFree, POLICY)
+
+/**
+ * Common part of DECLARE_HASHMAP_EX(...) and DECLARE_HASHMAP_ALIGNED(...).
+ */
+#define _DECLARE_HASHMAP(NAME, CMP, GET_HASH, FREE, REALLOC,                   \
+                         TABLE_ALLOC, TABLE_FREE, POLICY)                      \
                                                                                \
 const size_t _##NAME##Primes[] = { _HASHMAP_PRIMES, 0 };                       \
                                                                                \
+/* Capacities of the bucket arrays, see HashMapPolicy.                       */\
+static inline const size_t *_##NAME##BucketSizes(void) {                       \
+    return (POLICY).bucketSizes ? (POLICY).bucketSizes : _##NAME##Primes;      \
+}                                                                              \
+                                                                               \
+/* Allocates an empty top-level bucket array.                                */\
+/* \param capacity Number of buckets.                                        */\
+/* \return NULL, if memory is exhausted.                                     */\
+static NAME##Bucket *_##NAME##NewTable(size_t capacity) {                      \
+    if(capacity > SIZE_MAX / sizeof(NAME##Bucket)) {                           \
+        return NULL;                                                           \
+    }                                                                          \
+    NAME##Bucket *table = (NAME##Bucket*) TABLE_ALLOC(                         \
+                                              sizeof(NAME##Bucket[capacity])); \
+    if(table) {                                                                \
+        memset(&table[0], 0, sizeof(NAME##Bucket[capacity]));                  \
+    }                                                                          \
+    return table;                                                              \
+}                                                                              \
+                                                                               \
+/* Frees a top-level bucket array, but not the buckets.                      */\
+/* \param capacity Number of buckets.                                        */\
+static void _##NAME##FreeTable(NAME##Bucket *table,                            \
+                               size_t capacity) {                              \
+    if(table) {                                                                \
+        TABLE_FREE(table, sizeof(NAME##Bucket[capacity]));                     \
+    }                                                                          \
+}                                                                              \
+                                                                               \
 void NAME##New(NAME *map) {                                                    \
     map->size = 0;                                                             \
     map->nth_prime = 0;                                                        \
+    map->shared = false;                                                       \
     map->entries = NULL;                                                       \
+    map->snapshot = NULL;                                                      \
+    map->filter = NULL;                                                        \
 }                                                                              \
                                                                                \
-void NAME##Destroy(NAME *map) {                                                \
-    if(map->entries) {                                                         \
+/* Frees the table of a map and the bucket arrays it owns.                   */\
+static void _##NAME##FreeOwned(NAME *map) {                                    \
+    if(map->entries && !map->shared) {                                         \
         size_t capacity = _##NAME##Primes[map->nth_prime];                     \
         for(size_t i = 0; i < capacity; ++i) {                                 \
-            if(map->entries[i].entries) {                                      \
+            if(_HASHMAP_OWNS_ENTRIES(NAME, map->entries[i])) {                 \
                 FREE(map->entries[i].entries);                                 \
             }                                                                  \
         }                                                                      \
+        _##NAME##FreeTable(map->entries, capacity);                            \
     }                                                                          \
-    FREE(map->entries);                                                        \
-    map->size = 0;                                                             \
-    map->nth_prime = 0;                                                        \
-    map->entries = NULL;                                                       \
 }                                                                              \
                                                                                \
-/* Looks for smallest prime p: 2^n < capacity <= p < 2^(n+1)                 */\
+void NAME##Destroy(NAME *map) {                                                \
+    _##NAME##FreeOwned(map);                                                   \
+    if(map->filter) {                                                          \
+        FREE(map->filter);                                                     \
+    }                                                                          \
+    for(NAME##Snapshot *s = map->snapshot; s; s = s->older) {                  \
+        s->live = NULL;                                                        \
+    }                                                                          \
+    NAME##New(map);                                                            \
+}                                                                              \
+                                                                               \
+void NAME##SnapshotNew(NAME *map,                                              \
+                       NAME##Snapshot *snapshot) {                             \
+    snapshot->map = *map;                                                      \
+    snapshot->map.shared = true;                                               \
+    snapshot->map.snapshot = NULL;                                             \
+    snapshot->map.filter = NULL;                                               \
+    snapshot->live = map;                                                      \
+    snapshot->older = map->snapshot;                                           \
+    snapshot->newer = NULL;                                                    \
+    if(snapshot->older) {                                                      \
+        snapshot->older->newer = snapshot;                                     \
+    }                                                                          \
+    map->snapshot = snapshot;                                                  \
+    map->shared = map->entries != NULL;                                        \
+}                                                                              \
+                                                                               \
+void NAME##SnapshotDestroy(NAME##Snapshot *snapshot) {                         \
+    NAME *table = &snapshot->map;                                              \
+    NAME *newer = snapshot->newer ? &snapshot->newer->map : snapshot->live;    \
+    if(snapshot->older && snapshot->older->map.entries == table->entries) {    \
+        /* the older snapshot owns the table */                                \
+    } else if(newer && newer->entries == table->entries) {                     \
+        /* the newer one inherits the table */                                 \
+        if(newer == snapshot->live) {                                          \
+            newer->shared = false;                                             \
+        }                                                                      \
+    } else if(table->entries) {                                                \
+        /* hand the arrays still used by the newer one over, free the rest */  \
+        size_t capacity = _##NAME##Primes[table->nth_prime];                   \
+        bool sameCapacity = newer && newer->entries &&                         \
+                            newer->nth_prime == table->nth_prime;              \
+        for(size_t i = 0; i < capacity; ++i) {                                 \
+            NAME##Bucket *bucket = &table->entries[i];                         \
+            if(!_HASHMAP_OWNS_ENTRIES(NAME, *bucket)) {                        \
+                continue;                                                      \
+            }                                                                  \
+            NAME##Bucket *newerBucket = sameCapacity ? &newer->entries[i]      \
+                                                     : NULL;                   \
+            if(newerBucket && !_HASHMAP_IS_INLINE(NAME, *newerBucket) &&       \
+                               newerBucket->entries == bucket->entries) {      \
+                newerBucket->borrowed = false;                                 \
+            } else {                                                           \
+                FREE(bucket->entries);                                         \
+            }                                                                  \
+        }                                                                      \
+        _##NAME##FreeTable(table->entries, capacity);                          \
+    }                                                                          \
+    if(snapshot->older) {                                                      \
+        snapshot->older->newer = snapshot->newer;                              \
+    }                                                                          \
+    if(snapshot->newer) {                                                      \
+        snapshot->newer->older = snapshot->older;                              \
+    } else if(snapshot->live) {                                                \
+        snapshot->live->snapshot = snapshot->older;                            \
+    }                                                                          \
+    NAME##New(table);                                                          \
+}                                                                              \
+                                                                               \
+/* Copies the table and the array of the index'th bucket, if they belong to  */\
+/* a snapshot.                                                               */\
+/* \return false, if memory is exhausted.                                    */\
+static bool _##NAME##UnshareAt(NAME *map,                                      \
+                               size_t index) {                                 \
+    if(!map->entries) {                                                        \
+        return true;                                                           \
+    }                                                                          \
+    if(map->shared) {                                                          \
+        size_t capacity = _##NAME##Primes[map->nth_prime];                     \
+        NAME##Bucket *table = _##NAME##NewTable(capacity);                     \
+        if(!table) {                                                           \
+            return false;                                                      \
+        }                                                                      \
+        memcpy(&table[0], &map->entries[0], sizeof(NAME##Bucket[capacity]));   \
+        for(size_t i = 0; i < capacity; ++i) {                                 \
+            if(!_HASHMAP_IS_INLINE(NAME, table[i]) && table[i].entries) {      \
+                table[i].borrowed = true;                                      \
+            }                                                                  \
+        }                                                                      \
+        map->entries = table;                                                  \
+        map->shared = false;                                                   \
+    }                                                                          \
+    NAME##Bucket *bucket = &map->entries[index];                               \
+    if(bucket->borrowed) {                                                     \
+        size_t capacity = _##NAME##BucketSizes()[bucket->nth_prime];           \
+        _HashType##NAME *entries = REALLOC(NULL,                               \
+                                          sizeof(_HashType##NAME[capacity]));  \
+        if(!entries) {                                                         \
+            return false;                                                      \
+        }                                                                      \
+        memcpy(entries, bucket->entries,                                       \
+               sizeof(_HashType##NAME[bucket->size]));                         \
+        bucket->entries = entries;                                             \
+        bucket->borrowed = false;                                              \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Like _##NAME##UnshareAt(), for the bucket of entry.                       */\
+static bool _##NAME##Unshare(NAME *map,                                        \
+                             _HashType##NAME *entry) {                         \
+    if(!map->entries) {                                                        \
+        return true;                                                           \
+    }                                                                          \
+    return _##NAME##UnshareAt(map, ((size_t)(GET_HASH(entry))) %               \
+                                   _##NAME##Primes[map->nth_prime]);           \
+}                                                                              \
+                                                                               \
+/* Looks for smallest size p in sizes: capacity <= p                         */\
+/* \param sizes _##NAME##Primes, or _##NAME##BucketSizes().                  */\
 /* \param capacity Capacity to ensure.                                       */\
 /* \param entries Boolean flag, if nth_prime_ is meaningful.                 */\
-/* \param entries nth_prime_ [In/out] current capacity, see _HASHMAP_PRIMES  */\
+/* \param entries nth_prime_ [In/out] current capacity, index into sizes     */\
 /* \param newSize_ [Out] p (see description)                                 */\
-static _HashMapNextPrimeResult _##NAME##NextPrime(size_t capacity,             \
+static _HashMapNextPrimeResult _##NAME##NextPrime(const size_t *sizes,         \
+                                                  size_t capacity,             \
                                                   const void *entries,         \
                                                   uint8_t *nth_prime_,         \
                                                   size_t *newSize_) {          \
-    size_t oldSize = _##NAME##Primes[*nth_prime_];                             \
+    size_t oldSize = sizes[*nth_prime_];                                       \
     if(!capacity || (entries && oldSize >= capacity)) {                        \
         return _HMNPR_NOT_NEEDED;                                              \
     }                                                                          \
     int nth_prime = 0;                                                         \
     size_t newSize;                                                            \
-    while((newSize = _##NAME##Primes[nth_prime]) < capacity) {                 \
-        if(!newSize) {                                                         \
+    while((newSize = sizes[nth_prime]) < capacity) {                           \
+        if(!newSize || nth_prime == UINT8_MAX) {                               \
             return _HMNPR_FAIL;                                                \
         }                                                                      \
         ++nth_prime;                                                           \
@@ -235,6 +857,40 @@ static _HashMapNextPrimeResult _##NAME##NextPrime(size_t capacity,             \
     return _HMNPR_GREW;                                                        \
 }                                                                              \
                                                                                \
+/* Looks for the table size for capacity entries, see HashMapPolicy.         */\
+/* \param map Map to grow.                                                   */\
+/* \param capacity Number of entries to ensure.                              */\
+/* \param nth_prime [Out] index of the new size in _##NAME##Primes           */\
+/* \param newSize [Out] new number of buckets                                */\
+static _HashMapNextPrimeResult _##NAME##TableSize(const NAME *map,             \
+                                                  size_t capacity,             \
+                                                  uint8_t *nth_prime,          \
+                                                  size_t *newSize) {           \
+    const unsigned maxLoad = (POLICY).maxLoad;                                 \
+    if(!maxLoad || capacity / maxLoad >= SIZE_MAX / 100) {                     \
+        return _HMNPR_FAIL;                                                    \
+    }                                                                          \
+    size_t buckets = capacity / maxLoad * 100 +                                \
+                     (capacity % maxLoad * 100 + maxLoad - 1) / maxLoad;       \
+    *nth_prime = map->nth_prime;                                               \
+    _HashMapNextPrimeResult result = _##NAME##NextPrime(                       \
+            _##NAME##Primes, buckets, map->entries, nth_prime, newSize);       \
+    size_t oldSize = _##NAME##Primes[map->nth_prime];                          \
+    if(result == _HMNPR_GREW && map->entries && (POLICY).growth > 100 &&       \
+                         oldSize <= SIZE_MAX / (POLICY).growth &&              \
+                         *newSize < oldSize * (POLICY).growth / 100) {         \
+        uint8_t grown = 0;                                                     \
+        size_t grownSize;                                                      \
+        if(_##NAME##NextPrime(_##NAME##Primes,                                 \
+                              oldSize * (POLICY).growth / 100, NULL,           \
+                              &grown, &grownSize) == _HMNPR_GREW) {            \
+            *nth_prime = grown;                                                \
+            *newSize = grownSize;                                              \
+        }                                                                      \
+    }                                                                          \
+    return result;                                                             \
+}                                                                              \
+                                                                               \
 /* Helper function that puts an entry into the map, with checking the size   */\
 /* or minding duplicates.                                                    */\
 /* \param map Map to put entry into.                                         */\
@@ -244,16 +900,54 @@ static _HashType##NAME *_##NAME##PutReal(NAME *map,                            \
                                          _HashType##NAME *entry) {             \
     NAME##Bucket *bucket = &map->entries[((size_t)(GET_HASH(entry))) %         \
                                          _##NAME##Primes[map->nth_prime]];     \
+    if(bucket->size == UINT32_MAX) {                                           \
+        return NULL;                                                           \
+    }                                                                          \
+    if(_HASHMAP_IS_INLINE(NAME, *bucket)) {                                    \
+        _HashType##NAME *result = _HASHMAP_ENTRIES(NAME, *bucket);             \
+        if(bucket->size) {                                                     \
+            /* move the inline entry into an array of the next capacity, */    \
+            /* the policy may not have one                               */    \
+            uint8_t nth_prime = 0;                                             \
+            size_t newSize = 0;                                                \
+            if(_##NAME##NextPrime(_##NAME##BucketSizes(), 2, NULL,             \
+                                  &nth_prime, &newSize) != _HMNPR_GREW ||      \
+                         newSize > SIZE_MAX / sizeof(_HashType##NAME)) {       \
+                return NULL;                                                   \
+            }                                                                  \
+            _HashType##NAME *entries = REALLOC(NULL,                           \
+                                         sizeof(_HashType##NAME[newSize]));    \
+            if(!entries) {                                                     \
+                return NULL;                                                   \
+            }                                                                  \
+            entries[0] = *result;                                              \
+            bucket->entries = entries;                                         \
+            bucket->nth_prime = nth_prime;                                     \
+            result = &entries[bucket->size];                                   \
+        }                                                                      \
+        ++bucket->size;                                                        \
+        *result = *entry;                                                      \
+        return result;                                                         \
+    }                                                                          \
     uint8_t nth_prime = bucket->nth_prime;                                     \
     size_t newSize = 0;                                                        \
-    switch(_##NAME##NextPrime(bucket->size+1, bucket->entries, &nth_prime,     \
-                                                               &newSize)) {    \
+    switch(_##NAME##NextPrime(_##NAME##BucketSizes(), bucket->size+1,          \
+                              bucket->entries, &nth_prime, &newSize)) {        \
         case _HMNPR_FAIL:                                                      \
             return NULL;                                                       \
-        case _HMNPR_GREW:                                                      \
-            bucket->entries = REALLOC(bucket->entries,                         \
-                                      sizeof(_HashType##NAME[newSize]));       \
+        case _HMNPR_GREW: {                                                    \
+            if(newSize > SIZE_MAX / sizeof(_HashType##NAME)) {                 \
+                return NULL;                                                   \
+            }                                                                  \
+            _HashType##NAME *entries = REALLOC(bucket->entries,                \
+                                         sizeof(_HashType##NAME[newSize]));    \
+            if(!entries) {                                                     \
+                return NULL;                                                   \
+            }                                                                  \
+            bucket->entries = entries;                                         \
+            bucket->nth_prime = nth_prime;                                     \
             break;                                                             \
+        }                                                                      \
         case _HMNPR_NOT_NEEDED:                                                \
             break;                                                             \
         default:                                                               \
@@ -264,13 +958,84 @@ static _HashType##NAME *_##NAME##PutReal(NAME *map,                            \
     return result;                                                             \
 }                                                                              \
                                                                                \
+/* Allocates the array of a new bucket for the entries counted in            */\
+/* bucket->size, and resets bucket->size to 0.                               */\
+/* \return false, if memory is exhausted.                                    */\
+static bool _##NAME##ReserveBucket(NAME##Bucket *bucket) {                     \
+    size_t count = bucket->size;                                               \
+    bucket->size = 0;                                                          \
+    if(!count || (_##NAME##Inline && count == 1)) {                            \
+        return true; /* empty, or stays inline */                              \
+    }                                                                          \
+    size_t newSize = 0;                                                        \
+    if(_##NAME##NextPrime(_##NAME##BucketSizes(), count, NULL,                 \
+                          &bucket->nth_prime, &newSize) != _HMNPR_GREW ||      \
+                       newSize > SIZE_MAX / sizeof(_HashType##NAME)) {         \
+        return false;                                                          \
+    }                                                                          \
+    bucket->entries = REALLOC(NULL, sizeof(_HashType##NAME[newSize]));         \
+    return bucket->entries != NULL;                                            \
+}                                                                              \
+                                                                               \
+/* \return a filter for a table of the given capacity, or NULL.              */\
+static HashMapFilter *_##NAME##FilterAlloc(size_t capacity) {                  \
+    size_t blocks;                                                             \
+    HashMapFilter *filter = REALLOC(NULL,                                      \
+                                    _hashmapFilterSize(capacity, &blocks));    \
+    if(filter) {                                                               \
+        _hashmapFilterInit(filter, blocks);                                    \
+    }                                                                          \
+    return filter;                                                             \
+}                                                                              \
+                                                                               \
+/* Fills the map's filter with all entries.                                  */\
+static void _##NAME##FilterFill(NAME *map) {                                   \
+    HashMapFilter *filter = map->filter;                                       \
+    memset(filter->bits, 0,                                                    \
+           sizeof(uint64_t[filter->blocks][_HASHMAP_FILTER_BLOCK_WORDS]));     \
+    filter->removed = 0;                                                       \
+    _HashType##NAME *iter;                                                     \
+    HASHMAP_FOR_EACH(NAME, iter, *map) {                                       \
+        _hashmapFilterAdd(filter, (size_t)(GET_HASH(iter)));                   \
+    } HASHMAP_FOR_EACH_END                                                     \
+}                                                                              \
+                                                                               \
+/* Rebuilds the filter, if too many entries were removed since the last      */\
+/* time, because removed entries cannot be removed from the filter.          */\
+static void _##NAME##FilterRemoved(NAME *map,                                  \
+                                   size_t count) {                             \
+    HashMapFilter *filter = map->filter;                                       \
+    if(filter && (filter->removed += count) >=                                 \
+                 filter->blocks * _HASHMAP_FILTER_REMOVED_PER_BLOCK) {         \
+        _##NAME##FilterFill(map);                                              \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+bool NAME##FilterNew(NAME *map) {                                              \
+    if(map->filter) {                                                          \
+        return true;                                                           \
+    }                                                                          \
+    map->filter = _##NAME##FilterAlloc(_##NAME##Primes[map->nth_prime]);       \
+    if(!map->filter) {                                                         \
+        return false;                                                          \
+    }                                                                          \
+    _##NAME##FilterFill(map);                                                  \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+void NAME##FilterDestroy(NAME *map) {                                          \
+    if(map->filter) {                                                          \
+        FREE(map->filter);                                                     \
+        map->filter = NULL;                                                    \
+    }                                                                          \
+}                                                                              \
+                                                                               \
 bool NAME##EnsureSize(NAME *map,                                               \
                       size_t capacity) {                                       \
-    capacity = (capacity+2)/3 * 4; /* load factor = 0.75 */                    \
-    uint8_t nth_prime = map->nth_prime;                                        \
-    size_t oldCapacity = _##NAME##Primes[nth_prime];                           \
+    uint8_t nth_prime;                                                         \
+    size_t oldCapacity = _##NAME##Primes[map->nth_prime];                      \
     size_t newSize = 0;                                                        \
-    switch(_##NAME##NextPrime(capacity, map->entries, &nth_prime, &newSize)) { \
+    switch(_##NAME##TableSize(map, capacity, &nth_prime, &newSize)) {          \
         case _HMNPR_FAIL:                                                      \
             return false;                                                      \
         case _HMNPR_NOT_NEEDED:                                                \
@@ -280,39 +1045,196 @@ bool NAME##EnsureSize(NAME *map,                                               \
         default:                                                               \
             return false;                                                      \
     }                                                                          \
+    HashMapFilter *filter = NULL;                                              \
+    if(map->filter && !(filter = _##NAME##FilterAlloc(newSize))) {             \
+        return false;                                                          \
+    }                                                                          \
     NAME##Bucket *oldEntries = map->entries;                                   \
-    NAME##Bucket *newEntries = (NAME##Bucket*) REALLOC(NULL,                   \
-                                              sizeof(NAME##Bucket[newSize]));  \
+    NAME##Bucket *newEntries = _##NAME##NewTable(newSize);                     \
     if(!newEntries) {                                                          \
+        if(filter) {                                                           \
+            FREE(filter);                                                      \
+        }                                                                      \
         return false;                                                          \
     }                                                                          \
-    memset(&newEntries[0], 0, sizeof(NAME##Bucket[newSize]));                  \
-    map->entries = newEntries;                                                 \
-    map->nth_prime = nth_prime;                                                \
-    /* TODO: a failed _##NAME##PutReal(...) would corrupt the map! */          \
     if(map->size) {                                                            \
+        /* count the entries per new bucket, and allocate every new bucket */  \
+        /* before anything is moved, so that the map stays untouched if    */  \
+        /* memory is exhausted                                             */  \
+        bool failed = false;                                                   \
+        for(size_t i = 0; !failed && i < oldCapacity; ++i) {                   \
+            NAME##Bucket *bucket = &oldEntries[i];                             \
+            _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);        \
+            for(size_t h = 0; h < bucket->size; ++h) {                         \
+                NAME##Bucket *dest = &newEntries[                              \
+                        ((size_t)(GET_HASH((&entries[h])))) % newSize];        \
+                if(dest->size == UINT32_MAX) {                                 \
+                    failed = true;                                             \
+                    break;                                                     \
+                }                                                              \
+                ++dest->size;                                                  \
+            }                                                                  \
+        }                                                                      \
+        for(size_t i = 0; !failed && i < newSize; ++i) {                       \
+            failed = !_##NAME##ReserveBucket(&newEntries[i]);                  \
+        }                                                                      \
+        if(failed) {                                                           \
+            for(size_t i = 0; i < newSize; ++i) {                              \
+                if(!_HASHMAP_IS_INLINE(NAME, newEntries[i]) &&                 \
+                                                   newEntries[i].entries) {    \
+                    FREE(newEntries[i].entries);                               \
+                }                                                              \
+            }                                                                  \
+            _##NAME##FreeTable(newEntries, newSize);                           \
+            if(filter) {                                                       \
+                FREE(filter);                                                  \
+            }                                                                  \
+            return false;                                                      \
+        }                                                                      \
+        /* move the entries in order, so stacked duplicates stay adjacent */   \
         for(size_t i = 0; i < oldCapacity; ++i) {                              \
             NAME##Bucket *bucket = &oldEntries[i];                             \
+            _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);        \
             for(size_t h = 0; h < bucket->size; ++h) {                         \
-                _##NAME##PutReal(map, &bucket->entries[h]);                    \
+                NAME##Bucket *dest = &newEntries[                              \
+                        ((size_t)(GET_HASH((&entries[h])))) % newSize];        \
+                _HASHMAP_ENTRIES(NAME, *dest)[dest->size++] = entries[h];      \
+            }                                                                  \
+            if(!map->shared && _HASHMAP_OWNS_ENTRIES(NAME, *bucket)) {         \
+                FREE(bucket->entries);                                         \
             }                                                                  \
-            FREE(bucket->entries);                                             \
         }                                                                      \
     }                                                                          \
-    FREE(oldEntries);                                                          \
+    map->entries = newEntries;                                                 \
+    map->nth_prime = nth_prime;                                                \
+    if(!map->shared) {                                                         \
+        _##NAME##FreeTable(oldEntries, oldCapacity);                           \
+    }                                                                          \
+    map->shared = false;                                                       \
+    if(filter) {                                                               \
+        FREE(map->filter);                                                     \
+        map->filter = filter;                                                  \
+        _##NAME##FilterFill(map);                                              \
+    }                                                                          \
     return true;                                                               \
 }                                                                              \
                                                                                \
+/* Moves the last entry of its bucket right behind the entries equal to it,  */\
+/* which were put before.                                                    */\
+/* \param map Map containing last.                                           */\
+/* \param last Last entry of its bucket, with at least one equal entry.      */\
+/* \return pointer to the first entry equal to last.                         */\
+static _HashType##NAME *_##NAME##Stack(NAME *map,                              \
+                                       _HashType##NAME *last) {                \
+    NAME##Bucket *bucket = &map->entries[((size_t)(GET_HASH(last))) %          \
+                                         _##NAME##Primes[map->nth_prime]];     \
+    _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);                \
+    size_t end = bucket->size - 1;                                             \
+    size_t first = 0;                                                          \
+    while(first < end && (CMP((&entries[first]), last)) != 0) {                \
+        ++first;                                                               \
+    }                                                                          \
+    size_t behind = first + 1;                                                 \
+    while(behind < end && (CMP((&entries[behind]), last)) == 0) {              \
+        ++behind;                                                              \
+    }                                                                          \
+    if(behind < end) {                                                         \
+        _HashType##NAME tmp = entries[end];                                    \
+        memmove(&entries[behind+1],                                            \
+                &entries[behind],                                              \
+                sizeof(_HashType##NAME[end - behind]));                        \
+        entries[behind] = tmp;                                                 \
+    }                                                                          \
+    return &entries[first];                                                    \
+}                                                                              \
+                                                                               \
+/* Looks up the bucket of an entry and the first entry equal to it.          */\
+/* \param bucket_ [Out] Bucket of entry.                                     */\
+/* \return index of the first equal entry in *bucket_, or bucket size.       */\
+static size_t _##NAME##FindFirst(const NAME *map,                              \
+                                 _HashType##NAME *entry,                       \
+                                 NAME##Bucket **bucket_) {                     \
+    NAME##Bucket *bucket = &map->entries[((size_t)(GET_HASH(entry))) %         \
+                                         _##NAME##Primes[map->nth_prime]];     \
+    _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);                \
+    size_t h = 0;                                                              \
+    while(h < bucket->size && (CMP((&entries[h]), entry)) != 0) {              \
+        ++h;                                                                   \
+    }                                                                          \
+    *bucket_ = bucket;                                                         \
+    return h;                                                                  \
+}                                                                              \
+                                                                               \
+size_t NAME##FindAll(const NAME *map,                                          \
+                     _HashType##NAME **entry) {                                \
+    if(!map->entries || (map->filter && !_hashmapFilterMayContain(map->filter, \
+                                            (size_t)(GET_HASH((*entry)))))) {  \
+        return 0;                                                              \
+    }                                                                          \
+    NAME##Bucket *bucket;                                                      \
+    size_t first = _##NAME##FindFirst(map, *entry, &bucket);                   \
+    _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);                \
+    size_t behind = first;                                                     \
+    while(behind < bucket->size && (CMP((&entries[behind]), (*entry))) == 0) { \
+        ++behind;                                                              \
+    }                                                                          \
+    if(behind > first) {                                                       \
+        *entry = &entries[first];                                              \
+    }                                                                          \
+    return behind - first;                                                     \
+}                                                                              \
+                                                                               \
+size_t NAME##Count(const NAME *map,                                            \
+                   _HashType##NAME *entry) {                                   \
+    return NAME##FindAll(map, &entry);                                         \
+}                                                                              \
+                                                                               \
+size_t NAME##RemoveAll(NAME *map,                                              \
+                       _HashType##NAME *entry) {                               \
+    if(!map->entries || (map->filter && !_hashmapFilterMayContain(map->filter, \
+                                                (size_t)(GET_HASH(entry))))) { \
+        return 0;                                                              \
+    }                                                                          \
+    if(map->snapshot && !_##NAME##Unshare(map, entry)) {                       \
+        return 0;                                                              \
+    }                                                                          \
+    NAME##Bucket *bucket;                                                      \
+    size_t first = _##NAME##FindFirst(map, entry, &bucket);                    \
+    _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);                \
+    size_t behind = first;                                                     \
+    while(behind < bucket->size && (CMP((&entries[behind]), entry)) == 0) {    \
+        ++behind;                                                              \
+    }                                                                          \
+    size_t count = behind - first;                                             \
+    if(count) {                                                                \
+        memmove(&entries[first],                                               \
+                &entries[behind],                                              \
+                sizeof(_HashType##NAME[bucket->size - behind]));               \
+        bucket->size -= count;                                                 \
+        if(!bucket->size && _HASHMAP_IS_INLINE(NAME, *bucket)) {               \
+            bucket->entries = NULL;                                            \
+        }                                                                      \
+        map->size -= count;                                                    \
+        _##NAME##FilterRemoved(map, count);                                    \
+    }                                                                          \
+    return count;                                                              \
+}                                                                              \
+                                                                               \
 bool NAME##Find(const NAME *map,                                               \
                 _HashType##NAME **entry) {                                     \
     if(!map->entries) {                                                        \
         return NULL;                                                           \
     }                                                                          \
-    NAME##Bucket *bucket = &map->entries[((size_t)(GET_HASH((*entry)))) %      \
+    size_t hash = (size_t)(GET_HASH((*entry)));                                \
+    if(map->filter && !_hashmapFilterMayContain(map->filter, hash)) {          \
+        return false;                                                          \
+    }                                                                          \
+    NAME##Bucket *bucket = &map->entries[hash %                                \
                                          _##NAME##Primes[map->nth_prime]];     \
+    _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);                \
     for(size_t h = 0; h < bucket->size; ++h) {                                 \
-        if((CMP((&bucket->entries[h]), (*entry))) == 0) {                      \
-            *entry = &bucket->entries[h];                                      \
+        if((CMP((&entries[h]), (*entry))) == 0) {                              \
+            *entry = &entries[h];                                              \
             return true;                                                       \
         }                                                                      \
     }                                                                          \
@@ -323,6 +1245,9 @@ HashMapPutResult NAME##Put(NAME *map,                                          \
                            _HashType##NAME **entry,                            \
                            HashMapDuplicateResolution dr) {                    \
     HashMapPutResult result;                                                   \
+    if(map->snapshot && !_##NAME##Unshare(map, *entry)) {                      \
+        return HMPR_FAILED;                                                    \
+    }                                                                          \
     _HashType##NAME *current = *entry;                                         \
     if(!NAME##Find(map, &current)) {                                           \
         current = *entry;                                                      \
@@ -360,8 +1285,17 @@ HashMapPutResult NAME##Put(NAME *map,                                          \
         return HMPR_FAILED;                                                    \
     }                                                                          \
     _HashType##NAME *putEntry = _##NAME##PutReal(map, current);                \
+    if(!putEntry) {                                                            \
+        return HMPR_FAILED;                                                    \
+    }                                                                          \
+    if(map->filter) {                                                          \
+        _hashmapFilterAdd(map->filter, (size_t)(GET_HASH(putEntry)));          \
+    }                                                                          \
     if(result == HMPR_PUT) {                                                   \
         *entry = putEntry;                                                     \
+    } else {                                                                   \
+        /* the old entry might have moved while growing */                     \
+        *entry = _##NAME##Stack(map, putEntry);                                \
     }                                                                          \
     ++map->size;                                                               \
     return result;                                                             \
@@ -369,20 +1303,730 @@ HashMapPutResult NAME##Put(NAME *map,                                          \
                                                                                \
 bool NAME##Remove(NAME *map,                                                   \
                   _HashType##NAME *entry) {                                    \
+    if(!map->entries || (map->filter && !_hashmapFilterMayContain(map->filter, \
+                                                (size_t)(GET_HASH(entry))))) { \
+        return false;                                                          \
+    }                                                                          \
+    if(map->snapshot && !_##NAME##Unshare(map, entry)) {                       \
+        return false;                                                          \
+    }                                                                          \
     NAME##Bucket *bucket = &map->entries[((size_t)(GET_HASH(entry))) %         \
                                          _##NAME##Primes[map->nth_prime]];     \
+    _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);                \
     for(size_t nth = 0; nth < bucket->size; ++nth) {                           \
-         if((CMP(entry, (&bucket->entries[nth]))) == 0) {                      \
-            *entry = bucket->entries[nth];                                     \
-            memmove(&bucket->entries[nth],                                     \
-                    &bucket->entries[nth+1],                                   \
-                    sizeof(NAME##Bucket[bucket->size - nth - 1]));             \
-            --bucket->size;                                                    \
+         if((CMP(entry, (&entries[nth]))) == 0) {                              \
+            *entry = entries[nth];                                             \
+            memmove(&entries[nth],                                             \
+                    &entries[nth+1],                                           \
+                    sizeof(_HashType##NAME[bucket->size - nth - 1]));          \
+            if(!--bucket->size && _HASHMAP_IS_INLINE(NAME, *bucket)) {         \
+                bucket->entries = NULL;                                        \
+            }                                                                  \
             --map->size;                                                       \
+            _##NAME##FilterRemoved(map, 1);                                    \
             return true;                                                       \
         }                                                                      \
     }                                                                          \
     return false;                                                              \
+}                                                                              \
+                                                                               \
+/* Removes the nth entry of the index'th bucket. The last entry of the       */\
+/* bucket takes its place, unless one of them is stacked, then the rest of   */\
+/* the bucket moves up. Entries before nth stay where they are.              */\
+/* \param entry [Out] Removed entry, may be NULL.                            */\
+/* \return false, if memory is exhausted while copying the bucket from a     */\
+/*         snapshot.                                                         */\
+static bool _##NAME##EraseAt(NAME *map,                                        \
+                             size_t index,                                     \
+                             size_t nth,                                       \
+                             _HashType##NAME *entry) {                         \
+    if(map->snapshot && !_##NAME##UnshareAt(map, index)) {                     \
+        return false;                                                          \
+    }                                                                          \
+    NAME##Bucket *bucket = &map->entries[index];                               \
+    _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);                \
+    size_t last = bucket->size - 1;                                            \
+    if(entry) {                                                                \
+        *entry = entries[nth];                                                 \
+    }                                                                          \
+    if(nth < last) {                                                           \
+        /* stacked entries have to stay next to each other, in order */        \
+        if((nth > 0 && (CMP((&entries[nth-1]), (&entries[nth]))) == 0) ||      \
+                       (CMP((&entries[nth]), (&entries[nth+1]))) == 0 ||       \
+                       (CMP((&entries[last-1]), (&entries[last]))) == 0) {     \
+            memmove(&entries[nth],                                             \
+                    &entries[nth+1],                                           \
+                    sizeof(_HashType##NAME[last - nth]));                      \
+        } else {                                                               \
+            entries[nth] = entries[last];                                      \
+        }                                                                      \
+    }                                                                          \
+    if(!--bucket->size && _HASHMAP_IS_INLINE(NAME, *bucket)) {                 \
+        bucket->entries = NULL;                                                \
+    }                                                                          \
+    --map->size;                                                               \
+    _##NAME##FilterRemoved(map, 1);                                            \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+                                                                               \
+_HashType##NAME *NAME##IterBegin(NAME *map,                                    \
+                                 NAME##Iter *iter) {                           \
+    iter->map = map;                                                           \
+    iter->bucket = 0;                                                          \
+    iter->nth = SIZE_MAX;                                                      \
+    return NAME##IterNext(iter);                                               \
+}                                                                              \
+                                                                               \
+_HashType##NAME *NAME##IterNext(NAME##Iter *iter) {                            \
+    NAME *map = iter->map;                                                     \
+    if(!map->entries) {                                                        \
+        return NULL;                                                           \
+    }                                                                          \
+    size_t capacity = _##NAME##Primes[map->nth_prime];                         \
+    for(++iter->nth; iter->bucket < capacity; ++iter->bucket, iter->nth = 0) { \
+        if(iter->nth < map->entries[iter->bucket].size) {                      \
+            return &_HASHMAP_ENTRIES(NAME, map->entries[iter->bucket])         \
+                                                                  [iter->nth]; \
+        }                                                                      \
+    }                                                                          \
+    return NULL;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##IterErase(NAME##Iter *iter,                                         \
+                     _HashType##NAME *entry) {                                 \
+    NAME *map = iter->map;                                                     \
+    if(!map->entries || iter->bucket >= _##NAME##Primes[map->nth_prime] ||     \
+                        iter->nth >= map->entries[iter->bucket].size) {        \
+        return false;                                                          \
+    }                                                                          \
+    if(!_##NAME##EraseAt(map, iter->bucket, iter->nth, entry)) {               \
+        return false;                                                          \
+    }                                                                          \
+    /* the next entry is at the same position now */                           \
+    --iter->nth;                                                               \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Calls fn for the entries [first, behind) of the index'th bucket, back to  */\
+/* front, so fn may remove its entry.                                        */\
+static void _##NAME##ScanRun(NAME *map,                                        \
+                             size_t index,                                     \
+                             size_t first,                                     \
+                             size_t behind,                                    \
+                             void (*fn)(_HashType##NAME *entry, void *ctx),    \
+                             void *ctx) {                                      \
+    for(size_t h = behind; h-- > first; ) {                                    \
+        /* removing copies the table while a snapshot shares it */             \
+        NAME##Bucket *bucket = &map->entries[index];                           \
+        if(h < bucket->size) {                                                 \
+            fn(&_HASHMAP_ENTRIES(NAME, *bucket)[h], ctx);                      \
+        }                                                                      \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+bool NAME##Scan(NAME *map,                                                     \
+                NAME##ScanCursor *cursor,                                      \
+                size_t budget,                                                 \
+                void (*fn)(_HashType##NAME *entry, void *ctx),                 \
+                void *ctx) {                                                   \
+    if(!cursor->started) {                                                     \
+        if(!map->entries) {                                                    \
+            return false;                                                      \
+        }                                                                      \
+        NAME##SnapshotNew(map, &cursor->snapshot);                             \
+        cursor->bucket = 0;                                                    \
+        cursor->started = true;                                                \
+    }                                                                          \
+    const NAME *table = &cursor->snapshot.map;                                 \
+    size_t capacity = _##NAME##Primes[table->nth_prime];                       \
+    size_t work = 0;                                                           \
+    while(cursor->bucket < capacity && map->entries &&                         \
+                                       (!work || work < budget)) {             \
+        size_t i = cursor->bucket++;                                           \
+        if(map->nth_prime == table->nth_prime) {                               \
+            work += 1 + map->entries[i].size;                                  \
+            _##NAME##ScanRun(map, i, 0, map->entries[i].size, fn, ctx);        \
+            continue;                                                          \
+        }                                                                      \
+        /* the map grew, look up each run of equal entries of the snapshot */  \
+        NAME##Bucket *old = &table->entries[i];                                \
+        _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *old);               \
+        work += 1 + old->size;                                                 \
+        for(size_t h = 0; h < old->size; ++h) {                                \
+            if(h && (CMP((&entries[h-1]), (&entries[h]))) == 0) {              \
+                continue;                                                      \
+            }                                                                  \
+            NAME##Bucket *bucket;                                              \
+            size_t first = _##NAME##FindFirst(map, &entries[h], &bucket);      \
+            _HashType##NAME *found = _HASHMAP_ENTRIES(NAME, *bucket);          \
+            size_t behind = first;                                             \
+            while(behind < bucket->size &&                                     \
+                  (CMP((&found[behind]), (&entries[h]))) == 0) {               \
+                ++behind;                                                      \
+            }                                                                  \
+            _##NAME##ScanRun(map, (size_t) (bucket - map->entries), first,     \
+                             behind, fn, ctx);                                 \
+        }                                                                      \
+    }                                                                          \
+    if(cursor->bucket < capacity && map->entries) {                            \
+        return true;                                                           \
+    }                                                                          \
+    NAME##ScanStop(cursor);                                                    \
+    return false;                                                              \
+}                                                                              \
+                                                                               \
+void NAME##ScanStop(NAME##ScanCursor *cursor) {                                \
+    if(cursor->started) {                                                      \
+        NAME##SnapshotDestroy(&cursor->snapshot);                              \
+    }                                                                          \
+    cursor->bucket = 0;                                                        \
+    cursor->started = false;                                                   \
+}                                                                              \
+                                                                               \
+/* Puts an entry of a set operation, see NAME##Put().                        */\
+/* \param stack Whether map may hold entries equal to entry, then it is      */\
+/*              stacked behind them as with HMDR_STACK. Otherwise it is put  */\
+/*              without looking for duplicates.                              */\
+/* \return false, if memory is exhausted.                                    */\
+static bool _##NAME##Add(NAME *map,                                            \
+                         _HashType##NAME *entry,                               \
+                         bool stack) {                                         \
+    if(map->snapshot && !_##NAME##Unshare(map, entry)) {                       \
+        return false;                                                          \
+    }                                                                          \
+    if(!NAME##EnsureSize(map, map->size+1)) {                                  \
+        return false;                                                          \
+    }                                                                          \
+    if(stack) {                                                                \
+        NAME##Bucket *bucket;                                                  \
+        stack = _##NAME##FindFirst(map, entry, &bucket) < bucket->size;        \
+    }                                                                          \
+    _HashType##NAME *putEntry = _##NAME##PutReal(map, entry);                  \
+    if(!putEntry) {                                                            \
+        return false;                                                          \
+    }                                                                          \
+    if(map->filter) {                                                          \
+        _hashmapFilterAdd(map->filter, (size_t)(GET_HASH(putEntry)));          \
+    }                                                                          \
+    if(stack) {                                                                \
+        _##NAME##Stack(map, putEntry);                                         \
+    }                                                                          \
+    ++map->size;                                                               \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Whether the entries put into out by a set operation may be equal to ones  */\
+/* it holds already, see _##NAME##Add(). Entries put into left were looked   */\
+/* up in it before, and equal entries of an operand are adjacent anyway.     */\
+static bool _##NAME##MustStack(const NAME *out,                                \
+                               const NAME *left) {                             \
+    return out != left && out->size != 0;                                      \
+}                                                                              \
+                                                                               \
+typedef struct {                                                               \
+    NAME *out;                                                                 \
+    bool  stack;                                                               \
+} _##NAME##AddContext;                                                         \
+                                                                               \
+/* Called by _##NAME##Probe() for every entry of the iterated map.           */\
+/* \param previous The entry before entry in its bucket, or NULL.            */\
+/* \param found The first equal entry in the probed map, or NULL.            */\
+/* \param run Number of equal entries in the probed map.                     */\
+/* \return false, to stop.                                                   */\
+typedef bool (*_##NAME##ProbeVisit)(_HashType##NAME *entry,                    \
+                                    _HashType##NAME *previous,                 \
+                                    _HashType##NAME *found,                    \
+                                    size_t run,                                \
+                                    void *ctx);                                \
+                                                                               \
+/* Looks up a batch of entries, whose buckets were prefetched.               */\
+/* The visitor may modify probe, so the buckets are looked up again.         */\
+static bool _##NAME##ProbeBatch(const NAME *probe,                             \
+                                _HashType##NAME **batch,                       \
+                                _HashType##NAME **previous,                    \
+                                const size_t *hashes,                          \
+                                size_t count,                                  \
+                                _##NAME##ProbeVisit visit,                     \
+                                void *ctx) {                                   \
+    if(probe->entries) {                                                       \
+        /* the bucket headers are cached by now, prefetch the arrays */        \
+        size_t capacity = _##NAME##Primes[probe->nth_prime];                   \
+        for(size_t k = 0; k < count; ++k) {                                    \
+            NAME##Bucket *bucket = &probe->entries[hashes[k] % capacity];      \
+            if(!_HASHMAP_IS_INLINE(NAME, *bucket) && bucket->entries) {        \
+                __builtin_prefetch(bucket->entries);                           \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+    for(size_t k = 0; k < count; ++k) {                                        \
+        _HashType##NAME *found = NULL;                                         \
+        size_t run = 0;                                                        \
+        if(probe->entries && (!probe->filter ||                                \
+                     _hashmapFilterMayContain(probe->filter, hashes[k]))) {    \
+            NAME##Bucket *bucket = &probe->entries[hashes[k] %                 \
+                                          _##NAME##Primes[probe->nth_prime]];  \
+            _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);        \
+            for(size_t h = 0; h < bucket->size; ++h) {                         \
+                if((CMP((&entries[h]), (batch[k]))) == 0) {                    \
+                    found = &entries[h];                                       \
+                    run = 1;                                                   \
+                    while(h + run < bucket->size &&                            \
+                          (CMP((&entries[h+run]), (batch[k]))) == 0) {         \
+                        ++run;                                                 \
+                    }                                                          \
+                    break;                                                     \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+        if(!visit(batch[k], previous[k], found, run, ctx)) {                   \
+            return false;                                                      \
+        }                                                                      \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Looks up the entries of the buckets [begin, end) of iterated in probe,    */\
+/* _HASHMAP_SET_BATCH at a time, and calls visit for each in order.          */\
+/* The visitor must not modify iterated.                                     */\
+/* \return false, if the visitor stopped.                                    */\
+static bool _##NAME##Probe(const NAME *iterated,                               \
+                           size_t begin,                                       \
+                           size_t end,                                         \
+                           const NAME *probe,                                  \
+                           _##NAME##ProbeVisit visit,                          \
+                           void *ctx) {                                        \
+    _HashType##NAME *batch[_HASHMAP_SET_BATCH];                                \
+    _HashType##NAME *previous[_HASHMAP_SET_BATCH];                             \
+    size_t hashes[_HASHMAP_SET_BATCH];                                         \
+    size_t count = 0;                                                          \
+    for(size_t i = begin; i < end; ++i) {                                      \
+        NAME##Bucket *bucket = &iterated->entries[i];                          \
+        _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);            \
+        for(size_t h = 0; h < bucket->size; ++h) {                             \
+            batch[count] = &entries[h];                                        \
+            previous[count] = h ? &entries[h-1] : NULL;                        \
+            hashes[count] = (size_t)(GET_HASH((&entries[h])));                 \
+            if(probe->entries) {                                               \
+                __builtin_prefetch(&probe->entries[hashes[count] %             \
+                                          _##NAME##Primes[probe->nth_prime]]); \
+            }                                                                  \
+            if(++count == _HASHMAP_SET_BATCH) {                                \
+                if(!_##NAME##ProbeBatch(probe, batch, previous, hashes,        \
+                                        count, visit, ctx)) {                  \
+                    return false;                                              \
+                }                                                              \
+                count = 0;                                                     \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+    return _##NAME##ProbeBatch(probe, batch, previous, hashes, count,          \
+                               visit, ctx);                                    \
+}                                                                              \
+                                                                               \
+/* Number of words of the marks of a map, see _##NAME##MarkChunk().          */\
+static size_t _##NAME##MarkWords(const NAME *map) {                            \
+    return map->entries ? map->size / 64 + _##NAME##Primes[map->nth_prime] /   \
+                                           _HASHMAP_SET_CHUNK + 1 : 0;         \
+}                                                                              \
+                                                                               \
+typedef struct {                                                               \
+    uint64_t *marks;                                                           \
+    size_t    index;                                                           \
+    size_t    count;                                                           \
+} _##NAME##MarkContext;                                                        \
+                                                                               \
+static bool _##NAME##MarkVisit(_HashType##NAME *entry,                         \
+                               _HashType##NAME *previous,                      \
+                               _HashType##NAME *found,                         \
+                               size_t run,                                     \
+                               void *ctx) {                                    \
+    (void) entry;                                                              \
+    (void) previous;                                                           \
+    (void) run;                                                                \
+    _##NAME##MarkContext *context = (_##NAME##MarkContext*) ctx;               \
+    if(found) {                                                                \
+        context->marks[context->index / 64] |=                                 \
+                                       (uint64_t) 1 << (context->index % 64);  \
+        ++context->count;                                                      \
+    }                                                                          \
+    ++context->index;                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Marks the entries of the chunk'th _HASHMAP_SET_CHUNK buckets of iterated  */\
+/* that have an equal entry in probe. The marks of each chunk start at a     */\
+/* new word, one bit per entry, in the order of the buckets.                 */\
+/* \param marks Zeroed marks of the chunk.                                   */\
+/* \param count [Out] Number of marked entries.                              */\
+/* \return the number of entries of the chunk.                               */\
+static size_t _##NAME##MarkChunk(const NAME *iterated,                         \
+                                 size_t chunk,                                 \
+                                 const NAME *probe,                            \
+                                 uint64_t *marks,                              \
+                                 size_t *count) {                              \
+    size_t capacity = _##NAME##Primes[iterated->nth_prime];                    \
+    size_t begin = chunk * _HASHMAP_SET_CHUNK;                                 \
+    size_t end = capacity - begin < _HASHMAP_SET_CHUNK                         \
+                 ? capacity : begin + _HASHMAP_SET_CHUNK;                      \
+    _##NAME##MarkContext context = { marks, 0, 0 };                            \
+    _##NAME##Probe(iterated, begin, end, probe, _##NAME##MarkVisit, &context); \
+    *count = context.count;                                                    \
+    return context.index;                                                      \
+}                                                                              \
+                                                                               \
+/* Marks the entries of iterated that have an equal entry in probe.          */\
+/* \param marks [Out] Marks, see _##NAME##MarkChunk(). Free with FREE.       */\
+/* \param count [Out] Number of marked entries.                              */\
+/* \return false, if memory is exhausted.                                    */\
+static bool _##NAME##Mark(const NAME *iterated,                                \
+                          const NAME *probe,                                   \
+                          uint64_t **marks,                                    \
+                          size_t *count) {                                     \
+    size_t words = _##NAME##MarkWords(iterated);                               \
+    *marks = (uint64_t*) REALLOC(NULL, sizeof(uint64_t[words ? words : 1]));   \
+    *count = 0;                                                                \
+    if(!*marks) {                                                              \
+        return false;                                                          \
+    }                                                                          \
+    memset(*marks, 0, sizeof(uint64_t[words ? words : 1]));                    \
+    size_t capacity = words ? _##NAME##Primes[iterated->nth_prime] : 0;        \
+    uint64_t *chunkMarks = *marks;                                             \
+    for(size_t chunk = 0; chunk * _HASHMAP_SET_CHUNK < capacity; ++chunk) {    \
+        size_t chunkCount;                                                     \
+        size_t entries = _##NAME##MarkChunk(iterated, chunk, probe,            \
+                                            chunkMarks, &chunkCount);          \
+        chunkMarks += (entries + 63) / 64;                                     \
+        *count += chunkCount;                                                  \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Applies the marks of map marked, see _##NAME##Mark().                     */\
+/* If out is marked, the entries whose mark is not select are removed,       */\
+/* otherwise the entries whose mark is select are put into out.              */\
+/* \param marks Marks, or NULL to put all entries.                           */\
+/* \param stack See _##NAME##Add().                                          */\
+/* \return false, if memory is exhausted.                                    */\
+static bool _##NAME##ApplyMarks(NAME *out,                                     \
+                                const NAME *marked,                            \
+                                const uint64_t *marks,                         \
+                                bool select,                                   \
+                                bool stack) {                                  \
+    if(!marked->entries) {                                                     \
+        return true;                                                           \
+    }                                                                          \
+    size_t capacity = _##NAME##Primes[marked->nth_prime];                      \
+    size_t bit = 0;                                                            \
+    for(size_t i = 0; i < capacity; ++i) {                                     \
+        if(i % _HASHMAP_SET_CHUNK == 0) {                                      \
+            bit = (bit + 63) / 64 * 64;                                        \
+        }                                                                      \
+        size_t size = marked->entries[i].size;                                 \
+        if(out == marked) {                                                    \
+            /* back to front, erasing moves later entries only */              \
+            for(size_t h = size; h--; ) {                                      \
+                size_t b = bit + h;                                            \
+                if(((marks[b / 64] >> (b % 64)) & 1) != select &&              \
+                                  !_##NAME##EraseAt(out, i, h, NULL)) {        \
+                    return false;                                              \
+                }                                                              \
+            }                                                                  \
+        } else {                                                               \
+            _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME,                  \
+                                                        marked->entries[i]);   \
+            for(size_t h = 0; h < size; ++h) {                                 \
+                size_t b = bit + h;                                            \
+                if((!marks || ((marks[b / 64] >> (b % 64)) & 1) == select) &&  \
+                                  !_##NAME##Add(out, &entries[h], stack)) {    \
+                    return false;                                              \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+        bit += size;                                                           \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+static bool _##NAME##AddMissingVisit(_HashType##NAME *entry,                   \
+                                     _HashType##NAME *previous,                \
+                                     _HashType##NAME *found,                   \
+                                     size_t run,                               \
+                                     void *ctx) {                              \
+    (void) previous;                                                           \
+    (void) run;                                                                \
+    _##NAME##AddContext *context = (_##NAME##AddContext*) ctx;                 \
+    return found || _##NAME##Add(context->out, entry, context->stack);         \
+}                                                                              \
+                                                                               \
+static bool _##NAME##AddIfFoundVisit(_HashType##NAME *entry,                   \
+                                     _HashType##NAME *previous,                \
+                                     _HashType##NAME *found,                   \
+                                     size_t run,                               \
+                                     void *ctx) {                              \
+    (void) previous;                                                           \
+    (void) run;                                                                \
+    _##NAME##AddContext *context = (_##NAME##AddContext*) ctx;                 \
+    return !found || _##NAME##Add(context->out, entry, context->stack);        \
+}                                                                              \
+                                                                               \
+/* Puts the equal entries that were found, once per run of stacked entries   */\
+/* of the iterated map.                                                      */\
+static bool _##NAME##AddFoundVisit(_HashType##NAME *entry,                     \
+                                   _HashType##NAME *previous,                  \
+                                   _HashType##NAME *found,                     \
+                                   size_t run,                                 \
+                                   void *ctx) {                                \
+    if(!found || (previous && (CMP(previous, entry)) == 0)) {                  \
+        return true;                                                           \
+    }                                                                          \
+    _##NAME##AddContext *context = (_##NAME##AddContext*) ctx;                 \
+    for(size_t r = 0; r < run; ++r) {                                          \
+        if(!_##NAME##Add(context->out, &found[r], context->stack)) {           \
+            return false;                                                      \
+        }                                                                      \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+static bool _##NAME##RemoveFoundVisit(_HashType##NAME *entry,                  \
+                                      _HashType##NAME *previous,               \
+                                      _HashType##NAME *found,                  \
+                                      size_t run,                              \
+                                      void *out) {                             \
+    (void) run;                                                                \
+    /* the other entries of a run were removed with the first one */           \
+    if(!found || (previous && (CMP(previous, entry)) == 0)) {                  \
+        return true;                                                           \
+    }                                                                          \
+    return NAME##RemoveAll((NAME*) out, entry) > 0;                            \
+}                                                                              \
+                                                                               \
+typedef struct {                                                               \
+    uint64_t *touched;                                                         \
+    size_t    capacity;                                                        \
+    size_t    count;                                                           \
+} _##NAME##TouchContext;                                                       \
+                                                                               \
+static bool _##NAME##TouchVisit(_HashType##NAME *entry,                        \
+                                _HashType##NAME *previous,                     \
+                                _HashType##NAME *found,                        \
+                                size_t run,                                    \
+                                void *ctx) {                                   \
+    _##NAME##TouchContext *context = (_##NAME##TouchContext*) ctx;             \
+    if(!found || (previous && (CMP(previous, entry)) == 0)) {                  \
+        return true;                                                           \
+    }                                                                          \
+    size_t i = ((size_t)(GET_HASH(found))) % context->capacity;                \
+    context->touched[i / 64] |= (uint64_t) 1 << (i % 64);                      \
+    context->count += run;                                                     \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Flags the buckets of probe that hold entries equal to ones of iterated,   */\
+/* one bit per bucket.                                                       */\
+/* \param touched [Out] Flags. Free with FREE.                               */\
+/* \param count [Out] Number of entries of probe that have an equal entry.   */\
+/* \return false, if memory is exhausted.                                    */\
+static bool _##NAME##Touch(const NAME *iterated,                               \
+                           const NAME *probe,                                  \
+                           uint64_t **touched,                                 \
+                           size_t *count) {                                    \
+    size_t capacity = _##NAME##Primes[probe->nth_prime];                       \
+    *touched = (uint64_t*) REALLOC(NULL, sizeof(uint64_t[capacity / 64 + 1])); \
+    *count = 0;                                                                \
+    if(!*touched) {                                                            \
+        return false;                                                          \
+    }                                                                          \
+    memset(*touched, 0, sizeof(uint64_t[capacity / 64 + 1]));                  \
+    _##NAME##TouchContext context = { *touched, capacity, 0 };                 \
+    _##NAME##Probe(iterated, 0, _##NAME##Primes[iterated->nth_prime], probe,   \
+                   _##NAME##TouchVisit, &context);                             \
+    *count = context.count;                                                    \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Puts the entries of right that have no equal entry in left into out.      */\
+/* Only the entries of the buckets flagged by _##NAME##Touch() are looked    */\
+/* up in left, once per run of equal entries before any of them is put.      */\
+/* \return false, if memory is exhausted.                                    */\
+static bool _##NAME##AddUntouched(NAME *out,                                   \
+                                  const NAME *left,                            \
+                                  const NAME *right,                           \
+                                  const uint64_t *touched,                     \
+                                  bool stack) {                                \
+    size_t capacity = _##NAME##Primes[right->nth_prime];                       \
+    for(size_t i = 0; i < capacity; ++i) {                                     \
+        _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, right->entries[i]);  \
+        bool lookup = (touched[i / 64] >> (i % 64)) & 1;                       \
+        bool found = false;                                                    \
+        for(size_t h = 0; h < right->entries[i].size; ++h) {                   \
+            if(lookup && (!h || (CMP((&entries[h-1]), (&entries[h]))) != 0)) { \
+                NAME##Bucket *bucket;                                          \
+                found = _##NAME##FindFirst(left, &entries[h], &bucket) <       \
+                        bucket->size;                                          \
+            }                                                                  \
+            if(!found && !_##NAME##Add(out, &entries[h], stack)) {             \
+                return false;                                                  \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##Union(NAME *out,                                                    \
+                 const NAME *left,                                             \
+                 const NAME *right) {                                          \
+    bool stack = _##NAME##MustStack(out, left);                                \
+    bool touch = left->entries && left->size < right->size;                    \
+    uint64_t *marks = NULL;                                                    \
+    size_t count = 0;                                                          \
+    /* mark first, so that out can be sized exactly, walking the smaller */    \
+    /* operand: if it is left, the buckets of right are flagged instead  */    \
+    if(touch ? !_##NAME##Touch(left, right, &marks, &count)                    \
+             : right->entries && !_##NAME##Mark(right, left, &marks, &count)) {\
+        return false;                                                          \
+    }                                                                          \
+    size_t size = out->size + right->size - count +                            \
+                  (out != left ? left->size : 0);                              \
+    bool result = NAME##EnsureSize(out, size) &&                               \
+                  (out == left ||                                              \
+                   _##NAME##ApplyMarks(out, left, NULL, true, stack)) &&       \
+                  (!marks || (touch                                            \
+                   ? _##NAME##AddUntouched(out, left, right, marks, stack)     \
+                   : _##NAME##ApplyMarks(out, right, marks, false, stack)));   \
+    if(marks) {                                                                \
+        FREE(marks);                                                           \
+    }                                                                          \
+    return result;                                                             \
+}                                                                              \
+                                                                               \
+                                                                               \
+bool NAME##Intersect(NAME *out,                                                \
+                     const NAME *left,                                         \
+                     const NAME *right) {                                      \
+    if(!left->entries) {                                                       \
+        return true;                                                           \
+    }                                                                          \
+    if(out == left) {                                                          \
+        uint64_t *marks;                                                       \
+        size_t count;                                                          \
+        if(!_##NAME##Mark(left, right, &marks, &count)) {                      \
+            return false;                                                      \
+        }                                                                      \
+        bool result = _##NAME##ApplyMarks(out, left, marks, true, false);      \
+        FREE(marks);                                                           \
+        return result;                                                         \
+    }                                                                          \
+    if(!right->entries) {                                                      \
+        return true;                                                           \
+    }                                                                          \
+    _##NAME##AddContext context = { out, _##NAME##MustStack(out, left) };      \
+    size_t size = left->size < right->size ? left->size : right->size;         \
+    if(!NAME##EnsureSize(out, out->size + size)) {                             \
+        return false;                                                          \
+    }                                                                          \
+    if(left->size <= right->size) {                                            \
+        return _##NAME##Probe(left, 0, _##NAME##Primes[left->nth_prime], right,\
+                              _##NAME##AddIfFoundVisit, &context);             \
+    }                                                                          \
+    return _##NAME##Probe(right, 0, _##NAME##Primes[right->nth_prime], left,   \
+                          _##NAME##AddFoundVisit, &context);                   \
+}                                                                              \
+                                                                               \
+bool NAME##Difference(NAME *out,                                               \
+                      const NAME *left,                                        \
+                      const NAME *right) {                                     \
+    if(!left->entries) {                                                       \
+        return true;                                                           \
+    }                                                                          \
+    if(out != left) {                                                          \
+        _##NAME##AddContext context = { out, _##NAME##MustStack(out, left) };  \
+        if(!NAME##EnsureSize(out, out->size + left->size)) {                   \
+            return false;                                                      \
+        }                                                                      \
+        return _##NAME##Probe(left, 0, _##NAME##Primes[left->nth_prime], right,\
+                              _##NAME##AddMissingVisit, &context);             \
+    }                                                                          \
+    if(!right->entries) {                                                      \
+        return true;                                                           \
+    }                                                                          \
+    if(right->size < left->size) {                                             \
+        return _##NAME##Probe(right, 0, _##NAME##Primes[right->nth_prime],     \
+                              left, _##NAME##RemoveFoundVisit, out);           \
+    }                                                                          \
+    uint64_t *marks;                                                           \
+    size_t count;                                                              \
+    if(!_##NAME##Mark(left, right, &marks, &count)) {                          \
+        return false;                                                          \
+    }                                                                          \
+    bool result = _##NAME##ApplyMarks(out, left, marks, false, false);         \
+    FREE(marks);                                                               \
+    return result;                                                             \
+}                                                                              \
+                                                                               \
+bool NAME##Clone(NAME *dst,                                                    \
+                 const NAME *src) {                                            \
+    NAME##New(dst);                                                            \
+    if(src->filter) {                                                          \
+        dst->filter = _##NAME##FilterAlloc(_##NAME##Primes[src->nth_prime]);   \
+        if(!dst->filter) {                                                     \
+            return false;                                                      \
+        }                                                                      \
+        memcpy(dst->filter->bits, src->filter->bits,                           \
+               sizeof(uint64_t[dst->filter->blocks]                            \
+                              [_HASHMAP_FILTER_BLOCK_WORDS]));                 \
+        dst->filter->removed = src->filter->removed;                           \
+    }                                                                          \
+    if(!src->entries) {                                                        \
+        return true;                                                           \
+    }                                                                          \
+    size_t capacity = _##NAME##Primes[src->nth_prime];                         \
+    NAME##Bucket *table = NULL;                                                \
+    if(capacity <= SIZE_MAX / sizeof(NAME##Bucket)) {                          \
+        table = (NAME##Bucket*) TABLE_ALLOC(sizeof(NAME##Bucket[capacity]));   \
+    }                                                                          \
+    if(!table) {                                                               \
+        NAME##FilterDestroy(dst);                                              \
+        return false;                                                          \
+    }                                                                          \
+    memcpy(&table[0], &src->entries[0], sizeof(NAME##Bucket[capacity]));       \
+    for(size_t i = 0; i < capacity; ++i) {                                     \
+        if(i + _HASHMAP_CLONE_PREFETCH < capacity) {                           \
+            NAME##Bucket *ahead = &table[i + _HASHMAP_CLONE_PREFETCH];         \
+            if(!_HASHMAP_IS_INLINE(NAME, *ahead) && ahead->entries) {          \
+                __builtin_prefetch(ahead->entries);                            \
+            }                                                                  \
+        }                                                                      \
+        NAME##Bucket *bucket = &table[i];                                      \
+        if(_HASHMAP_IS_INLINE(NAME, *bucket) || !bucket->entries) {            \
+            continue;                                                          \
+        }                                                                      \
+        size_t bucketCapacity = _##NAME##BucketSizes()[bucket->nth_prime];     \
+        _HashType##NAME *entries = REALLOC(NULL,                               \
+                                 sizeof(_HashType##NAME[bucketCapacity]));     \
+        if(!entries) {                                                         \
+            /* the buckets from i on still point into src */                   \
+            for(size_t j = 0; j < i; ++j) {                                    \
+                if(_HASHMAP_OWNS_ENTRIES(NAME, table[j])) {                    \
+                    FREE(table[j].entries);                                    \
+                }                                                              \
+            }                                                                  \
+            _##NAME##FreeTable(table, capacity);                               \
+            NAME##FilterDestroy(dst);                                          \
+            return false;                                                      \
+        }                                                                      \
+        memcpy(entries, bucket->entries,                                       \
+               sizeof(_HashType##NAME[bucket->size]));                         \
+        bucket->entries = entries;                                             \
+        bucket->borrowed = false;                                              \
+    }                                                                          \
+    dst->size = src->size;                                                     \
+    dst->nth_prime = src->nth_prime;                                           \
+    dst->entries = table;                                                      \
+    return true;                                                               \
 }
 
+
+
 #endif // ifndef HASHMAP_H__
@@ -0,0 +1,731 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+#ifndef HASHMAP_HPP__
+#define HASHMAP_HPP__
+
+// C++17 map with the bucket layout of hashmap.h: a top-level array of buckets,
+// every bucket is an array of entries, both sized from the same prime list.
+// Unlike std::unordered_map it does not allocate a node per element.
+//
+// Elements are constructed, moved and destroyed properly, so any type works,
+// as long as it is nothrow move constructible (std::string, std::vector etc.
+// are). Growing the map move-constructs the elements into their new buckets.
+//
+// Inserting invalidates iterators, pointers and references into the map,
+// erasing invalidates them for the erased element and the last element of its
+// bucket.
+
+#include "hashmap.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace hashmap {
+
+namespace detail {
+
+constexpr std::size_t primes[] = { _HASHMAP_PRIMES };
+constexpr std::uint8_t primeCount = sizeof(primes) / sizeof(primes[0]);
+
+template <class Slot>
+struct Bucket {
+    std::uint32_t size;
+    std::uint8_t  nth_prime;
+    Slot         *entries;
+};
+
+template <class Hash, class KeyEqual, class = void>
+struct IsTransparent : std::false_type {};
+
+template <class Hash, class KeyEqual>
+struct IsTransparent<Hash, KeyEqual,
+                     std::void_t<typename Hash::is_transparent,
+                                 typename KeyEqual::is_transparent>>
+    : std::true_type {};
+
+} // namespace detail
+
+/**
+ * Maps Key to T, with an interface like std::unordered_map's.
+ * If Hash and KeyEqual both define is_transparent, find(), count(),
+ * contains(), erase() and try_emplace() accept any key type they can handle.
+ */
+template <class Key,
+          class T,
+          class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>,
+          class Allocator = std::allocator<std::pair<const Key, T>>>
+class HashMap {
+public:
+    using key_type        = Key;
+    using mapped_type     = T;
+    using value_type      = std::pair<const Key, T>;
+    using size_type       = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using hasher          = Hash;
+    using key_equal       = KeyEqual;
+    using allocator_type  = Allocator;
+    using reference       = value_type&;
+    using const_reference = const value_type&;
+
+private:
+    // The elements are stored with a mutable key, so that growing and erasing
+    // can move them. They are handed out as value_type, which has the same
+    // layout.
+    using Slot = std::pair<Key, T>;
+    using Bucket = detail::Bucket<Slot>;
+    using Traits = std::allocator_traits<Allocator>;
+    using SlotTraits = typename Traits::template rebind_traits<Slot>;
+    using SlotAllocator = typename SlotTraits::allocator_type;
+    using BucketTraits = typename Traits::template rebind_traits<Bucket>;
+    using BucketAllocator = typename BucketTraits::allocator_type;
+
+    static_assert(std::is_nothrow_move_constructible<Slot>::value,
+                  "keys and values must be nothrow move constructible");
+    static_assert(sizeof(Slot) == sizeof(value_type) &&
+                  alignof(Slot) == alignof(value_type),
+                  "pair<Key, T> and pair<const Key, T> must be alike");
+
+    template <class K>
+    using EnableTransparent = std::enable_if_t<
+            detail::IsTransparent<Hash, KeyEqual>::value &&
+            !std::is_convertible<const K&, const Key&>::value, int>;
+
+    static value_type &view(Slot &slot) {
+        return *std::launder(reinterpret_cast<value_type*>(&slot));
+    }
+
+    template <bool Const>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = typename HashMap::value_type;
+        using difference_type   = std::ptrdiff_t;
+        using reference = std::conditional_t<Const, const value_type&,
+                                                    value_type&>;
+        using pointer   = std::conditional_t<Const, const value_type*,
+                                                    value_type*>;
+
+        Iterator() = default;
+
+        template <bool OtherConst,
+                  class = std::enable_if_t<Const && !OtherConst>>
+        Iterator(const Iterator<OtherConst> &other)
+                : bucket_(other.bucket_), end_(other.end_),
+                  index_(other.index_) {}
+
+        reference operator*() const {
+            return view(bucket_->entries[index_]);
+        }
+
+        pointer operator->() const {
+            return &**this;
+        }
+
+        Iterator &operator++() {
+            if(++index_ >= bucket_->size) {
+                ++bucket_;
+                index_ = 0;
+                skipEmpty();
+            }
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        friend bool operator==(const Iterator &left, const Iterator &right) {
+            return left.bucket_ == right.bucket_ && left.index_ == right.index_;
+        }
+
+        friend bool operator!=(const Iterator &left, const Iterator &right) {
+            return !(left == right);
+        }
+
+    private:
+        friend class HashMap;
+        template <bool> friend class Iterator;
+
+        Iterator(Bucket *bucket, Bucket *end, std::uint32_t index)
+                : bucket_(bucket), end_(end), index_(index) {}
+
+        void skipEmpty() {
+            while(bucket_ != end_ && !bucket_->size) {
+                ++bucket_;
+            }
+        }
+
+        Bucket       *bucket_ = nullptr;
+        Bucket       *end_ = nullptr;
+        std::uint32_t index_ = 0;
+    };
+
+public:
+    using iterator       = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    HashMap() : HashMap(Allocator()) {}
+
+    explicit HashMap(const Allocator &alloc,
+                     const Hash &hash = Hash(),
+                     const KeyEqual &equal = KeyEqual())
+            : hash_(hash), equal_(equal), alloc_(alloc) {}
+
+    HashMap(const HashMap &other)
+            : HashMap(other,
+                      SlotTraits::select_on_container_copy_construction(
+                              other.alloc_)) {}
+
+    HashMap(const HashMap &other, const Allocator &alloc)
+            : hash_(other.hash_), equal_(other.equal_), alloc_(alloc) {
+        copyFrom(other);
+    }
+
+    HashMap(HashMap &&other) noexcept
+            : entries_(std::exchange(other.entries_, nullptr)),
+              size_(std::exchange(other.size_, 0)),
+              nth_prime_(std::exchange(other.nth_prime_, 0)),
+              hash_(std::move(other.hash_)),
+              equal_(std::move(other.equal_)),
+              alloc_(std::move(other.alloc_)) {}
+
+    HashMap &operator=(const HashMap &other) {
+        if(this != &other) {
+            destroy();
+            if constexpr(
+                    SlotTraits::propagate_on_container_copy_assignment::value) {
+                alloc_ = other.alloc_;
+            }
+            hash_ = other.hash_;
+            equal_ = other.equal_;
+            copyFrom(other);
+        }
+        return *this;
+    }
+
+    HashMap &operator=(HashMap &&other) noexcept(
+            SlotTraits::propagate_on_container_move_assignment::value ||
+            SlotTraits::is_always_equal::value) {
+        if(this == &other) {
+            return *this;
+        }
+        destroy();
+        hash_ = std::move(other.hash_);
+        equal_ = std::move(other.equal_);
+        if constexpr(
+                SlotTraits::propagate_on_container_move_assignment::value) {
+            alloc_ = std::move(other.alloc_);
+        } else if(alloc_ != other.alloc_) {
+            // the memory cannot change hands, move the elements one by one
+            reserve(other.size_);
+            for(value_type &entry : other) {
+                Slot &slot = reinterpret_cast<Slot&>(entry);
+                emplaceNew(std::move(slot.first), std::move(slot.second));
+            }
+            other.clear();
+            return *this;
+        }
+        entries_ = std::exchange(other.entries_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        nth_prime_ = std::exchange(other.nth_prime_, 0);
+        return *this;
+    }
+
+    ~HashMap() {
+        destroy();
+    }
+
+    allocator_type get_allocator() const {
+        return allocator_type(alloc_);
+    }
+
+    hasher hash_function() const {
+        return hash_;
+    }
+
+    key_equal key_eq() const {
+        return equal_;
+    }
+
+    iterator begin() noexcept {
+        return makeBegin<iterator>();
+    }
+
+    const_iterator begin() const noexcept {
+        return makeBegin<const_iterator>();
+    }
+
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+
+    iterator end() noexcept {
+        return makeEnd<iterator>();
+    }
+
+    const_iterator end() const noexcept {
+        return makeEnd<const_iterator>();
+    }
+
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    bool empty() const noexcept {
+        return !size_;
+    }
+
+    size_type size() const noexcept {
+        return size_;
+    }
+
+    /**
+     * Number of top-level buckets.
+     */
+    size_type bucket_count() const noexcept {
+        return entries_ ? detail::primes[nth_prime_] : 0;
+    }
+
+    /**
+     * Removes all elements, the capacity stays.
+     */
+    void clear() noexcept {
+        for(size_type i = 0; i < bucket_count(); ++i) {
+            Bucket &bucket = entries_[i];
+            for(std::uint32_t h = 0; h < bucket.size; ++h) {
+                SlotTraits::destroy(alloc_, &bucket.entries[h]);
+            }
+            bucket.size = 0;
+        }
+        size_ = 0;
+    }
+
+    /**
+     * Ensures that the map can hold capacity elements without growing, like
+     * NAME##EnsureSize().
+     */
+    void reserve(size_type capacity) {
+        if(capacity > SIZE_MAX / 4 * 3) {
+            throw std::length_error("hashmap::HashMap::reserve");
+        }
+        capacity = (capacity+2)/3 * 4; // load factor = 0.75
+        if(entries_ && detail::primes[nth_prime_] >= capacity) {
+            return;
+        }
+        std::uint8_t nth_prime = nth_prime_;
+        while(detail::primes[nth_prime] < capacity) {
+            if(++nth_prime >= detail::primeCount) {
+                throw std::length_error("hashmap::HashMap::reserve");
+            }
+        }
+        rehash(nth_prime);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const Key &key, Args&&... args) {
+        return tryEmplace(key, std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(Key &&key, Args&&... args) {
+        return tryEmplace(std::move(key), std::forward<Args>(args)...);
+    }
+
+    /**
+     * Heterogeneous try_emplace(): Key is only constructed from key, if it
+     * was not found.
+     */
+    template <class K, class... Args, EnableTransparent<K> = 0>
+    std::pair<iterator, bool> try_emplace(K &&key, Args&&... args) {
+        return tryEmplace(std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    std::pair<iterator, bool> insert(const value_type &value) {
+        return try_emplace(value.first, value.second);
+    }
+
+    std::pair<iterator, bool> insert(value_type &&value) {
+        return try_emplace(value.first, std::move(value.second));
+    }
+
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const Key &key, M &&value) {
+        std::pair<iterator, bool> result = try_emplace(key,
+                                                       std::forward<M>(value));
+        if(!result.second) {
+            result.first->second = std::forward<M>(value);
+        }
+        return result;
+    }
+
+    T &operator[](const Key &key) {
+        return try_emplace(key).first->second;
+    }
+
+    T &operator[](Key &&key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    T &at(const Key &key) {
+        iterator found = find(key);
+        if(found == end()) {
+            throw std::out_of_range("hashmap::HashMap::at");
+        }
+        return found->second;
+    }
+
+    const T &at(const Key &key) const {
+        const_iterator found = find(key);
+        if(found == end()) {
+            throw std::out_of_range("hashmap::HashMap::at");
+        }
+        return found->second;
+    }
+
+    iterator find(const Key &key) {
+        return lookup<iterator>(key);
+    }
+
+    const_iterator find(const Key &key) const {
+        return lookup<const_iterator>(key);
+    }
+
+    template <class K, EnableTransparent<K> = 0>
+    iterator find(const K &key) {
+        return lookup<iterator>(key);
+    }
+
+    template <class K, EnableTransparent<K> = 0>
+    const_iterator find(const K &key) const {
+        return lookup<const_iterator>(key);
+    }
+
+    bool contains(const Key &key) const {
+        return find(key) != end();
+    }
+
+    template <class K, EnableTransparent<K> = 0>
+    bool contains(const K &key) const {
+        return find(key) != end();
+    }
+
+    size_type count(const Key &key) const {
+        return contains(key);
+    }
+
+    template <class K, EnableTransparent<K> = 0>
+    size_type count(const K &key) const {
+        return contains(key);
+    }
+
+    size_type erase(const Key &key) {
+        return eraseKey(key);
+    }
+
+    template <class K, EnableTransparent<K> = 0>
+    size_type erase(const K &key) {
+        return eraseKey(key);
+    }
+
+    iterator erase(iterator position) {
+        return erase(const_iterator(position));
+    }
+
+    /**
+     * \return iterator to the element following position.
+     */
+    iterator erase(const_iterator position) {
+        Bucket *bucket = position.bucket_;
+        eraseAt(*bucket, position.index_);
+        iterator next(bucket, position.end_, position.index_);
+        if(next.index_ >= bucket->size) {
+            ++next.bucket_;
+            next.index_ = 0;
+            next.skipEmpty();
+        }
+        return next;
+    }
+
+    void swap(HashMap &other) noexcept {
+        using std::swap;
+        swap(entries_, other.entries_);
+        swap(size_, other.size_);
+        swap(nth_prime_, other.nth_prime_);
+        swap(hash_, other.hash_);
+        swap(equal_, other.equal_);
+        if constexpr(SlotTraits::propagate_on_container_swap::value) {
+            swap(alloc_, other.alloc_);
+        }
+    }
+
+    friend void swap(HashMap &left, HashMap &right) noexcept {
+        left.swap(right);
+    }
+
+private:
+    template <class It>
+    It makeBegin() const noexcept {
+        It result(entries_, entries_ + bucket_count(), 0);
+        result.skipEmpty();
+        return result;
+    }
+
+    template <class It>
+    It makeEnd() const noexcept {
+        return It(entries_ + bucket_count(), entries_ + bucket_count(), 0);
+    }
+
+    template <class K>
+    Bucket &bucketIn(Bucket *table, std::size_t capacity,
+                     const K &key) const {
+        return table[static_cast<std::size_t>(hash_(key)) % capacity];
+    }
+
+    template <class K>
+    Bucket &bucketOf(const K &key) const {
+        return bucketIn(entries_, detail::primes[nth_prime_], key);
+    }
+
+    /**
+     * \return index of key in bucket, or bucket.size.
+     */
+    template <class K>
+    std::uint32_t indexOf(const Bucket &bucket, const K &key) const {
+        std::uint32_t h = 0;
+        while(h < bucket.size && !equal_(bucket.entries[h].first, key)) {
+            ++h;
+        }
+        return h;
+    }
+
+    template <class It, class K>
+    It lookup(const K &key) const {
+        if(!entries_) {
+            return makeEnd<It>();
+        }
+        Bucket &bucket = bucketOf(key);
+        std::uint32_t h = indexOf(bucket, key);
+        if(h == bucket.size) {
+            return makeEnd<It>();
+        }
+        return It(&bucket, entries_ + bucket_count(), h);
+    }
+
+    template <class K, class... Args>
+    std::pair<iterator, bool> tryEmplace(K &&key, Args&&... args) {
+        iterator found = lookup<iterator>(key);
+        if(found != end()) {
+            return { found, false };
+        }
+        return { emplaceNew(std::forward<K>(key), std::forward<Args>(args)...),
+                 true };
+    }
+
+    /**
+     * Puts a new element, key must not exist yet.
+     */
+    template <class K, class... Args>
+    iterator emplaceNew(K &&key, Args&&... args) {
+        reserve(size_ + 1);
+        Bucket &bucket = bucketOf(key);
+        Slot *slot = reserveSlot(bucket);
+        SlotTraits::construct(alloc_, slot, std::piecewise_construct,
+                              std::forward_as_tuple(std::forward<K>(key)),
+                              std::forward_as_tuple(
+                                      std::forward<Args>(args)...));
+        ++size_;
+        return iterator(&bucket, entries_ + bucket_count(), bucket.size++);
+    }
+
+    /**
+     * Grows bucket if it is full, like _##NAME##PutReal().
+     * \return storage for the next element of bucket.
+     */
+    Slot *reserveSlot(Bucket &bucket) {
+        if(bucket.size == UINT32_MAX) {
+            throw std::length_error("hashmap::HashMap: bucket is full");
+        }
+        if(!bucket.entries) {
+            bucket.nth_prime = 0;
+            bucket.entries = SlotTraits::allocate(alloc_, detail::primes[0]);
+        } else if(bucket.size >= detail::primes[bucket.nth_prime]) {
+            std::uint8_t nth_prime = bucket.nth_prime + 1;
+            Slot *entries = SlotTraits::allocate(alloc_,
+                                                 detail::primes[nth_prime]);
+            for(std::uint32_t h = 0; h < bucket.size; ++h) {
+                SlotTraits::construct(alloc_, &entries[h],
+                                      std::move(bucket.entries[h]));
+                SlotTraits::destroy(alloc_, &bucket.entries[h]);
+            }
+            SlotTraits::deallocate(alloc_, bucket.entries,
+                                   detail::primes[bucket.nth_prime]);
+            bucket.entries = entries;
+            bucket.nth_prime = nth_prime;
+        }
+        return &bucket.entries[bucket.size];
+    }
+
+    /**
+     * Moves all elements into a new table of primes[nth_prime] buckets.
+     * Like NAME##EnsureSizeParallel(), it first counts the elements of every
+     * new bucket and allocates all arrays, so the map is left untouched if
+     * the memory is exhausted. Then moving the elements cannot fail.
+     */
+    void rehash(std::uint8_t nth_prime) {
+        std::size_t capacity = detail::primes[nth_prime];
+        std::size_t oldCapacity = bucket_count();
+        BucketAllocator bucketAlloc(alloc_);
+        Bucket *table = BucketTraits::allocate(bucketAlloc, capacity);
+        for(std::size_t i = 0; i < capacity; ++i) {
+            table[i] = Bucket{ 0, 0, nullptr };
+        }
+        try {
+            for(std::size_t i = 0; i < oldCapacity; ++i) {
+                Bucket &old = entries_[i];
+                for(std::uint32_t h = 0; h < old.size; ++h) {
+                    Bucket &bucket = bucketIn(table, capacity,
+                                              old.entries[h].first);
+                    if(bucket.size == UINT32_MAX) {
+                        throw std::length_error(
+                                "hashmap::HashMap: bucket is full");
+                    }
+                    ++bucket.size;
+                }
+            }
+            for(std::size_t i = 0; i < capacity; ++i) {
+                Bucket &bucket = table[i];
+                if(!bucket.size) {
+                    continue;
+                }
+                while(detail::primes[bucket.nth_prime] < bucket.size) {
+                    ++bucket.nth_prime;
+                }
+                bucket.entries = SlotTraits::allocate(
+                        alloc_, detail::primes[bucket.nth_prime]);
+                bucket.size = 0;
+            }
+        } catch(...) {
+            for(std::size_t i = 0; i < capacity; ++i) {
+                table[i].size = 0;
+            }
+            freeTable(table, capacity);
+            throw;
+        }
+        for(std::size_t i = 0; i < oldCapacity; ++i) {
+            Bucket &old = entries_[i];
+            for(std::uint32_t h = 0; h < old.size; ++h) {
+                Bucket &bucket = bucketIn(table, capacity,
+                                          old.entries[h].first);
+                SlotTraits::construct(alloc_, &bucket.entries[bucket.size++],
+                                      std::move(old.entries[h]));
+            }
+        }
+        freeTable(entries_, oldCapacity);
+        entries_ = table;
+        nth_prime_ = nth_prime;
+    }
+
+    /**
+     * Destroys the elements of table and frees it.
+     */
+    void freeTable(Bucket *table, std::size_t capacity) noexcept {
+        if(!table) {
+            return;
+        }
+        for(std::size_t i = 0; i < capacity; ++i) {
+            Bucket &bucket = table[i];
+            for(std::uint32_t h = 0; h < bucket.size; ++h) {
+                SlotTraits::destroy(alloc_, &bucket.entries[h]);
+            }
+            if(bucket.entries) {
+                SlotTraits::deallocate(alloc_, bucket.entries,
+                                       detail::primes[bucket.nth_prime]);
+            }
+        }
+        BucketAllocator bucketAlloc(alloc_);
+        BucketTraits::deallocate(bucketAlloc, table, capacity);
+    }
+
+    void destroy() noexcept {
+        freeTable(entries_, bucket_count());
+        entries_ = nullptr;
+        size_ = 0;
+        nth_prime_ = 0;
+    }
+
+    void copyFrom(const HashMap &other) {
+        reserve(other.size_);
+        for(const value_type &entry : other) {
+            emplaceNew(entry.first, entry.second);
+        }
+    }
+
+    /**
+     * Destroys bucket.entries[h] and moves the last element of bucket into
+     * its place.
+     */
+    void eraseAt(Bucket &bucket, std::uint32_t h) noexcept {
+        SlotTraits::destroy(alloc_, &bucket.entries[h]);
+        if(h != --bucket.size) {
+            SlotTraits::construct(alloc_, &bucket.entries[h],
+                                  std::move(bucket.entries[bucket.size]));
+            SlotTraits::destroy(alloc_, &bucket.entries[bucket.size]);
+        }
+        --size_;
+    }
+
+    template <class K>
+    size_type eraseKey(const K &key) {
+        if(!entries_) {
+            return 0;
+        }
+        Bucket &bucket = bucketOf(key);
+        std::uint32_t h = indexOf(bucket, key);
+        if(h == bucket.size) {
+            return 0;
+        }
+        eraseAt(bucket, h);
+        return 1;
+    }
+
+    Bucket       *entries_ = nullptr;
+    size_type     size_ = 0;
+    std::uint8_t  nth_prime_ = 0;
+    Hash          hash_;
+    KeyEqual      equal_;
+    SlotAllocator alloc_;
+};
+
+namespace pmr {
+
+/**
+ * HashMap using a std::pmr::memory_resource.
+ */
+template <class Key,
+          class T,
+          class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>>
+using HashMap = hashmap::HashMap<
+        Key, T, Hash, KeyEqual,
+        std::pmr::polymorphic_allocator<std::pair<const Key, T>>>;
+
+} // namespace pmr
+
+} // namespace hashmap
+
+#endif // ifndef HASHMAP_HPP__
@@ -0,0 +1,751 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+#ifndef HASHMAP_PARALLEL_H__
+#define HASHMAP_PARALLEL_H__
+
+// Multi-threaded operations on maps set up with DEFINE_HASHMAP and
+// DECLARE_HASHMAP. Link with -pthread.
+// The threads are started by the first call and kept in a pool for the
+// following calls.
+
+#include "hashmap.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+// Number of top-level buckets a worker claims at once.
+#define _HASHMAP_PARALLEL_CHUNK 1024
+
+// NAME##EnsureSizeParallel() rehashes maps with fewer entries serially.
+#ifndef HASHMAP_PARALLEL_REHASH_THRESHOLD
+#   define HASHMAP_PARALLEL_REHASH_THRESHOLD (1 << 20)
+#endif
+
+// The functions use at most this many threads, larger nthreads are clamped.
+#ifndef HASHMAP_PARALLEL_MAX_THREADS
+#   define HASHMAP_PARALLEL_MAX_THREADS 256
+#endif
+
+static inline unsigned _hashmapParallelThreads(unsigned nthreads) {
+    if(!nthreads) {
+        return 1;
+    } else if(nthreads > HASHMAP_PARALLEL_MAX_THREADS) {
+        return HASHMAP_PARALLEL_MAX_THREADS;
+    }
+    return nthreads;
+}
+
+/**
+ * Threads that are started once and run the shares of every
+ * _hashmapParallelRun(...) call afterwards. There is one pool per translation
+ * unit, its threads wait for work until the process exits.
+ */
+typedef struct {
+    pthread_mutex_t   lock;
+    pthread_cond_t    wake;     // there are shares to claim
+    pthread_cond_t    done;     // all shares have finished
+    bool              busy;     // a call uses the pool
+    pid_t             pid;      // process that started the threads
+    unsigned          threads;  // number of started threads
+    void           *(*worker)(void*);
+    char             *args;
+    size_t            argSize;
+    unsigned          shares;   // shares of the current call
+    unsigned          next;     // next share to claim
+    unsigned          finished; // shares that have returned
+} _HashMapParallelPool;
+
+static _HashMapParallelPool _hashmapParallelPool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    false, 0, 0, NULL, NULL, 0, 0, 0, 0
+};
+
+/**
+ * Claims and runs shares until there are none left. Called with the lock
+ * held, returns with the lock held.
+ */
+static inline void _hashmapParallelPoolWork(_HashMapParallelPool *pool) {
+    while(pool->next < pool->shares) {
+        void *arg = pool->args + pool->next++ * pool->argSize;
+        void *(*worker)(void*) = pool->worker;
+        pthread_mutex_unlock(&pool->lock);
+        worker(arg);
+        pthread_mutex_lock(&pool->lock);
+        if(++pool->finished == pool->shares) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+}
+
+static inline void *_hashmapParallelPoolThread(void *arg) {
+    _HashMapParallelPool *pool = (_HashMapParallelPool*) arg;
+    pthread_mutex_lock(&pool->lock);
+    for(;;) {
+        _hashmapParallelPoolWork(pool);
+        pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    return NULL;
+}
+
+/**
+ * Runs worker(args + t*argSize) for t in [0, nthreads), nthreads at most
+ * HASHMAP_PARALLEL_MAX_THREADS. The shares are claimed by the threads of the
+ * pool and the calling thread, the pool grows to nthreads-1 threads as needed.
+ * If the pool is in use, e.g. by another thread or because worker called this
+ * function, new threads are spawned for this call. If a thread could not be
+ * spawned, its share runs in the calling thread, after the others were
+ * started. A worker must not wait for another share of the same call.
+ */
+static inline void _hashmapParallelRun(unsigned nthreads,
+                                       void *(*worker)(void*),
+                                       void *args,
+                                       size_t argSize) {
+    nthreads = _hashmapParallelThreads(nthreads);
+    _HashMapParallelPool *pool = &_hashmapParallelPool;
+    pthread_mutex_lock(&pool->lock);
+    if(!pool->busy) {
+        pool->busy = true;
+        if(pool->pid != getpid()) {
+            /* a forked child does not inherit the threads of the pool */
+            pool->pid = getpid();
+            pool->threads = 0;
+        }
+        while(pool->threads + 1 < nthreads) {
+            pthread_t thread;
+            if(pthread_create(&thread, NULL, _hashmapParallelPoolThread,
+                              pool) != 0) {
+                break;
+            }
+            pthread_detach(thread);
+            ++pool->threads;
+        }
+        pool->worker = worker;
+        pool->args = (char*) args;
+        pool->argSize = argSize;
+        pool->shares = nthreads;
+        pool->next = 0;
+        pool->finished = 0;
+        pthread_cond_broadcast(&pool->wake);
+        _hashmapParallelPoolWork(pool);
+        while(pool->finished < pool->shares) {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        pool->busy = false;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_t threads[HASHMAP_PARALLEL_MAX_THREADS];
+    bool spawned[HASHMAP_PARALLEL_MAX_THREADS];
+    for(unsigned t = 1; t < nthreads; ++t) {
+        spawned[t] = pthread_create(&threads[t], NULL, worker,
+                                    (char*) args + t*argSize) == 0;
+    }
+    worker(args);
+    for(unsigned t = 1; t < nthreads; ++t) {
+        if(spawned[t]) {
+            pthread_join(threads[t], NULL);
+        } else {
+            worker((char*) args + t*argSize);
+        }
+    }
+}
+
+/**
+ * Claims the next chunk [*begin, *end) of [0, capacity), shared by all
+ * workers through *next.
+ * \return false if there is nothing left.
+ */
+static inline bool _hashmapParallelClaim(size_t *next,
+                                         size_t capacity,
+                                         size_t *begin,
+                                         size_t *end) {
+    *begin = __atomic_fetch_add(next, _HASHMAP_PARALLEL_CHUNK,
+                                __ATOMIC_RELAXED);
+    if(*begin >= capacity) {
+        return false;
+    }
+    *end = capacity - *begin < _HASHMAP_PARALLEL_CHUNK
+                ? capacity : *begin + _HASHMAP_PARALLEL_CHUNK;
+    return true;
+}
+
+/**
+ * _hashmapFilterAdd(...) for multiple threads filling the same filter.
+ */
+static inline void _hashmapFilterAddAtomic(HashMapFilter *filter,
+                                           size_t hash) {
+    uint64_t h = _hashmapFilterMix(hash);
+    uint64_t *block = &filter->bits[(h % filter->blocks) *
+                                    _HASHMAP_FILTER_BLOCK_WORDS];
+    for(int k = 0; k < 4; ++k, h >>= 9) {
+        __atomic_fetch_or(&block[(h >> 34) & 7],
+                          (uint64_t) 1 << ((h >> 28) & 63), __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Defines the prototypes of the multi-threaded functions of map type NAME.
+ * Use after DEFINE_HASHMAP(NAME, TYPE).
+ * \param NAME Typedef'd name of the HashMap type.
+ */
+#define DEFINE_HASHMAP_PARALLEL(NAME)                                          \
+                                                                               \
+/* Calls fn for every entry of a map using nthreads threads.                 */\
+/* The top-level buckets are handed out to the threads in small chunks, so   */\
+/* threads that hit well-filled buckets simply claim fewer chunks.           */\
+/* You must not insert or delete elements while iterating.                   */\
+/* \param map Map to iterate over.                                           */\
+/* \param nthreads Number of threads to use, including the calling thread,   */\
+/*                  at most HASHMAP_PARALLEL_MAX_THREADS.                    */\
+/* \param fn Function to call, must be thread-safe.                          */\
+/* \param ctx Per-thread contexts: fn gets ctx + t*ctxSize in thread t, so   */\
+/*            you may reduce over an array of nthreads accumulators after    */\
+/*            the call. Use ctxSize = 0 to share ctx.                        */\
+void NAME##ParallelForEach(const NAME *map,                                    \
+                           unsigned nthreads,                                  \
+                           void (*fn)(_HashType##NAME *entry, void *ctx),      \
+                           void *ctx,                                          \
+                           size_t ctxSize);                                    \
+                                                                               \
+/* Like NAME##EnsureSize(), but if the map holds at least                    */\
+/* HASHMAP_PARALLEL_REHASH_THRESHOLD entries, the entries are redistributed  */\
+/* by nthreads threads. The resulting map equals the one of a serial rehash, */\
+/* except that entries of different keys sharing a bucket may be in another  */\
+/* order. Stacked duplicates keep their order.                               */\
+/* If the memory is exhausted, the map is left untouched.                    */\
+/* \param map Map to grow if needed.                                         */\
+/* \param capacity Number of entries the map shall hold.                     */\
+/* \param nthreads Number of threads to use, including the calling thread.   */\
+/* \return false, if could not ensure size.                                  */\
+bool NAME##EnsureSizeParallel(NAME *map,                                       \
+                              size_t capacity,                                 \
+                              unsigned nthreads);                              \
+                                                                               \
+/* Like NAME##Union(), NAME##Intersect() and NAME##Difference(), but the     */\
+/* operand whose entries are selected is probed by nthreads threads. Then    */\
+/* the result is put into out by the calling thread.                         */\
+/* \param nthreads Number of threads to use, including the calling thread.   */\
+/* \return false, if memory is exhausted. out may hold a partial result.     */\
+bool NAME##UnionParallel(NAME *out,                                            \
+                         const NAME *left,                                     \
+                         const NAME *right,                                    \
+                         unsigned nthreads);                                   \
+                                                                               \
+bool NAME##IntersectParallel(NAME *out,                                        \
+                             const NAME *left,                                 \
+                             const NAME *right,                                \
+                             unsigned nthreads);                               \
+                                                                               \
+bool NAME##DifferenceParallel(NAME *out,                                       \
+                              const NAME *left,                                \
+                              const NAME *right,                               \
+                              unsigned nthreads);
+
+
+/**
+ * Declares the multi-threaded functions of map type NAME.
+ * Use after DECLARE_HASHMAP(NAME, ...) or DECLARE_HASHMAP_ALIGNED(NAME, ...),
+ * with the same first five parameters.
+ */
+#define DECLARE_HASHMAP_PARALLEL(NAME, CMP, GET_HASH, FREE, REALLOC)           \
+                                                                               \
+typedef struct {                                                               \
+    const NAME *map;                                                           \
+    size_t     *next;                                                          \
+    void      (*fn)(_HashType##NAME *entry, void *ctx);                        \
+    void       *ctx;                                                           \
+} _##NAME##ForEachWorker;                                                      \
+                                                                               \
+static void *_##NAME##ForEachWork(void *arg) {                                 \
+    _##NAME##ForEachWorker *worker = (_##NAME##ForEachWorker*) arg;            \
+    const NAME *map = worker->map;                                             \
+    size_t capacity = _##NAME##Primes[map->nth_prime];                         \
+    size_t begin, end;                                                         \
+    while(_hashmapParallelClaim(worker->next, capacity, &begin, &end)) {       \
+        for(size_t i = begin; i < end; ++i) {                                  \
+            NAME##Bucket *bucket = &map->entries[i];                           \
+            _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);        \
+            for(size_t h = 0; h < bucket->size; ++h) {                         \
+                worker->fn(&entries[h], worker->ctx);                          \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+    return NULL;                                                               \
+}                                                                              \
+                                                                               \
+void NAME##ParallelForEach(const NAME *map,                                    \
+                           unsigned nthreads,                                  \
+                           void (*fn)(_HashType##NAME *entry, void *ctx),      \
+                           void *ctx,                                          \
+                           size_t ctxSize) {                                   \
+    if(!map->entries || !map->size) {                                          \
+        return;                                                                \
+    }                                                                          \
+    nthreads = _hashmapParallelThreads(nthreads);                              \
+    size_t next = 0;                                                           \
+    _##NAME##ForEachWorker workers[nthreads];                                  \
+    for(unsigned t = 0; t < nthreads; ++t) {                                   \
+        workers[t] = (_##NAME##ForEachWorker) {                                \
+            .map  = map,                                                       \
+            .next = &next,                                                     \
+            .fn   = fn,                                                        \
+            .ctx  = ctxSize ? (char*) ctx + t*ctxSize : ctx,                   \
+        };                                                                     \
+    }                                                                          \
+    _hashmapParallelRun(nthreads, _##NAME##ForEachWork, workers,               \
+                        sizeof(workers[0]));                                   \
+}                                                                              \
+                                                                               \
+typedef enum {                                                                 \
+    _##NAME##REHASH_COUNT,    /* count entries per new bucket               */ \
+    _##NAME##REHASH_RESERVE,  /* allocate new buckets exactly               */ \
+    _##NAME##REHASH_PLACE,    /* move the entries, free the old buckets     */ \
+    _##NAME##REHASH_ROLLBACK, /* free the new buckets                       */ \
+} _##NAME##RehashPhase;                                                        \
+                                                                               \
+typedef struct {                                                               \
+    _##NAME##RehashPhase phase;                                                \
+    NAME##Bucket        *oldEntries;                                           \
+    size_t               oldCapacity;                                          \
+    NAME##Bucket        *newEntries;                                           \
+    size_t               newCapacity;                                          \
+    bool                 keepOld;                                              \
+    size_t              *next;                                                 \
+    bool                *failed;                                               \
+} _##NAME##RehashWorker;                                                       \
+                                                                               \
+static void *_##NAME##RehashWork(void *arg) {                                  \
+    _##NAME##RehashWorker *worker = (_##NAME##RehashWorker*) arg;              \
+    NAME##Bucket *oldEntries = worker->oldEntries;                             \
+    NAME##Bucket *newEntries = worker->newEntries;                             \
+    size_t newCapacity = worker->newCapacity;                                  \
+    size_t capacity = worker->phase == _##NAME##REHASH_COUNT ||                \
+                      worker->phase == _##NAME##REHASH_PLACE                   \
+                            ? worker->oldCapacity : newCapacity;               \
+    size_t begin, end;                                                         \
+    while(_hashmapParallelClaim(worker->next, capacity, &begin, &end)) {       \
+        for(size_t i = begin; i < end; ++i) {                                  \
+            switch(worker->phase) {                                            \
+                case _##NAME##REHASH_COUNT: {                                  \
+                    NAME##Bucket *bucket = &oldEntries[i];                     \
+                    _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);\
+                    for(size_t h = 0; h < bucket->size; ++h) {                 \
+                        _HashType##NAME *entry = &entries[h];                  \
+                        size_t dest = ((size_t)(GET_HASH(entry))) %            \
+                                      newCapacity;                             \
+                        __atomic_fetch_add(&newEntries[dest].size, 1,          \
+                                           __ATOMIC_RELAXED);                  \
+                    }                                                          \
+                    break;                                                     \
+                }                                                              \
+                case _##NAME##REHASH_RESERVE:                                  \
+                    if(!_##NAME##ReserveBucket(&newEntries[i])) {              \
+                        __atomic_store_n(worker->failed, true,                 \
+                                         __ATOMIC_RELAXED);                    \
+                    }                                                          \
+                    break;                                                     \
+                case _##NAME##REHASH_PLACE: {                                  \
+                    NAME##Bucket *bucket = &oldEntries[i];                     \
+                    _HashType##NAME *entries = _HASHMAP_ENTRIES(NAME, *bucket);\
+                    /* runs of entries with the same destination are moved */  \
+                    /* at once, so stacked duplicates stay adjacent        */  \
+                    size_t h = 0;                                              \
+                    while(h < bucket->size) {                                  \
+                        size_t dest = ((size_t)(GET_HASH((&entries[h])))) %    \
+                                                                  newCapacity; \
+                        size_t run = 1;                                        \
+                        while(h + run < bucket->size &&                        \
+                              ((size_t)(GET_HASH((&entries[h+run])))) %        \
+                                                         newCapacity == dest) {\
+                            ++run;                                             \
+                        }                                                      \
+                        size_t at = __atomic_fetch_add(&newEntries[dest].size, \
+                                                  run, __ATOMIC_RELAXED);      \
+                        memcpy(&_HASHMAP_ENTRIES(NAME, newEntries[dest])[at],  \
+                               &entries[h],                                    \
+                               sizeof(_HashType##NAME[run]));                  \
+                        h += run;                                              \
+                    }                                                          \
+                    if(!worker->keepOld &&                                     \
+                                   _HASHMAP_OWNS_ENTRIES(NAME, *bucket)) {     \
+                        FREE(bucket->entries);                                 \
+                    }                                                          \
+                    break;                                                     \
+                }                                                              \
+                case _##NAME##REHASH_ROLLBACK:                                 \
+                    if(!_HASHMAP_IS_INLINE(NAME, newEntries[i]) &&             \
+                                                       newEntries[i].entries) {\
+                        FREE(newEntries[i].entries);                           \
+                    }                                                          \
+                    break;                                                     \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+    return NULL;                                                               \
+}                                                                              \
+                                                                               \
+static void _##NAME##RehashRun(unsigned nthreads,                              \
+                               _##NAME##RehashWorker *workers,                 \
+                               _##NAME##RehashPhase phase) {                   \
+    size_t next = 0;                                                           \
+    for(unsigned t = 0; t < nthreads; ++t) {                                   \
+        workers[t].phase = phase;                                              \
+        workers[t].next = &next;                                               \
+    }                                                                          \
+    _hashmapParallelRun(nthreads, _##NAME##RehashWork, workers,                \
+                        sizeof(workers[0]));                                   \
+}                                                                              \
+                                                                               \
+static void _##NAME##FilterFillEntry(_HashType##NAME *entry,                   \
+                                     void *filter) {                           \
+    _hashmapFilterAddAtomic(filter, (size_t)(GET_HASH(entry)));                \
+}                                                                              \
+                                                                               \
+bool NAME##EnsureSizeParallel(NAME *map,                                       \
+                              size_t capacity,                                 \
+                              unsigned nthreads) {                             \
+    if(nthreads <= 1 || !map->entries ||                                       \
+                        map->size < HASHMAP_PARALLEL_REHASH_THRESHOLD) {       \
+        return NAME##EnsureSize(map, capacity);                                \
+    }                                                                          \
+    nthreads = _hashmapParallelThreads(nthreads);                              \
+    uint8_t nth_prime;                                                         \
+    size_t oldCapacity = _##NAME##Primes[map->nth_prime];                      \
+    size_t newSize = 0;                                                        \
+    switch(_##NAME##TableSize(map, capacity, &nth_prime, &newSize)) {          \
+        case _HMNPR_FAIL:                                                      \
+            return false;                                                      \
+        case _HMNPR_NOT_NEEDED:                                                \
+            return true;                                                       \
+        case _HMNPR_GREW:                                                      \
+            break;                                                             \
+        default:                                                               \
+            return false;                                                      \
+    }                                                                          \
+    HashMapFilter *filter = NULL;                                              \
+    if(map->filter && !(filter = _##NAME##FilterAlloc(newSize))) {             \
+        return false;                                                          \
+    }                                                                          \
+    NAME##Bucket *newEntries = _##NAME##NewTable(newSize);                     \
+    if(!newEntries) {                                                          \
+        if(filter) {                                                           \
+            FREE(filter);                                                      \
+        }                                                                      \
+        return false;                                                          \
+    }                                                                          \
+    bool failed = false;                                                       \
+    _##NAME##RehashWorker workers[nthreads];                                   \
+    for(unsigned t = 0; t < nthreads; ++t) {                                   \
+        workers[t] = (_##NAME##RehashWorker) {                                 \
+            .oldEntries  = map->entries,                                       \
+            .oldCapacity = oldCapacity,                                        \
+            .newEntries  = newEntries,                                         \
+            .newCapacity = newSize,                                            \
+            .keepOld     = map->shared,                                        \
+            .failed      = &failed,                                            \
+        };                                                                     \
+    }                                                                          \
+    _##NAME##RehashRun(nthreads, workers, _##NAME##REHASH_COUNT);              \
+    _##NAME##RehashRun(nthreads, workers, _##NAME##REHASH_RESERVE);            \
+    if(failed) {                                                               \
+        _##NAME##RehashRun(nthreads, workers, _##NAME##REHASH_ROLLBACK);       \
+        _##NAME##FreeTable(newEntries, newSize);                               \
+        if(filter) {                                                           \
+            FREE(filter);                                                      \
+        }                                                                      \
+        return false;                                                          \
+    }                                                                          \
+    _##NAME##RehashRun(nthreads, workers, _##NAME##REHASH_PLACE);              \
+    if(!map->shared) {                                                         \
+        _##NAME##FreeTable(map->entries, oldCapacity);                         \
+    }                                                                          \
+    map->shared = false;                                                       \
+    map->entries = newEntries;                                                 \
+    map->nth_prime = nth_prime;                                                \
+    if(filter) {                                                               \
+        FREE(map->filter);                                                     \
+        map->filter = filter;                                                  \
+        NAME##ParallelForEach(map, nthreads, _##NAME##FilterFillEntry,         \
+                              filter, 0);                                      \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+typedef struct {                                                               \
+    const NAME *iterated;                                                      \
+    const NAME *probe;                                                         \
+    size_t      chunks;                                                        \
+    size_t     *offsets;  /* words per chunk, then first word of each chunk */ \
+    uint64_t   *marks;                                                         \
+    size_t     *next;                                                          \
+    size_t     *count;                                                         \
+} _##NAME##MarkWorker;                                                         \
+                                                                               \
+static void *_##NAME##MarkWork(void *arg) {                                    \
+    _##NAME##MarkWorker *worker = (_##NAME##MarkWorker*) arg;                  \
+    const NAME *iterated = worker->iterated;                                   \
+    size_t capacity = _##NAME##Primes[iterated->nth_prime];                    \
+    size_t chunk;                                                              \
+    while((chunk = __atomic_fetch_add(worker->next, 1, __ATOMIC_RELAXED)) <    \
+                                                            worker->chunks) {  \
+        if(!worker->marks) {                                                   \
+            size_t begin = chunk * _HASHMAP_SET_CHUNK;                         \
+            size_t end = capacity - begin < _HASHMAP_SET_CHUNK                 \
+                         ? capacity : begin + _HASHMAP_SET_CHUNK;              \
+            size_t entries = 0;                                                \
+            for(size_t i = begin; i < end; ++i) {                              \
+                entries += iterated->entries[i].size;                          \
+            }                                                                  \
+            worker->offsets[chunk] = (entries + 63) / 64;                      \
+        } else {                                                               \
+            size_t count;                                                      \
+            _##NAME##MarkChunk(iterated, chunk, worker->probe,                 \
+                               &worker->marks[worker->offsets[chunk]], &count);\
+            __atomic_fetch_add(worker->count, count, __ATOMIC_RELAXED);        \
+        }                                                                      \
+    }                                                                          \
+    return NULL;                                                               \
+}                                                                              \
+                                                                               \
+/* Like _##NAME##Mark(), using nthreads threads. First the threads count     */\
+/* the entries of each chunk, to know where its marks start.                 */\
+static bool _##NAME##MarkParallel(const NAME *iterated,                        \
+                                  const NAME *probe,                           \
+                                  unsigned nthreads,                           \
+                                  uint64_t **marks,                            \
+                                  size_t *count) {                             \
+    nthreads = _hashmapParallelThreads(nthreads);                              \
+    size_t capacity = _##NAME##Primes[iterated->nth_prime];                    \
+    size_t chunks = (capacity + _HASHMAP_SET_CHUNK - 1) / _HASHMAP_SET_CHUNK;  \
+    size_t *offsets = (size_t*) REALLOC(NULL, sizeof(size_t[chunks]));         \
+    *count = 0;                                                                \
+    if(!offsets) {                                                             \
+        return false;                                                          \
+    }                                                                          \
+    size_t next = 0;                                                           \
+    _##NAME##MarkWorker workers[nthreads];                                     \
+    for(unsigned t = 0; t < nthreads; ++t) {                                   \
+        workers[t] = (_##NAME##MarkWorker) {                                   \
+            .iterated = iterated,                                              \
+            .probe    = probe,                                                 \
+            .chunks   = chunks,                                                \
+            .offsets  = offsets,                                               \
+            .marks    = NULL,                                                  \
+            .next     = &next,                                                 \
+            .count    = count,                                                 \
+        };                                                                     \
+    }                                                                          \
+    _hashmapParallelRun(nthreads, _##NAME##MarkWork, workers,                  \
+                        sizeof(workers[0]));                                   \
+    size_t words = 0;                                                          \
+    for(size_t chunk = 0; chunk < chunks; ++chunk) {                           \
+        size_t chunkWords = offsets[chunk];                                    \
+        offsets[chunk] = words;                                                \
+        words += chunkWords;                                                   \
+    }                                                                          \
+    *marks = (uint64_t*) REALLOC(NULL, sizeof(uint64_t[words ? words : 1]));   \
+    if(!*marks) {                                                              \
+        FREE(offsets);                                                         \
+        return false;                                                          \
+    }                                                                          \
+    memset(*marks, 0, sizeof(uint64_t[words ? words : 1]));                    \
+    next = 0;                                                                  \
+    for(unsigned t = 0; t < nthreads; ++t) {                                   \
+        workers[t].marks = *marks;                                             \
+    }                                                                          \
+    _hashmapParallelRun(nthreads, _##NAME##MarkWork, workers,                  \
+                        sizeof(workers[0]));                                   \
+    FREE(offsets);                                                             \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##UnionParallel(NAME *out,                                            \
+                         const NAME *left,                                     \
+                         const NAME *right,                                    \
+                         unsigned nthreads) {                                  \
+    if(nthreads <= 1 || !right->entries) {                                     \
+        return NAME##Union(out, left, right);                                  \
+    }                                                                          \
+    uint64_t *marks;                                                           \
+    size_t count;                                                              \
+    if(!_##NAME##MarkParallel(right, left, nthreads, &marks, &count)) {        \
+        return false;                                                          \
+    }                                                                          \
+    bool stack = _##NAME##MustStack(out, left);                                \
+    size_t size = out->size + right->size - count +                            \
+                  (out != left ? left->size : 0);                              \
+    bool result = NAME##EnsureSize(out, size) &&                               \
+                  (out == left ||                                              \
+                   _##NAME##ApplyMarks(out, left, NULL, true, stack)) &&       \
+                  _##NAME##ApplyMarks(out, right, marks, false, stack);        \
+    FREE(marks);                                                               \
+    return result;                                                             \
+}                                                                              \
+                                                                               \
+bool NAME##IntersectParallel(NAME *out,                                        \
+                             const NAME *left,                                 \
+                             const NAME *right,                                \
+                             unsigned nthreads) {                              \
+    if(nthreads <= 1 || !left->entries) {                                      \
+        return NAME##Intersect(out, left, right);                              \
+    }                                                                          \
+    uint64_t *marks;                                                           \
+    size_t count;                                                              \
+    if(!_##NAME##MarkParallel(left, right, nthreads, &marks, &count)) {        \
+        return false;                                                          \
+    }                                                                          \
+    bool stack = _##NAME##MustStack(out, left);                                \
+    bool result = (out == left || NAME##EnsureSize(out, out->size + count)) && \
+                  _##NAME##ApplyMarks(out, left, marks, true, stack);          \
+    FREE(marks);                                                               \
+    return result;                                                             \
+}                                                                              \
+                                                                               \
+bool NAME##DifferenceParallel(NAME *out,                                       \
+                              const NAME *left,                                \
+                              const NAME *right,                               \
+                              unsigned nthreads) {                             \
+    if(nthreads <= 1 || !left->entries) {                                      \
+        return NAME##Difference(out, left, right);                             \
+    }                                                                          \
+    uint64_t *marks;                                                           \
+    size_t count;                                                              \
+    if(!_##NAME##MarkParallel(left, right, nthreads, &marks, &count)) {        \
+        return false;                                                          \
+    }                                                                          \
+    bool stack = _##NAME##MustStack(out, left);                                \
+    bool result = (out == left ||                                              \
+                   NAME##EnsureSize(out, out->size + left->size - count)) &&   \
+                  _##NAME##ApplyMarks(out, left, marks, false, stack);         \
+    FREE(marks);                                                               \
+    return result;                                                             \
+}
+
+/**
+ * Defines the prototype of the multi-threaded counting of counter map type
+ * NAME, see countermap.h. Use after DEFINE_COUNTER_MAP(NAME, KEY_TYPE).
+ * \param NAME Typedef'd name of the counter map type.
+ */
+#define DEFINE_COUNTER_MAP_PARALLEL(NAME)                                      \
+                                                                               \
+/* Counts items [0, count) using nthreads threads. The threads claim small   */\
+/* ranges [begin, end) of the items one after another and call fn to count   */\
+/* them with NAME##Increment(local, ...) in a map of their own, so counting  */\
+/* needs no locks. Afterwards the thread-local maps are merged pairwise in   */\
+/* parallel, and the result is added to map.                                 */\
+/* \param map Map to add the counters to.                                    */\
+/* \param nthreads Number of threads to use, including the calling thread.   */\
+/* \param count Number of items.                                             */\
+/* \param fn Counts the items [begin, end) into local, must be thread-safe.  */\
+/*           Returns false if memory is exhausted.                           */\
+/* \param ctx Passed to fn.                                                  */\
+/* \return false, if memory is exhausted. The counters are partly added.     */\
+bool NAME##CountParallel(NAME *map,                                            \
+                         unsigned nthreads,                                    \
+                         size_t count,                                         \
+                         bool (*fn)(NAME *local, size_t begin, size_t end,     \
+                                    void *ctx),                                \
+                         void *ctx);
+
+/**
+ * Declares the multi-threaded counting of counter map type NAME.
+ * Use after DECLARE_COUNTER_MAP(NAME, ...).
+ */
+#define DECLARE_COUNTER_MAP_PARALLEL(NAME)                                     \
+                                                                               \
+typedef struct {                                                               \
+    NAME     *locals;                                                          \
+    unsigned  t;                                                               \
+    size_t    step;     /* 0 while counting, merge distance afterwards */      \
+    size_t    count;                                                           \
+    size_t   *next;                                                            \
+    bool    (*fn)(NAME *local, size_t begin, size_t end, void *ctx);           \
+    void     *ctx;                                                             \
+    bool     *failed;                                                          \
+} _##NAME##CountWorker;                                                        \
+                                                                               \
+static void *_##NAME##CountWork(void *arg) {                                   \
+    _##NAME##CountWorker *worker = (_##NAME##CountWorker*) arg;                \
+    NAME *local = &worker->locals[worker->t];                                  \
+    bool ok = true;                                                            \
+    if(!worker->step) {                                                        \
+        size_t begin, end;                                                     \
+        while(ok && _hashmapParallelClaim(worker->next, worker->count,         \
+                                          &begin, &end)) {                     \
+            ok = worker->fn(local, begin, end, worker->ctx);                   \
+        }                                                                      \
+    } else {                                                                   \
+        ok = NAME##Merge(local, &worker->locals[worker->t + worker->step]);    \
+        NAME##Destroy(&worker->locals[worker->t + worker->step]);              \
+    }                                                                          \
+    if(!ok) {                                                                  \
+        __atomic_store_n(worker->failed, true, __ATOMIC_RELAXED);              \
+    }                                                                          \
+    return NULL;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##CountParallel(NAME *map,                                            \
+                         unsigned nthreads,                                    \
+                         size_t count,                                         \
+                         bool (*fn)(NAME *local, size_t begin, size_t end,     \
+                                    void *ctx),                                \
+                         void *ctx) {                                          \
+    if(nthreads <= 1) {                                                        \
+        for(size_t begin = 0; begin < count;                                   \
+                              begin += _HASHMAP_PARALLEL_CHUNK) {              \
+            size_t end = count - begin < _HASHMAP_PARALLEL_CHUNK               \
+                         ? count : begin + _HASHMAP_PARALLEL_CHUNK;            \
+            if(!fn(map, begin, end, ctx)) {                                    \
+                return false;                                                  \
+            }                                                                  \
+        }                                                                      \
+        return true;                                                           \
+    }                                                                          \
+    nthreads = _hashmapParallelThreads(nthreads);                              \
+    NAME locals[nthreads];                                                     \
+    _##NAME##CountWorker workers[nthreads];                                    \
+    size_t next = 0;                                                           \
+    bool failed = false;                                                       \
+    for(unsigned t = 0; t < nthreads; ++t) {                                   \
+        NAME##New(&locals[t]);                                                 \
+        workers[t] = (_##NAME##CountWorker) {                                  \
+            .locals = locals,                                                  \
+            .t      = t,                                                       \
+            .count  = count,                                                   \
+            .next   = &next,                                                   \
+            .fn     = fn,                                                      \
+            .ctx    = ctx,                                                     \
+            .failed = &failed,                                                 \
+        };                                                                     \
+    }                                                                          \
+    _hashmapParallelRun(nthreads, _##NAME##CountWork, workers,                 \
+                        sizeof(workers[0]));                                   \
+    /* merge t + step into t, for t = 0, 2*step, 4*step, ... */                \
+    _##NAME##CountWorker merges[(nthreads + 1) / 2];                           \
+    for(size_t step = 1; step < nthreads; step *= 2) {                         \
+        unsigned pairs = 0;                                                    \
+        for(unsigned t = 0; t + step < nthreads; t += 2 * step) {              \
+            merges[pairs] = workers[t];                                        \
+            merges[pairs].step = step;                                         \
+            ++pairs;                                                           \
+        }                                                                      \
+        _hashmapParallelRun(pairs, _##NAME##CountWork, merges,                 \
+                            sizeof(merges[0]));                                \
+    }                                                                          \
+    if(!failed) {                                                              \
+        if(!map->entries && !map->snapshot && !map->filter) {                  \
+            *map = locals[0];                                                  \
+            return true;                                                       \
+        }                                                                      \
+        failed = !NAME##Merge(map, &locals[0]);                                \
+    }                                                                          \
+    NAME##Destroy(&locals[0]);                                                 \
+    return !failed;                                                            \
+}
+
+#endif // ifndef HASHMAP_PARALLEL_H__
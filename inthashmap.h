@@ -0,0 +1,389 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+#ifndef INTHASHMAP_H__
+#define INTHASHMAP_H__
+
+// Maps from integer keys to values, for when DEFINE_HASHMAP's buckets are too
+// much overhead. The keys are stored in one flat array, a reserved key marks
+// empty slots. A lookup compares a whole group of keys at once (16 bytes, or
+// 32 bytes with AVX2), using GCC's vector extensions.
+//
+// Collisions are resolved by linear probing. The probe sequence does not wrap
+// around: the arrays have a tail of _INT_HASHMAP_TAIL extra slots behind the
+// home slots, and the map grows if an entry would not fit into the tail.
+// Removing an entry shifts its successors back, so there are no tombstones.
+
+#include "hashmap.h"
+
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#   define _INT_HASHMAP_GROUP_BYTES 32
+#elif defined(__SSE2__)
+#   include <emmintrin.h>
+#   define _INT_HASHMAP_GROUP_BYTES 16
+#else
+#   define _INT_HASHMAP_GROUP_BYTES 16
+#endif
+
+// Slots behind the last home slot, see above.
+#define _INT_HASHMAP_TAIL 64
+
+/**
+ * \return bit n*size is set, if lane n of the comparison EQ is true.
+ */
+#if defined(__AVX2__)
+#   define _INT_HASHMAP_MASK(EQ, LANES)                                        \
+        ((uint32_t) _mm256_movemask_epi8((__m256i) (EQ)))
+#elif defined(__SSE2__)
+#   define _INT_HASHMAP_MASK(EQ, LANES)                                        \
+        ((uint32_t) _mm_movemask_epi8((__m128i) (EQ)))
+#else
+#   define _INT_HASHMAP_MASK(EQ, LANES)                                        \
+        __extension__ ({                                                       \
+            uint32_t __mask = 0;                                               \
+            for(unsigned __lane = 0; __lane < (LANES); ++__lane) {             \
+                if((EQ)[__lane]) {                                             \
+                    __mask |= (uint32_t) 1 <<                                  \
+                              (__lane * (_INT_HASHMAP_GROUP_BYTES / (LANES))); \
+                }                                                              \
+            }                                                                  \
+            __mask;                                                            \
+        })
+#endif
+
+/**
+ * Defines the types and function prototypes of an integer map type NAME.
+ * \param NAME Name of the map type.
+ * \param INT_TYPE Integer type of the keys.
+ * \param VALUE Type of the values.
+ */
+#define DEFINE_INT_HASHMAP(NAME, INT_TYPE, VALUE)                              \
+                                                                               \
+typedef INT_TYPE _IntType##NAME;                                               \
+typedef VALUE    _IntValue##NAME;                                              \
+                                                                               \
+typedef struct {                                                               \
+    size_t    size;                                                            \
+    size_t    capacity; /* home slots, a power of 2, or 0 */                   \
+    uint8_t   shift;    /* 64 - log2(capacity) */                              \
+    INT_TYPE  empty;    /* key of empty slots */                               \
+    INT_TYPE *keys;     /* capacity + tail + group slots */                    \
+    VALUE    *values;                                                          \
+} NAME;                                                                        \
+                                                                               \
+/* Initialize a new map.                                                     */\
+/* \param map Map to initialize.                                             */\
+void NAME##New(NAME *map);                                                     \
+                                                                               \
+/* Frees the internal memory of a map.                                       */\
+/* \param map Map to destroy.                                                */\
+void NAME##Destroy(NAME *map);                                                 \
+                                                                               \
+/* Ensures that the map can hold capacity entries without growing.           */\
+/* \param map Map to grow if needed.                                         */\
+/* \param capacity Number of entries the map shall hold.                     */\
+/* \return false, if could not ensure size.                                  */\
+bool NAME##EnsureSize(NAME *map,                                               \
+                      size_t capacity);                                        \
+                                                                               \
+/* Looks up a key in a map.                                                  */\
+/* \param map Map to search in.                                              */\
+/* \param key Key to search.                                                 */\
+/* \param value [Out] Returns pointer to the value of key. May be NULL.      */\
+/* \return false, if could not found.                                        */\
+bool NAME##Find(const NAME *map,                                               \
+                INT_TYPE key,                                                  \
+                VALUE **value);                                                \
+                                                                               \
+/* Adds a key into a map.                                                    */\
+/* \param map Map to add to.                                                 */\
+/* \param key Key to add, must not be the empty key.                         */\
+/* \param value [In/Out] Value to add. Returns pointer to the stored value.  */\
+/* \param dr What to do with duplicates. HMDR_STACK is not supported.        */\
+/* \return HMPR_FAILED if the key is the empty key, if dr is HMDR_FAIL or    */\
+/*         HMDR_STACK and the key existed, or if memory is exhausted.        */\
+HashMapPutResult NAME##Put(NAME *map,                                          \
+                           INT_TYPE key,                                       \
+                           VALUE **value,                                      \
+                           HashMapDuplicateResolution dr);                     \
+                                                                               \
+/* Removes a key from a map.                                                 */\
+/* \param map Map to remove from.                                            */\
+/* \param key Key to remove.                                                 */\
+/* \param value [Out] Returns the removed value. May be NULL.                */\
+/* \return false, if did not exist                                           */\
+bool NAME##Remove(NAME *map,                                                   \
+                  INT_TYPE key,                                                \
+                  VALUE *value);
+
+/**
+ * Declares the functions of integer map type NAME.
+ * \param NAME Name of the map type.
+ * \param EMPTY Key that marks empty slots. It cannot be put into the map.
+ * \param FREE Free function to use.
+ * \param REALLOC Realloc function to use.
+ */
+#define DECLARE_INT_HASHMAP(NAME, EMPTY, FREE, REALLOC)                        \
+                                                                               \
+typedef _IntType##NAME _IntGroup##NAME                                         \
+                       __attribute__((vector_size(_INT_HASHMAP_GROUP_BYTES))); \
+                                                                               \
+enum {                                                                         \
+    _##NAME##Lanes = _INT_HASHMAP_GROUP_BYTES / sizeof(_IntType##NAME),        \
+};                                                                             \
+                                                                               \
+void NAME##New(NAME *map) {                                                    \
+    map->size = 0;                                                             \
+    map->capacity = 0;                                                         \
+    map->shift = 64;                                                           \
+    map->empty = (EMPTY);                                                      \
+    map->keys = NULL;                                                          \
+    map->values = NULL;                                                        \
+}                                                                              \
+                                                                               \
+void NAME##Destroy(NAME *map) {                                                \
+    if(map->keys) {                                                            \
+        FREE(map->keys);                                                       \
+        FREE(map->values);                                                     \
+    }                                                                          \
+    NAME##New(map);                                                            \
+}                                                                              \
+                                                                               \
+/* Fibonacci hashing, the upper bits of the product are the home slot.       */\
+static inline size_t _##NAME##Home(const NAME *map,                            \
+                                   _IntType##NAME key) {                       \
+    return (size_t) (((uint64_t) key * 0x9E3779B97F4A7C15u) >> map->shift);    \
+}                                                                              \
+                                                                               \
+/* Number of slots, not counting the group behind the tail.                  */\
+static inline size_t _##NAME##Slots(const NAME *map) {                         \
+    return map->capacity + _INT_HASHMAP_TAIL;                                  \
+}                                                                              \
+                                                                               \
+/* Finds the slot of key, or the first empty slot of its run.                */\
+/* \return true, if key was found.                                           */\
+static inline bool _##NAME##Probe(const NAME *map,                             \
+                                  _IntType##NAME key,                          \
+                                  size_t *slot) {                              \
+    const _IntGroup##NAME keys = key - (_IntGroup##NAME) {0};                  \
+    const _IntGroup##NAME empty = map->empty - (_IntGroup##NAME) {0};          \
+    for(size_t i = _##NAME##Home(map, key); ; i += _##NAME##Lanes) {           \
+        _IntGroup##NAME group;                                                 \
+        memcpy(&group, &map->keys[i], sizeof(group));                          \
+        uint32_t mask = _INT_HASHMAP_MASK(group == keys, _##NAME##Lanes);      \
+        if(mask) {                                                             \
+            *slot = i + __builtin_ctz(mask) / sizeof(_IntType##NAME);          \
+            return true;                                                       \
+        }                                                                      \
+        mask = _INT_HASHMAP_MASK(group == empty, _##NAME##Lanes);              \
+        if(mask) {                                                             \
+            *slot = i + __builtin_ctz(mask) / sizeof(_IntType##NAME);          \
+            return false;                                                      \
+        }                                                                      \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* Allocates empty arrays for capacity home slots.                           */\
+static bool _##NAME##Alloc(NAME *map,                                          \
+                           size_t capacity) {                                  \
+    size_t slots = capacity + _INT_HASHMAP_TAIL + _##NAME##Lanes;              \
+    if(capacity > SIZE_MAX / 2 ||                                              \
+                  slots > SIZE_MAX / sizeof(_IntValue##NAME) ||                \
+                  slots > SIZE_MAX / sizeof(_IntType##NAME)) {                 \
+        return false;                                                          \
+    }                                                                          \
+    _IntType##NAME *keys = REALLOC(NULL, sizeof(_IntType##NAME[slots]));       \
+    if(!keys) {                                                                \
+        return false;                                                          \
+    }                                                                          \
+    _IntValue##NAME *values = REALLOC(NULL, sizeof(_IntValue##NAME[slots]));   \
+    if(!values) {                                                              \
+        FREE(keys);                                                            \
+        return false;                                                          \
+    }                                                                          \
+    for(size_t i = 0; i < slots; ++i) {                                        \
+        keys[i] = map->empty;                                                  \
+    }                                                                          \
+    uint8_t shift = 64;                                                        \
+    for(size_t c = capacity; c > 1; c >>= 1) {                                 \
+        --shift;                                                               \
+    }                                                                          \
+    map->capacity = capacity;                                                  \
+    map->shift = shift;                                                        \
+    map->keys = keys;                                                          \
+    map->values = values;                                                      \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Moves all entries into new arrays of capacity home slots, or more, if the */\
+/* entries do not fit into the tail.                                         */\
+static bool _##NAME##Rehash(NAME *map,                                         \
+                            size_t capacity) {                                 \
+    NAME old = *map;                                                           \
+    for(;;) {                                                                  \
+        if(!_##NAME##Alloc(map, capacity)) {                                   \
+            *map = old;                                                        \
+            return false;                                                      \
+        }                                                                      \
+        size_t i = 0, oldSlots = old.keys ? _##NAME##Slots(&old) : 0;          \
+        for(; i < oldSlots; ++i) {                                             \
+            if(old.keys[i] == old.empty) {                                     \
+                continue;                                                      \
+            }                                                                  \
+            size_t slot;                                                       \
+            _##NAME##Probe(map, old.keys[i], &slot);                           \
+            if(slot >= _##NAME##Slots(map)) {                                  \
+                break;                                                         \
+            }                                                                  \
+            map->keys[slot] = old.keys[i];                                     \
+            map->values[slot] = old.values[i];                                 \
+        }                                                                      \
+        if(i == oldSlots) {                                                    \
+            break;                                                             \
+        }                                                                      \
+        /* overflowed the tail, try again with twice the capacity */           \
+        FREE(map->keys);                                                       \
+        FREE(map->values);                                                     \
+        capacity *= 2;                                                         \
+    }                                                                          \
+    if(old.keys) {                                                             \
+        FREE(old.keys);                                                        \
+        FREE(old.values);                                                      \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##EnsureSize(NAME *map,                                               \
+                      size_t capacity) {                                       \
+    if(capacity > SIZE_MAX / 4) {                                              \
+        return false;                                                          \
+    }                                                                          \
+    capacity = (capacity+2)/3 * 4; /* load factor = 0.75 */                    \
+    if(capacity <= map->capacity) {                                            \
+        return true;                                                           \
+    }                                                                          \
+    size_t newCapacity = map->capacity ? map->capacity : 8;                    \
+    while(newCapacity < capacity) {                                            \
+        newCapacity *= 2;                                                      \
+    }                                                                          \
+    return _##NAME##Rehash(map, newCapacity);                                  \
+}                                                                              \
+                                                                               \
+bool NAME##Find(const NAME *map,                                               \
+                _IntType##NAME key,                                            \
+                _IntValue##NAME **value) {                                     \
+    size_t slot;                                                               \
+    if(!map->keys || key == map->empty ||                                      \
+                     !_##NAME##Probe(map, key, &slot)) {                       \
+        return false;                                                          \
+    }                                                                          \
+    if(value) {                                                                \
+        *value = &map->values[slot];                                           \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+HashMapPutResult NAME##Put(NAME *map,                                          \
+                           _IntType##NAME key,                                 \
+                           _IntValue##NAME **value,                            \
+                           HashMapDuplicateResolution dr) {                    \
+    if(key == map->empty || !NAME##EnsureSize(map, map->size+1)) {             \
+        return HMPR_FAILED;                                                    \
+    }                                                                          \
+    size_t slot;                                                               \
+    if(_##NAME##Probe(map, key, &slot)) {                                      \
+        _IntValue##NAME *current = &map->values[slot];                         \
+        switch(dr) {                                                           \
+            case HMDR_FIND:                                                    \
+                *value = current;                                              \
+                return HMPR_FOUND;                                             \
+            case HMDR_REPLACE:                                                 \
+                *current = **value;                                            \
+                *value = current;                                              \
+                return HMPR_REPLACED;                                          \
+            case HMDR_SWAP: {                                                  \
+                _IntValue##NAME tmp = *current;                                \
+                *current = **value;                                            \
+                **value = tmp;                                                 \
+                *value = current;                                              \
+                return HMPR_SWAPPED;                                           \
+            }                                                                  \
+            default:                                                           \
+                *value = current;                                              \
+                return HMPR_FAILED;                                            \
+        }                                                                      \
+    }                                                                          \
+    while(slot >= _##NAME##Slots(map)) {                                       \
+        /* the run overflowed the tail */                                      \
+        if(!_##NAME##Rehash(map, map->capacity * 2)) {                         \
+            return HMPR_FAILED;                                                \
+        }                                                                      \
+        _##NAME##Probe(map, key, &slot);                                       \
+    }                                                                          \
+    map->keys[slot] = key;                                                     \
+    map->values[slot] = **value;                                               \
+    *value = &map->values[slot];                                               \
+    ++map->size;                                                               \
+    return HMPR_PUT;                                                           \
+}                                                                              \
+                                                                               \
+bool NAME##Remove(NAME *map,                                                   \
+                  _IntType##NAME key,                                          \
+                  _IntValue##NAME *value) {                                    \
+    size_t slot;                                                               \
+    if(!map->keys || key == map->empty ||                                      \
+                     !_##NAME##Probe(map, key, &slot)) {                       \
+        return false;                                                          \
+    }                                                                          \
+    if(value) {                                                                \
+        *value = map->values[slot];                                            \
+    }                                                                          \
+    /* shift back the following entries that may live in slot */               \
+    for(size_t next = slot + 1; map->keys[next] != map->empty; ++next) {       \
+        if(_##NAME##Home(map, map->keys[next]) <= slot) {                      \
+            map->keys[slot] = map->keys[next];                                 \
+            map->values[slot] = map->values[next];                             \
+            slot = next;                                                       \
+        }                                                                      \
+    }                                                                          \
+    map->keys[slot] = map->empty;                                              \
+    --map->size;                                                               \
+    return true;                                                               \
+}
+
+/**
+ * Iterates over all entries of an integer map.
+ * You must not insert or delete elements in this loop.
+ * You can use continue and break as in usual for-loops.
+ *
+ *     INT_HASHMAP_FOR_EACH(NAME, key, value, map) {
+ *         do_something(key, *value);
+ *     } INT_HASHMAP_FOR_EACH_END
+ *
+ * \param NAME Defined name of map
+ * \param KEY INT_TYPE variable for the current key.
+ * \param VALUE VALUE* variable for the current value.
+ * \param MAP Map to iterate over.
+ */
+#define INT_HASHMAP_FOR_EACH(NAME, KEY, VALUE, MAP)                            \
+    for(size_t __i = 0, __broke = 0; !__broke && (MAP).keys &&                 \
+                            __i < (MAP).capacity + _INT_HASHMAP_TAIL; ++__i) { \
+        if((MAP).keys[__i] == (MAP).empty) {                                   \
+            continue;                                                          \
+        }                                                                      \
+        KEY = (MAP).keys[__i];                                                 \
+        VALUE = &(MAP).values[__i];                                            \
+        __broke = 1;                                                           \
+        do
+
+/**
+ * Closes an INT_HASHMAP_FOR_EACH(...)
+ */
+#define INT_HASHMAP_FOR_EACH_END                                               \
+        while( __broke = 0, __broke );                                         \
+    }
+
+#endif // ifndef INTHASHMAP_H__
@@ -0,0 +1,334 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+#ifndef LRUCACHE_H__
+#define LRUCACHE_H__
+
+// Caches with a fixed number of entries on top of DEFINE_HASHMAP and
+// DECLARE_HASHMAP. All entries live in one array of slots allocated by
+// NAME##New(), the recency links are slot indices, so neither a hit nor an
+// eviction allocates.
+
+#include "hashmap.h"
+
+typedef enum {
+    LCP_LRU,   // evicts the least recently used entry, a hit relinks the slot
+    LCP_CLOCK, // evicts an entry not used since the clock hand passed it the
+               // last time, a hit only sets a flag
+} LruCachePolicy;
+
+// End of the recency list and of the list of free slots.
+#define _LRU_CACHE_NIL UINT32_MAX
+
+/**
+ * Defines the types and function prototypes of a cache type NAME.
+ * \param NAME Name of the cache type.
+ * \param TYPE Type of the entries.
+ */
+#define DEFINE_LRU_CACHE(NAME, TYPE)                                           \
+                                                                               \
+typedef TYPE _LruType##NAME;                                                   \
+                                                                               \
+typedef struct {                                                               \
+    TYPE     value;                                                            \
+    uint32_t prev;       /* more recently used slot, or free list link */      \
+    uint32_t next;       /* less recently used slot */                         \
+    uint8_t  referenced; /* used since the clock hand passed, for LCP_CLOCK */ \
+} NAME##Slot;                                                                  \
+                                                                               \
+DEFINE_HASHMAP(NAME##Index, NAME##Slot*)                                       \
+                                                                               \
+typedef struct {                                                               \
+    NAME##Index    index;                                                      \
+    NAME##Slot    *slots;                                                      \
+    uint32_t       capacity;                                                   \
+    uint32_t       used;     /* slots [0, used) were handed out */             \
+    uint32_t       free;     /* first free slot below used */                  \
+    uint32_t       newest;                                                     \
+    uint32_t       oldest;                                                     \
+    uint32_t       hand;     /* clock hand */                                  \
+    LruCachePolicy policy;                                                     \
+    void         (*evict)(TYPE *entry, void *ctx);                             \
+    void          *ctx;                                                        \
+} NAME;                                                                        \
+                                                                               \
+/* Initializes a cache with room for capacity entries.                       */\
+/* \param cache Cache to initialize.                                         */\
+/* \param capacity Maximum number of entries, 1 to UINT32_MAX-1.             */\
+/* \param policy Which entry to evict if the cache is full.                  */\
+/* \param evict Called with every entry that leaves the cache by eviction    */\
+/*              or NAME##Destroy(), e.g. to free it. May be NULL.            */\
+/* \param ctx Passed to evict.                                               */\
+/* \return false, if memory is exhausted.                                    */\
+bool NAME##New(NAME *cache,                                                    \
+               size_t capacity,                                                \
+               LruCachePolicy policy,                                          \
+               void (*evict)(TYPE *entry, void *ctx),                          \
+               void *ctx);                                                     \
+                                                                               \
+/* Calls evict for every cached entry and frees the cache.                   */\
+/* \param cache Cache to destroy.                                            */\
+void NAME##Destroy(NAME *cache);                                               \
+                                                                               \
+/* Looks up an entry and marks it as used.                                   */\
+/* \param cache Cache to search in.                                          */\
+/* \param entry [In/Out] Entry to search, returns pointer to found item.     */\
+/*              The pointer is valid until the entry leaves the cache.       */\
+/* \return false, if could not found.                                        */\
+bool NAME##Get(NAME *cache,                                                    \
+               TYPE **entry);                                                  \
+                                                                               \
+/* Looks up an entry without marking it as used.                             */\
+/* \param cache Cache to search in.                                          */\
+/* \param entry [In/Out] Entry to search, returns pointer to found item.     */\
+/* \return false, if could not found.                                        */\
+bool NAME##Peek(const NAME *cache,                                             \
+                TYPE **entry);                                                 \
+                                                                               \
+/* Adds an entry into a cache and marks it as used. If the cache is full,    */\
+/* an entry gets evicted first.                                              */\
+/* \param cache Cache to add to.                                             */\
+/* \param entry [In/Out] Entry add. Returns pointer to the cached item.      */\
+/* \param dr What to do with duplicates. HMDR_STACK is not supported.        */\
+/* \return HMPR_FAILED if dr is HMDR_FAIL or HMDR_STACK and the entry        */\
+/*         existed, or if memory is exhausted.                               */\
+HashMapPutResult NAME##Put(NAME *cache,                                        \
+                           TYPE **entry,                                       \
+                           HashMapDuplicateResolution dr);                     \
+                                                                               \
+/* Removes an entry from a cache, without calling evict.                     */\
+/* \param cache Cache to remove from.                                        */\
+/* \param entry [In/out] Entry to remove, returns removed entry.             */\
+/* \return false, if did not exist                                           */\
+bool NAME##Remove(NAME *cache,                                                 \
+                  TYPE *entry);
+
+/**
+ * Declares the functions of cache type NAME.
+ * The parameters are the same as for DECLARE_HASHMAP(...), CMP and GET_HASH
+ * get TYPE* arguments.
+ */
+#define DECLARE_LRU_CACHE(NAME, CMP, GET_HASH, FREE, REALLOC)                  \
+                                                                               \
+static inline int _##NAME##SlotCmp(NAME##Slot **left,                          \
+                                   NAME##Slot **right) {                       \
+    return (CMP((&(*left)->value), (&(*right)->value))) != 0;                  \
+}                                                                              \
+                                                                               \
+static inline size_t _##NAME##SlotHash(NAME##Slot **slot) {                    \
+    return (size_t)(GET_HASH((&(*slot)->value)));                              \
+}                                                                              \
+                                                                               \
+DECLARE_HASHMAP(NAME##Index, _##NAME##SlotCmp, _##NAME##SlotHash,              \
+                FREE, REALLOC)                                                 \
+                                                                               \
+bool NAME##New(NAME *cache,                                                    \
+               size_t capacity,                                                \
+               LruCachePolicy policy,                                          \
+               void (*evict)(_LruType##NAME *entry, void *ctx),                \
+               void *ctx) {                                                    \
+    if(capacity < 1 || capacity >= _LRU_CACHE_NIL ||                           \
+                       capacity > SIZE_MAX / sizeof(NAME##Slot)) {             \
+        return false;                                                          \
+    }                                                                          \
+    NAME##IndexNew(&cache->index);                                             \
+    if(!NAME##IndexEnsureSize(&cache->index, capacity)) {                      \
+        return false;                                                          \
+    }                                                                          \
+    cache->slots = REALLOC(NULL, sizeof(NAME##Slot[capacity]));                \
+    if(!cache->slots) {                                                        \
+        NAME##IndexDestroy(&cache->index);                                     \
+        return false;                                                          \
+    }                                                                          \
+    cache->capacity = capacity;                                                \
+    cache->used = 0;                                                           \
+    cache->free = _LRU_CACHE_NIL;                                              \
+    cache->newest = _LRU_CACHE_NIL;                                            \
+    cache->oldest = _LRU_CACHE_NIL;                                            \
+    cache->hand = 0;                                                           \
+    cache->policy = policy;                                                    \
+    cache->evict = evict;                                                      \
+    cache->ctx = ctx;                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+void NAME##Destroy(NAME *cache) {                                              \
+    if(cache->evict) {                                                         \
+        NAME##Slot **iter;                                                     \
+        HASHMAP_FOR_EACH(NAME##Index, iter, cache->index) {                    \
+            cache->evict(&(*iter)->value, cache->ctx);                         \
+        } HASHMAP_FOR_EACH_END                                                 \
+    }                                                                          \
+    NAME##IndexDestroy(&cache->index);                                         \
+    FREE(cache->slots);                                                        \
+    cache->slots = NULL;                                                       \
+    cache->capacity = 0;                                                       \
+    cache->used = 0;                                                           \
+}                                                                              \
+                                                                               \
+/* Removes slot i from the recency list.                                     */\
+static void _##NAME##Unlink(NAME *cache,                                       \
+                            uint32_t i) {                                      \
+    NAME##Slot *slot = &cache->slots[i];                                       \
+    if(slot->prev != _LRU_CACHE_NIL) {                                         \
+        cache->slots[slot->prev].next = slot->next;                            \
+    } else {                                                                   \
+        cache->newest = slot->next;                                            \
+    }                                                                          \
+    if(slot->next != _LRU_CACHE_NIL) {                                         \
+        cache->slots[slot->next].prev = slot->prev;                            \
+    } else {                                                                   \
+        cache->oldest = slot->prev;                                            \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* Puts slot i at the front of the recency list.                             */\
+static void _##NAME##PushNewest(NAME *cache,                                   \
+                                uint32_t i) {                                  \
+    NAME##Slot *slot = &cache->slots[i];                                       \
+    slot->prev = _LRU_CACHE_NIL;                                               \
+    slot->next = cache->newest;                                                \
+    if(cache->newest != _LRU_CACHE_NIL) {                                      \
+        cache->slots[cache->newest].prev = i;                                  \
+    } else {                                                                   \
+        cache->oldest = i;                                                     \
+    }                                                                          \
+    cache->newest = i;                                                         \
+}                                                                              \
+                                                                               \
+static void _##NAME##Touch(NAME *cache,                                        \
+                           NAME##Slot *slot) {                                 \
+    if(cache->policy == LCP_CLOCK) {                                           \
+        if(!slot->referenced) {                                                \
+            slot->referenced = 1;                                              \
+        }                                                                      \
+    } else if(cache->newest != (uint32_t) (slot - cache->slots)) {             \
+        _##NAME##Unlink(cache, slot - cache->slots);                           \
+        _##NAME##PushNewest(cache, slot - cache->slots);                       \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* \return the index of a slot to evict, the cache has to be full.           */\
+static uint32_t _##NAME##Victim(NAME *cache) {                                 \
+    if(cache->policy != LCP_CLOCK) {                                           \
+        return cache->oldest;                                                  \
+    }                                                                          \
+    for(;;) {                                                                  \
+        uint32_t i = cache->hand;                                              \
+        cache->hand = i + 1 < cache->capacity ? i + 1 : 0;                     \
+        if(!cache->slots[i].referenced) {                                      \
+            return i;                                                          \
+        }                                                                      \
+        cache->slots[i].referenced = 0;                                        \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* \return the slot in the index equal to *entry, or NULL.                   */\
+static NAME##Slot *_##NAME##Lookup(const NAME *cache,                          \
+                                   NAME##Slot *probe) {                        \
+    NAME##Slot **found = &probe;                                               \
+    if(!NAME##IndexFind(&cache->index, &found)) {                              \
+        return NULL;                                                           \
+    }                                                                          \
+    return *found;                                                             \
+}                                                                              \
+                                                                               \
+bool NAME##Get(NAME *cache,                                                    \
+               _LruType##NAME **entry) {                                       \
+    NAME##Slot probe = { .value = **entry };                                   \
+    NAME##Slot *slot = _##NAME##Lookup(cache, &probe);                         \
+    if(!slot) {                                                                \
+        return false;                                                          \
+    }                                                                          \
+    _##NAME##Touch(cache, slot);                                               \
+    *entry = &slot->value;                                                     \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##Peek(const NAME *cache,                                             \
+                _LruType##NAME **entry) {                                      \
+    NAME##Slot probe = { .value = **entry };                                   \
+    NAME##Slot *slot = _##NAME##Lookup(cache, &probe);                         \
+    if(!slot) {                                                                \
+        return false;                                                          \
+    }                                                                          \
+    *entry = &slot->value;                                                     \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+HashMapPutResult NAME##Put(NAME *cache,                                        \
+                           _LruType##NAME **entry,                             \
+                           HashMapDuplicateResolution dr) {                    \
+    NAME##Slot probe = { .value = **entry };                                   \
+    NAME##Slot *slot = _##NAME##Lookup(cache, &probe);                         \
+    if(slot) {                                                                 \
+        HashMapPutResult result;                                               \
+        switch(dr) {                                                           \
+            case HMDR_FIND:                                                    \
+                result = HMPR_FOUND;                                           \
+                break;                                                         \
+            case HMDR_REPLACE:                                                 \
+                slot->value = **entry;                                         \
+                result = HMPR_REPLACED;                                        \
+                break;                                                         \
+            case HMDR_SWAP:                                                    \
+                **entry = slot->value;                                         \
+                slot->value = probe.value;                                     \
+                result = HMPR_SWAPPED;                                         \
+                break;                                                         \
+            default:                                                           \
+                *entry = &slot->value;                                         \
+                return HMPR_FAILED;                                            \
+        }                                                                      \
+        _##NAME##Touch(cache, slot);                                           \
+        *entry = &slot->value;                                                 \
+        return result;                                                         \
+    }                                                                          \
+    uint32_t i;                                                                \
+    if(cache->free != _LRU_CACHE_NIL) {                                        \
+        i = cache->free;                                                       \
+        cache->free = cache->slots[i].prev;                                    \
+    } else if(cache->used < cache->capacity) {                                 \
+        i = cache->used++;                                                     \
+    } else {                                                                   \
+        i = _##NAME##Victim(cache);                                            \
+        slot = &cache->slots[i];                                               \
+        NAME##IndexRemove(&cache->index, &slot);                               \
+        _##NAME##Unlink(cache, i);                                             \
+        if(cache->evict) {                                                     \
+            cache->evict(&slot->value, cache->ctx);                            \
+        }                                                                      \
+    }                                                                          \
+    slot = &cache->slots[i];                                                   \
+    slot->value = probe.value;                                                 \
+    slot->referenced = 0;                                                      \
+    NAME##Slot **putSlot = &slot;                                              \
+    if(NAME##IndexPut(&cache->index, &putSlot, HMDR_FAIL) != HMPR_PUT) {       \
+        slot->prev = cache->free;                                              \
+        cache->free = i;                                                       \
+        return HMPR_FAILED;                                                    \
+    }                                                                          \
+    _##NAME##PushNewest(cache, i);                                             \
+    *entry = &slot->value;                                                     \
+    return HMPR_PUT;                                                           \
+}                                                                              \
+                                                                               \
+bool NAME##Remove(NAME *cache,                                                 \
+                  _LruType##NAME *entry) {                                     \
+    NAME##Slot probe = { .value = *entry };                                    \
+    NAME##Slot *slot = _##NAME##Lookup(cache, &probe);                         \
+    if(!slot) {                                                                \
+        return false;                                                          \
+    }                                                                          \
+    *entry = slot->value;                                                      \
+    NAME##IndexRemove(&cache->index, &slot);                                   \
+    uint32_t i = slot - cache->slots;                                          \
+    _##NAME##Unlink(cache, i);                                                 \
+    slot->prev = cache->free;                                                  \
+    cache->free = i;                                                           \
+    return true;                                                               \
+}
+
+#endif // ifndef LRUCACHE_H__
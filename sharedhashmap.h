@@ -0,0 +1,598 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+#ifndef SHAREDHASHMAP_H__
+#define SHAREDHASHMAP_H__
+
+// Maps in a shared memory region, e.g. a memfd_create(2) or shm_open(3) file,
+// that several processes map and search at the same time. Pre-forked workers
+// inherit the mapping, other processes attach to the file descriptor.
+//
+// The map and its buckets only contain offsets into the region, never raw
+// pointers, so every process may map the region at another address. All the
+// memory comes from the region, which has a fixed size: a map is full when
+// its region is exhausted, and freed blocks are reused.
+//
+// There is only one writer at a time, if several processes write, they have to
+// serialize NAME##Put(...), NAME##Remove(...) and NAME##EnsureSize(...)
+// themselves, e.g. with flock(2). The readers never lock, they copy the entry
+// out and retry if the writer changed the map meanwhile (a seqlock). For that
+// TYPE must be plain data, and CMP must only read the entries, because it can
+// see a half-written entry before the retry.
+// POSIX only.
+
+#include "hashmap.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// "ShrdMap1" read as a little endian integer.
+#define _SHARED_HASHMAP_MAGIC 0x3170614d64726853ull
+
+// Blocks are 2^order bytes, at least 2^_SHARED_HASHMAP_MIN_ORDER bytes.
+#define _SHARED_HASHMAP_MIN_ORDER 4
+#define _SHARED_HASHMAP_ORDERS 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#   define _SHARED_HASHMAP_PAUSE() __builtin_ia32_pause()
+#else
+#   define _SHARED_HASHMAP_PAUSE() do {} while(0)
+#endif
+
+/**
+ * Start of the region, the same for every map type. Only offsets from the
+ * start of the region are stored.
+ */
+typedef struct {
+    uint64_t magic;
+    uint64_t entrySize; // sizeof(TYPE) of the creator
+    uint64_t bytes;     // size of the region
+    uint64_t sequence;  // odd while the writer changes the map
+    uint64_t size;      // number of entries
+    uint64_t table;     // offset of the buckets, 0 if none yet
+    uint64_t nth_prime; // index of the number of buckets in _HASHMAP_PRIMES
+    uint64_t end;       // offset of the memory that was never allocated
+    uint64_t free[_SHARED_HASHMAP_ORDERS]; // freed blocks of 2^order bytes,
+                                           // linked by their first 8 bytes
+} SharedHashMapHeader;
+
+static inline void *_sharedHashMapAt(SharedHashMapHeader *header,
+                                     uint64_t offset) {
+    return (char *) header + offset;
+}
+
+/**
+ * Smallest order of a block that holds bytes.
+ */
+static inline unsigned _sharedHashMapOrder(uint64_t bytes) {
+    unsigned order = _SHARED_HASHMAP_MIN_ORDER;
+    while(order < _SHARED_HASHMAP_ORDERS - 1 &&
+          ((uint64_t) 1 << order) < bytes) {
+        ++order;
+    }
+    return order;
+}
+
+/**
+ * Allocates a block of 2^order bytes, from the freed blocks if possible.
+ * Only the writer calls this, the readers never look at a free block.
+ * \return offset of the block, 0 if the region is exhausted.
+ */
+static inline uint64_t _sharedHashMapAlloc(SharedHashMapHeader *header,
+                                           unsigned order) {
+    uint64_t offset = header->free[order];
+    if(offset) {
+        memcpy(&header->free[order], _sharedHashMapAt(header, offset),
+               sizeof(uint64_t));
+        return offset;
+    }
+    uint64_t bytes = (uint64_t) 1 << order;
+    if(bytes > header->bytes - header->end) {
+        return 0;
+    }
+    offset = header->end;
+    header->end += bytes;
+    return offset;
+}
+
+static inline void _sharedHashMapFree(SharedHashMapHeader *header,
+                                      uint64_t offset,
+                                      unsigned order) {
+    if(offset) {
+        memcpy(_sharedHashMapAt(header, offset), &header->free[order],
+               sizeof(uint64_t));
+        header->free[order] = offset;
+    }
+}
+
+/**
+ * Opens a write window: readers that overlap it retry.
+ */
+static inline void _sharedHashMapBegin(SharedHashMapHeader *header) {
+    __atomic_store_n(&header->sequence, header->sequence + 1,
+                     __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void _sharedHashMapEnd(SharedHashMapHeader *header) {
+    __atomic_store_n(&header->sequence, header->sequence + 1,
+                     __ATOMIC_RELEASE);
+}
+
+/**
+ * Defines the types and function prototypes of a shared map type NAME.
+ * \param NAME Name of the map type.
+ * \param TYPE Type of the entries, plain data without pointers.
+ */
+#define DEFINE_SHARED_HASHMAP(NAME, TYPE)                                      \
+                                                                               \
+typedef TYPE _SharedType##NAME;                                                \
+                                                                               \
+typedef struct {                                                               \
+    uint64_t entries; /* offset of the entries, 0 if none */                   \
+    uint32_t size;    /* number of entries */                                  \
+    uint32_t order;   /* the entries are in a block of 2^order bytes */        \
+} NAME##Bucket;                                                                \
+                                                                               \
+typedef struct {                                                               \
+    SharedHashMapHeader *header;   /* start of the mapping */                  \
+    size_t               bytes;    /* length of the mapping */                 \
+    bool                 writable;                                             \
+} NAME;                                                                        \
+                                                                               \
+/* Creates an empty map in a file, and maps it.                              */\
+/* \param map [Out] Map to initialize.                                       */\
+/* \param fd File to create the map in, e.g. from memfd_create(2) or         */\
+/*           shm_open(3), opened for reading and writing. It is resized to   */\
+/*           bytes, and may be closed afterwards.                            */\
+/* \param bytes Size of the region, all entries and buckets must fit in.     */\
+/*              Pages that are never used are not allocated by the kernel.   */\
+/* \return false, if the file could not be resized or mapped.                */\
+bool NAME##Create(NAME *map,                                                   \
+                  int fd,                                                      \
+                  size_t bytes);                                               \
+                                                                               \
+/* Maps a map that another process created with NAME##Create(...).           */\
+/* \param map [Out] Map to initialize.                                       */\
+/* \param fd File of the map, may be closed afterwards.                      */\
+/* \param writable Whether the process will change the map.                  */\
+/* \return false, if the file could not be mapped, or does not contain a map */\
+/*         of TYPE.                                                          */\
+bool NAME##Attach(NAME *map,                                                   \
+                  int fd,                                                      \
+                  bool writable);                                              \
+                                                                               \
+/* Unmaps a map. The map stays in the file for the other processes.          */\
+/* \param map Map to detach from.                                            */\
+void NAME##Detach(NAME *map);                                                  \
+                                                                               \
+/* Number of entries, may be outdated immediately.                           */\
+/* \param map Map to count.                                                  */\
+/* \return Number of entries.                                                */\
+size_t NAME##Size(const NAME *map);                                            \
+                                                                               \
+/* Looks up an entry in a map. Does not lock, may run in any number of       */\
+/* processes at the same time, and concurrently with the writer.             */\
+/* \param map Map to search in.                                              */\
+/* \param entry [In/Out] Entry to search, returns a copy of the found entry. */\
+/* \return false, if could not found.                                        */\
+bool NAME##Find(const NAME *map,                                               \
+                TYPE *entry);                                                  \
+                                                                               \
+/* Grows the map to hold at least capacity entries. Writer only.             */\
+/* \param map Map to grow.                                                   */\
+/* \param capacity Number of entries.                                        */\
+/* \return false, if the region is exhausted or the map is not writable.     */\
+bool NAME##EnsureSize(NAME *map,                                               \
+                      size_t capacity);                                        \
+                                                                               \
+/* Adds an entry into a map. Writer only.                                    */\
+/* The readers see the new entry as soon as this returns.                    */\
+/* \param map Map to add to.                                                 */\
+/* \param entry [In/Out] Entry add. If duplicate, returns a copy of the old  */\
+/*              entry in here, depending on dr.                              */\
+/* \param dr What to do with duplicates, HMDR_STACK is not supported.        */\
+/* \return HMPR_FAILED as for NAME##Put() of DEFINE_HASHMAP(...), or if the  */\
+/*         region is exhausted or the map is not writable.                   */\
+HashMapPutResult NAME##Put(NAME *map,                                          \
+                           TYPE *entry,                                        \
+                           HashMapDuplicateResolution dr);                     \
+                                                                               \
+/* Removes an entry for the list. Writer only.                               */\
+/* \param map Map to remove from.                                            */\
+/* \param entry [In/out] Entry to remove, returns removed entry.             */\
+/* \return false, if did not exist, or the map is not writable.              */\
+bool NAME##Remove(NAME *map,                                                   \
+                  TYPE *entry);
+
+
+/**
+ * Declares the functions of shared map type NAME.
+ * \param NAME Name of the map type.
+ * \param CMP Comparison function as for DECLARE_HASHMAP(...), it may only
+ *            read the entries.
+ * \param GET_HASH Hash function as for DECLARE_HASHMAP(...), it is only
+ *                 called with entries that are not shared.
+ */
+#define DECLARE_SHARED_HASHMAP(NAME, CMP, GET_HASH)                            \
+                                                                               \
+static const uint64_t _##NAME##Primes[] = { _HASHMAP_PRIMES, 0 };              \
+                                                                               \
+static bool _##NAME##Map(NAME *map,                                            \
+                         int fd,                                               \
+                         size_t bytes,                                         \
+                         bool writable) {                                      \
+    void *memory = mmap(NULL, bytes,                                           \
+                        writable ? PROT_READ | PROT_WRITE : PROT_READ,         \
+                        MAP_SHARED, fd, 0);                                    \
+    if(memory == MAP_FAILED) {                                                 \
+        return false;                                                          \
+    }                                                                          \
+    map->header = (SharedHashMapHeader *) memory;                              \
+    map->bytes = bytes;                                                        \
+    map->writable = writable;                                                  \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##Create(NAME *map,                                                   \
+                  int fd,                                                      \
+                  size_t bytes) {                                              \
+    if(bytes < sizeof(SharedHashMapHeader) + 1024 ||                           \
+       ftruncate(fd, (off_t) bytes) != 0 ||                                    \
+       !_##NAME##Map(map, fd, bytes, true)) {                                  \
+        return false;                                                          \
+    }                                                                          \
+    SharedHashMapHeader *header = map->header;                                 \
+    memset(header, 0, sizeof(*header));                                        \
+    header->entrySize = sizeof(_SharedType##NAME);                             \
+    header->bytes = bytes;                                                     \
+    header->end = (sizeof(*header) + (1u << _SHARED_HASHMAP_MIN_ORDER) - 1) &  \
+                  ~(uint64_t) ((1u << _SHARED_HASHMAP_MIN_ORDER) - 1);         \
+    __atomic_store_n(&header->magic, _SHARED_HASHMAP_MAGIC, __ATOMIC_RELEASE); \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##Attach(NAME *map,                                                   \
+                  int fd,                                                      \
+                  bool writable) {                                             \
+    struct stat st;                                                            \
+    if(fstat(fd, &st) != 0 ||                                                  \
+       st.st_size < (off_t) sizeof(SharedHashMapHeader) ||                     \
+       (uint64_t) st.st_size > SIZE_MAX) {                                     \
+        return false;                                                          \
+    }                                                                          \
+    if(!_##NAME##Map(map, fd, (size_t) st.st_size, writable)) {                \
+        return false;                                                          \
+    }                                                                          \
+    const SharedHashMapHeader *header = map->header;                           \
+    if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) !=                    \
+                                                    _SHARED_HASHMAP_MAGIC ||   \
+       header->entrySize != sizeof(_SharedType##NAME) ||                       \
+       header->bytes != map->bytes) {                                          \
+        NAME##Detach(map);                                                     \
+        return false;                                                          \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+void NAME##Detach(NAME *map) {                                                 \
+    munmap(map->header, map->bytes);                                           \
+    map->header = NULL;                                                        \
+    map->bytes = 0;                                                            \
+}                                                                              \
+                                                                               \
+size_t NAME##Size(const NAME *map) {                                           \
+    return (size_t) __atomic_load_n(&map->header->size, __ATOMIC_RELAXED);     \
+}                                                                              \
+                                                                               \
+/* Helper function that searches the bucket of an entry. Every offset is     */\
+/* checked against the region before it is used, because a reader can see    */\
+/* the map while the writer changes it.                                      */\
+/* \return 1 and the offsets of the bucket and the entry if found, 0 if not  */\
+/*         found, -1 if the map is inconsistent.                             */\
+static int _##NAME##Lookup(const NAME *map,                                    \
+                           const _SharedType##NAME *entry,                     \
+                           size_t hash,                                        \
+                           uint64_t *bucketOffset,                             \
+                           uint64_t *entryOffset) {                            \
+    SharedHashMapHeader *header = map->header;                                 \
+    const uint64_t bytes = map->bytes;                                         \
+    uint64_t table = __atomic_load_n(&header->table, __ATOMIC_RELAXED);        \
+    if(!table) {                                                               \
+        return 0;                                                              \
+    }                                                                          \
+    uint64_t nth_prime = __atomic_load_n(&header->nth_prime, __ATOMIC_RELAXED);\
+    if(nth_prime >= sizeof(_##NAME##Primes) / sizeof(uint64_t) - 1) {          \
+        return -1;                                                             \
+    }                                                                          \
+    uint64_t buckets = _##NAME##Primes[nth_prime];                             \
+    if(table % sizeof(NAME##Bucket) || table > bytes ||                        \
+       buckets > (bytes - table) / sizeof(NAME##Bucket)) {                     \
+        return -1;                                                             \
+    }                                                                          \
+    uint64_t offset = table + (uint64_t) hash % buckets * sizeof(NAME##Bucket);\
+    NAME##Bucket *bucket = (NAME##Bucket *) _sharedHashMapAt(header, offset);  \
+    uint64_t entries = __atomic_load_n(&bucket->entries, __ATOMIC_RELAXED);    \
+    uint32_t size = __atomic_load_n(&bucket->size, __ATOMIC_RELAXED);          \
+    if(!size) {                                                                \
+        return 0;                                                              \
+    }                                                                          \
+    if(entries % sizeof(uint64_t) || entries > bytes ||                        \
+       size > (bytes - entries) / sizeof(_SharedType##NAME)) {                 \
+        return -1;                                                             \
+    }                                                                          \
+    for(uint32_t i = 0; i < size; ++i) {                                       \
+        uint64_t at = entries + i * (uint64_t) sizeof(_SharedType##NAME);      \
+        const _SharedType##NAME *iter = (const _SharedType##NAME *)            \
+                                        _sharedHashMapAt(header, at);          \
+        if(CMP(iter, entry) == 0) {                                            \
+            *bucketOffset = offset;                                            \
+            *entryOffset = at;                                                 \
+            return 1;                                                          \
+        }                                                                      \
+    }                                                                          \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+bool NAME##Find(const NAME *map,                                               \
+                _SharedType##NAME *entry) {                                    \
+    SharedHashMapHeader *header = map->header;                                 \
+    size_t hash = GET_HASH(entry);                                             \
+    for(;;) {                                                                  \
+        uint64_t sequence = __atomic_load_n(&header->sequence,                 \
+                                            __ATOMIC_ACQUIRE);                 \
+        if(sequence & 1) {                                                     \
+            _SHARED_HASHMAP_PAUSE();                                           \
+            continue;                                                          \
+        }                                                                      \
+        uint64_t bucket, at;                                                   \
+        int found = _##NAME##Lookup(map, entry, hash, &bucket, &at);           \
+        _SharedType##NAME copy;                                                \
+        if(found > 0) {                                                        \
+            memcpy(&copy, _sharedHashMapAt(header, at), sizeof(copy));         \
+        }                                                                      \
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);                               \
+        if(__atomic_load_n(&header->sequence, __ATOMIC_RELAXED) != sequence) { \
+            continue;                                                          \
+        }                                                                      \
+        if(found <= 0) {                                                       \
+            return false;                                                      \
+        }                                                                      \
+        *entry = copy;                                                         \
+        return true;                                                           \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* Helper function that appends an entry to a bucket no reader can see yet.  */\
+static bool _##NAME##Append(SharedHashMapHeader *header,                       \
+                            NAME##Bucket *bucket,                              \
+                            const _SharedType##NAME *entry) {                  \
+    const uint64_t size = sizeof(_SharedType##NAME);                           \
+    if(!bucket->entries || (bucket->size + 1) * size >                         \
+                           (uint64_t) 1 << bucket->order) {                    \
+        unsigned order = bucket->entries                                       \
+                       ? bucket->order + 1                                     \
+                       : _sharedHashMapOrder(size);                            \
+        uint64_t entries = _sharedHashMapAlloc(header, order);                 \
+        if(!entries) {                                                         \
+            return false;                                                      \
+        }                                                                      \
+        memcpy(_sharedHashMapAt(header, entries),                              \
+               _sharedHashMapAt(header, bucket->entries),                      \
+               bucket->size * size);                                           \
+        if(bucket->entries) {                                                  \
+            _sharedHashMapFree(header, bucket->entries, bucket->order);        \
+        }                                                                      \
+        bucket->entries = entries;                                             \
+        bucket->order = order;                                                 \
+    }                                                                          \
+    memcpy(_sharedHashMapAt(header, bucket->entries + bucket->size * size),    \
+           entry, size);                                                       \
+    ++bucket->size;                                                            \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Helper function that frees the entries of a table and the table.          */\
+static void _##NAME##FreeTable(SharedHashMapHeader *header,                    \
+                               uint64_t table,                                 \
+                               uint64_t buckets) {                             \
+    NAME##Bucket *iter = (NAME##Bucket *) _sharedHashMapAt(header, table);     \
+    for(uint64_t i = 0; i < buckets; ++i) {                                    \
+        if(iter[i].entries) {                                                  \
+            _sharedHashMapFree(header, iter[i].entries, iter[i].order);        \
+        }                                                                      \
+    }                                                                          \
+    _sharedHashMapFree(header, table,                                          \
+                       _sharedHashMapOrder(buckets * sizeof(NAME##Bucket)));   \
+}                                                                              \
+                                                                               \
+/* Helper function that moves the entries into a new table. The new table is */\
+/* built in free memory while the readers still use the old one, and only    */\
+/* the switch is in a write window.                                          */\
+static bool _##NAME##Rehash(NAME *map,                                         \
+                            uint64_t nth_prime) {                              \
+    SharedHashMapHeader *header = map->header;                                 \
+    uint64_t buckets = _##NAME##Primes[nth_prime];                             \
+    if(buckets > header->bytes / sizeof(NAME##Bucket)) {                       \
+        return false;                                                          \
+    }                                                                          \
+    uint64_t table = _sharedHashMapAlloc(                                      \
+            header, _sharedHashMapOrder(buckets * sizeof(NAME##Bucket)));      \
+    if(!table) {                                                               \
+        return false;                                                          \
+    }                                                                          \
+    NAME##Bucket *newBuckets = (NAME##Bucket *)                                \
+                               _sharedHashMapAt(header, table);                \
+    memset(newBuckets, 0, buckets * sizeof(NAME##Bucket));                     \
+                                                                               \
+    uint64_t oldTable = header->table;                                         \
+    uint64_t oldBuckets = oldTable ? _##NAME##Primes[header->nth_prime] : 0;   \
+    NAME##Bucket *oldBucket = (NAME##Bucket *)                                 \
+                              _sharedHashMapAt(header, oldTable);              \
+    for(uint64_t i = 0; i < oldBuckets; ++i) {                                 \
+        for(uint32_t j = 0; j < oldBucket[i].size; ++j) {                      \
+            _SharedType##NAME *entry = (_SharedType##NAME *) _sharedHashMapAt( \
+                    header, oldBucket[i].entries +                             \
+                            j * (uint64_t) sizeof(_SharedType##NAME));         \
+            size_t hash = GET_HASH(entry);                                     \
+            if(!_##NAME##Append(header, &newBuckets[(uint64_t) hash % buckets],\
+                                entry)) {                                      \
+                _##NAME##FreeTable(header, table, buckets);                    \
+                return false;                                                  \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    _sharedHashMapBegin(header);                                               \
+    header->table = table;                                                     \
+    header->nth_prime = nth_prime;                                             \
+    _sharedHashMapEnd(header);                                                 \
+                                                                               \
+    if(oldTable) {                                                             \
+        _##NAME##FreeTable(header, oldTable, oldBuckets);                      \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##EnsureSize(NAME *map,                                               \
+                      size_t capacity) {                                       \
+    if(!map->writable) {                                                       \
+        return false;                                                          \
+    }                                                                          \
+    SharedHashMapHeader *header = map->header;                                 \
+    uint64_t nth_prime = header->table ? header->nth_prime : 0;                \
+    while(_##NAME##Primes[nth_prime] &&                                        \
+          _##NAME##Primes[nth_prime] < capacity) {                             \
+        ++nth_prime;                                                           \
+    }                                                                          \
+    if(!_##NAME##Primes[nth_prime]) {                                          \
+        return false;                                                          \
+    } else if(header->table && nth_prime == header->nth_prime) {               \
+        return true;                                                           \
+    }                                                                          \
+    return _##NAME##Rehash(map, nth_prime);                                    \
+}                                                                              \
+                                                                               \
+HashMapPutResult NAME##Put(NAME *map,                                          \
+                           _SharedType##NAME *entry,                           \
+                           HashMapDuplicateResolution dr) {                    \
+    if(!map->writable) {                                                       \
+        return HMPR_FAILED;                                                    \
+    }                                                                          \
+    SharedHashMapHeader *header = map->header;                                 \
+    const uint64_t size = sizeof(_SharedType##NAME);                           \
+    size_t hash = GET_HASH(entry);                                             \
+    uint64_t bucketOffset, at;                                                 \
+    switch(_##NAME##Lookup(map, entry, hash, &bucketOffset, &at)) {            \
+        case 0:                                                                \
+            break;                                                             \
+        case 1:                                                                \
+            switch(dr) {                                                       \
+                case HMDR_FIND:                                                \
+                    memcpy(entry, _sharedHashMapAt(header, at), size);         \
+                    return HMPR_FOUND;                                         \
+                case HMDR_REPLACE:                                             \
+                    _sharedHashMapBegin(header);                               \
+                    memcpy(_sharedHashMapAt(header, at), entry, size);         \
+                    _sharedHashMapEnd(header);                                 \
+                    return HMPR_REPLACED;                                      \
+                case HMDR_SWAP: {                                              \
+                    _SharedType##NAME old;                                     \
+                    memcpy(&old, _sharedHashMapAt(header, at), size);          \
+                    _sharedHashMapBegin(header);                               \
+                    memcpy(_sharedHashMapAt(header, at), entry, size);         \
+                    _sharedHashMapEnd(header);                                 \
+                    *entry = old;                                              \
+                    return HMPR_SWAPPED;                                       \
+                }                                                              \
+                case HMDR_FAIL:                                                \
+                    memcpy(entry, _sharedHashMapAt(header, at), size);         \
+                    return HMPR_FAILED;                                        \
+                default:                                                       \
+                    return HMPR_FAILED;                                        \
+            }                                                                  \
+        default:                                                               \
+            return HMPR_FAILED;                                                \
+    }                                                                          \
+                                                                               \
+    if(header->size >= SIZE_MAX ||                                             \
+       !NAME##EnsureSize(map, (size_t) header->size + 1)) {                    \
+        return HMPR_FAILED;                                                    \
+    }                                                                          \
+    uint64_t index = (uint64_t) hash % _##NAME##Primes[header->nth_prime];     \
+    NAME##Bucket *bucket = (NAME##Bucket *) _sharedHashMapAt(header,           \
+            header->table + index * sizeof(NAME##Bucket));                     \
+    if(bucket->size >= UINT32_MAX) {                                           \
+        return HMPR_FAILED;                                                    \
+    } else if(bucket->entries &&                                               \
+              (bucket->size + 1) * size <= (uint64_t) 1 << bucket->order) {    \
+        /* the slot after the last entry is not visible to the readers, */     \
+        /* but the new size must not be seen before the entry           */     \
+        _sharedHashMapBegin(header);                                           \
+        memcpy(_sharedHashMapAt(header, bucket->entries + bucket->size * size),\
+               entry, size);                                                   \
+        ++bucket->size;                                                        \
+        ++header->size;                                                        \
+        _sharedHashMapEnd(header);                                             \
+        return HMPR_PUT;                                                       \
+    }                                                                          \
+                                                                               \
+    /* the entries get copied into a bigger block, while the readers still  */ \
+    /* use the old one                                                      */ \
+    unsigned order = bucket->entries ? bucket->order + 1                       \
+                                     : _sharedHashMapOrder(size);              \
+    uint64_t entries = _sharedHashMapAlloc(header, order);                     \
+    if(!entries) {                                                             \
+        return HMPR_FAILED;                                                    \
+    }                                                                          \
+    memcpy(_sharedHashMapAt(header, entries),                                  \
+           _sharedHashMapAt(header, bucket->entries), bucket->size * size);    \
+    memcpy(_sharedHashMapAt(header, entries + bucket->size * size),            \
+           entry, size);                                                       \
+    NAME##Bucket old = *bucket;                                                \
+    _sharedHashMapBegin(header);                                               \
+    bucket->entries = entries;                                                 \
+    bucket->order = order;                                                     \
+    ++bucket->size;                                                            \
+    ++header->size;                                                            \
+    _sharedHashMapEnd(header);                                                 \
+    _sharedHashMapFree(header, old.entries, old.order);                        \
+    return HMPR_PUT;                                                           \
+}                                                                              \
+                                                                               \
+bool NAME##Remove(NAME *map,                                                   \
+                  _SharedType##NAME *entry) {                                  \
+    if(!map->writable) {                                                       \
+        return false;                                                          \
+    }                                                                          \
+    SharedHashMapHeader *header = map->header;                                 \
+    const uint64_t size = sizeof(_SharedType##NAME);                           \
+    uint64_t bucketOffset, at;                                                 \
+    if(_##NAME##Lookup(map, entry, GET_HASH(entry), &bucketOffset, &at) <= 0) {\
+        return false;                                                          \
+    }                                                                          \
+    NAME##Bucket *bucket = (NAME##Bucket *) _sharedHashMapAt(header,           \
+                                                             bucketOffset);    \
+    uint64_t end = bucket->entries + bucket->size * size;                      \
+    memcpy(entry, _sharedHashMapAt(header, at), size);                         \
+    _sharedHashMapBegin(header);                                               \
+    memmove(_sharedHashMapAt(header, at), _sharedHashMapAt(header, at + size), \
+            end - at - size);                                                  \
+    --bucket->size;                                                            \
+    --header->size;                                                            \
+    NAME##Bucket old = *bucket;                                                \
+    if(!bucket->size) {                                                        \
+        bucket->entries = 0;                                                   \
+    }                                                                          \
+    _sharedHashMapEnd(header);                                                 \
+    if(!old.size) {                                                            \
+        _sharedHashMapFree(header, old.entries, old.order);                    \
+    }                                                                          \
+    return true;                                                               \
+}
+
+
+#endif // ifndef SHAREDHASHMAP_H__
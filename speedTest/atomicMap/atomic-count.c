@@ -0,0 +1,131 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Counts random keys with 1 to MAX_THREADS threads, in an atomic map and in
+// DEFINE_HASHMAP maps behind striped locks.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 -pthread atomic-count.c -o atomic-count
+//
+// Usage: ./atomic-count [UPDATES [KEYS [MAX_THREADS]]]
+
+#include "../../atomichashmap.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define STRIPES 64
+
+struct entry {
+	uint64_t key;
+	uint64_t count;
+};
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+#define ENTRY_CMP(left, right) left->key == right->key ? 0 : 1
+#define ENTRY_HASH(entry) mix(entry->key)
+
+DEFINE_HASHMAP(hashMap, struct entry)
+DECLARE_HASHMAP(hashMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+DEFINE_ATOMIC_HASHMAP(atomicMap, uint64_t, uint64_t)
+DECLARE_ATOMIC_HASHMAP(atomicMap, 0, UINT64_MAX, free, realloc)
+
+static struct {
+	pthread_mutex_t lock;
+	hashMap         map;
+	char            padding[64];
+} stripes[STRIPES];
+
+static atomicMap counts;
+static uint64_t updates, keys;
+static unsigned threads;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Keys are in [1, keys], 0 is the empty key.
+static uint64_t key(uint64_t i) {
+	return mix(i) % keys + 1;
+}
+
+static void *countAtomic(void *arg) {
+	uint64_t thread = (uintptr_t) arg;
+	for(uint64_t i = thread; i < updates; i += threads) {
+		if(atomicMapUpdate(&counts, key(i), 1, AHMO_ADD) == HMPR_FAILED) {
+			abort();
+		}
+	}
+	return NULL;
+}
+
+static void *countStriped(void *arg) {
+	uint64_t thread = (uintptr_t) arg;
+	for(uint64_t i = thread; i < updates; i += threads) {
+		struct entry entry = { key(i), 0 }, *entryPtr = &entry;
+		unsigned stripe = mix(entry.key) >> 58;
+		pthread_mutex_lock(&stripes[stripe].lock);
+		if(hashMapPut(&stripes[stripe].map, &entryPtr, HMDR_FIND) ==
+				HMPR_FAILED) {
+			abort();
+		}
+		++entryPtr->count;
+		pthread_mutex_unlock(&stripes[stripe].lock);
+	}
+	return NULL;
+}
+
+static double measure(void *(*fn)(void *)) {
+	pthread_t ids[threads];
+	double start = now();
+	for(unsigned t = 0; t < threads; ++t) {
+		if(pthread_create(&ids[t], NULL, fn, (void *) (uintptr_t) t)) {
+			abort();
+		}
+	}
+	for(unsigned t = 0; t < threads; ++t) {
+		pthread_join(ids[t], NULL);
+	}
+	return updates / (now() - start) / 1e6;
+}
+
+int main(int argc, char **argv) {
+	updates = argc > 1 ? strtoull(argv[1], NULL, 10) : 50000000;
+	keys = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+	unsigned maxThreads = argc > 3 ? strtoul(argv[3], NULL, 10) : 64;
+
+	printf("Counting %llu updates of %llu keys, million updates per second\n\n",
+	       (unsigned long long) updates, (unsigned long long) keys);
+	printf("threads   atomic  striped\n");
+	for(threads = 1; threads <= maxThreads; threads *= 2) {
+		atomicMapNew(&counts);
+		double atomic = measure(countAtomic);
+		atomicMapDestroy(&counts);
+
+		for(unsigned s = 0; s < STRIPES; ++s) {
+			pthread_mutex_init(&stripes[s].lock, NULL);
+			hashMapNew(&stripes[s].map);
+		}
+		double striped = measure(countStriped);
+		for(unsigned s = 0; s < STRIPES; ++s) {
+			hashMapDestroy(&stripes[s].map);
+			pthread_mutex_destroy(&stripes[s].lock);
+		}
+
+		printf("%7u  %7.1f  %7.1f\n", threads, atomic, striped);
+	}
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Checks the growth of a map past 2^31 buckets, with 4-byte entries.
+//
+// Without arguments only the sizes are checked: a TABLE_ALLOC that records
+// the requested size and fails lets NAME##EnsureSize() go through the 64-bit
+// part of _HASHMAP_PRIMES without the memory. Exits with 1 if a capacity got
+// too few buckets, or if a capacity that cannot be reached was not rejected.
+//
+// With ENTRIES, a real map with that many entries is built and searched. Past
+// 2^31 buckets, i.e. with ENTRIES > 1610612735, this needs more than 64 GiB.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 big-map.c -o big-map
+//
+// Usage: ./big-map [ENTRIES]
+
+#include "../../hashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if SIZE_MAX <= 0xFFFFFFFFu
+#   error "a map past 2^31 buckets needs a 64-bit size_t"
+#endif
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+#define INT_CMP(left, right) *left==*right ? 0 : 1
+#define INT_HASH(entry) mix(*entry)
+
+static size_t requested;
+
+static void *recordingAlloc(size_t size) {
+	requested = size;
+	return NULL;
+}
+
+static void recordingFree(void *table, size_t size) {
+	(void) table;
+	(void) size;
+}
+
+DEFINE_HASHMAP(dryMap, uint32_t)
+DECLARE_HASHMAP_ALIGNED(dryMap, INT_CMP, INT_HASH, free, realloc,
+                        recordingAlloc, recordingFree)
+
+DEFINE_HASHMAP(bigMap, uint32_t)
+DECLARE_HASHMAP(bigMap, INT_CMP, INT_HASH, free, realloc)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int checkSizes(void) {
+	// capacities whose table fits into size_t, and ones that do not
+	static const size_t capacities[] = {
+		1610612735u, 1610612736u, 3000000000u, 1ull << 40, 1ull << 58,
+	};
+	static const size_t unreachable[] = { 1ull << 60, SIZE_MAX };
+	int result = 0;
+	for(size_t i = 0; i < sizeof(capacities) / sizeof(capacities[0]); ++i) {
+		dryMap map;
+		dryMapNew(&map);
+		requested = 0;
+		bool grew = dryMapEnsureSize(&map, capacities[i]);
+		size_t buckets = requested / sizeof(dryMapBucket);
+		bool ok = !grew && buckets >= capacities[i] / 3 * 4;
+		printf("capacity %20zu: %20zu buckets  %s\n", capacities[i], buckets,
+		       ok ? "ok" : "WRONG");
+		result |= !ok;
+	}
+	for(size_t i = 0; i < sizeof(unreachable) / sizeof(unreachable[0]); ++i) {
+		dryMap map;
+		dryMapNew(&map);
+		requested = 0;
+		bool ok = !dryMapEnsureSize(&map, unreachable[i]) && !requested;
+		printf("capacity %20zu: %20s          %s\n", unreachable[i], "rejected",
+		       ok ? "ok" : "WRONG");
+		result |= !ok;
+	}
+	return result;
+}
+
+static int build(size_t entries) {
+	if(entries > UINT32_MAX) {
+		fprintf(stderr, "at most %u entries\n", UINT32_MAX);
+		return 1;
+	}
+	bigMap map;
+	bigMapNew(&map);
+	double start = now();
+	if(!bigMapEnsureSize(&map, entries)) {
+		fprintf(stderr, "could not allocate %zu buckets\n", entries / 3 * 4);
+		return 1;
+	}
+	for(size_t i = 0; i < entries; ++i) {
+		uint32_t entry = (uint32_t) i, *entryPtr = &entry;
+		if(bigMapPut(&map, &entryPtr, HMDR_FAIL) != HMPR_PUT) {
+			fprintf(stderr, "memory exhausted after %zu entries\n", i);
+			return 1;
+		}
+	}
+	printf("put %zu entries into %zu buckets: %.3f s\n", map.size,
+	       _bigMapPrimes[map.nth_prime], now() - start);
+
+	start = now();
+	int result = 0;
+	for(size_t i = 0; i < 1000000; ++i) {
+		uint32_t key = (uint32_t) (mix(i) % (2 * (uint64_t) entries));
+		uint32_t *found = &key;
+		if(bigMapFind(&map, &found) != (key < entries)) {
+			printf("lookup of %u: WRONG\n", key);
+			result = 1;
+			break;
+		}
+	}
+	printf("1000000 lookups: %.3f s\n", now() - start);
+	bigMapDestroy(&map);
+	return result;
+}
+
+int main(int argc, char **argv) {
+	if(argc > 1) {
+		return build(strtoull(argv[1], NULL, 10));
+	}
+	return checkSizes();
+}
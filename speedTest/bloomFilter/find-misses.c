@@ -0,0 +1,90 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Miss-heavy NAME##Find() calls on the same map, without and with the Bloom
+// filter of NAME##FilterNew(). Most misses should be answered by the filter
+// without touching the bucket array.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 find-misses.c -o find-misses
+//
+// Usage: ./find-misses [ENTRIES [LOOKUPS [HIT_PERCENT]]]
+
+#include "../../hashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+struct entry {
+	uint64_t key;
+	uint64_t value;
+};
+
+#define ENTRY_CMP(left, right) left->key == right->key ? 0 : 1
+#define ENTRY_HASH(entry) mix(entry->key)
+
+DEFINE_HASHMAP(entryMap, struct entry)
+DECLARE_HASHMAP(entryMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void measure(const entryMap *map, const char *name, uint64_t entries,
+                    uint64_t lookups, unsigned hitPercent) {
+	uint64_t found = 0;
+	double start = now();
+	for(uint64_t i = 0; i < lookups; ++i) {
+		// keys [0, entries) are in the map, keys above are not
+		uint64_t r = mix(i);
+		struct entry key = {
+			.key = r % 100 < hitPercent ? (r >> 8) % entries
+			                            : entries + (r >> 8),
+		};
+		struct entry *keyPtr = &key;
+		found += entryMapFind(map, &keyPtr);
+	}
+	double seconds = now() - start;
+	printf("%-14s %8.3f s  %6.1f ns/find  (%llu found)\n", name, seconds,
+	       seconds * 1e9 / lookups, (unsigned long long) found);
+}
+
+int main(int argc, char **argv) {
+	uint64_t entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+	uint64_t lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 20000000;
+	unsigned hitPercent = argc > 3 ? atoi(argv[3]) : 5;
+
+	printf("%llu entries, %llu lookups (%u%% hits)\n\n",
+	       (unsigned long long) entries, (unsigned long long) lookups,
+	       hitPercent);
+
+	entryMap map;
+	entryMapNew(&map);
+	if(!entryMapEnsureSize(&map, entries)) {
+		return 1;
+	}
+	for(uint64_t i = 0; i < entries; ++i) {
+		struct entry entry = { .key = i, .value = i }, *entryPtr = &entry;
+		entryMapPut(&map, &entryPtr, HMDR_FAIL);
+	}
+
+	measure(&map, "without filter", entries, lookups, hitPercent);
+	if(!entryMapFilterNew(&map)) {
+		return 1;
+	}
+	measure(&map, "with filter", entries, lookups, hitPercent);
+
+	entryMapDestroy(&map);
+	return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Copies a map, once with NAME##Clone(), once by putting every entry into a
+// map that was grown to the right size beforehand, which hashes and compares
+// every entry again.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 clone.c -o clone
+//
+// Usage: ./clone [ENTRIES] [ROUNDS]
+
+#include "../../hashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+struct entry {
+	uint64_t key;
+	uint64_t value;
+};
+
+#define ENTRY_CMP(left, right) left->key == right->key ? 0 : 1
+#define ENTRY_HASH(entry) mix(entry->key)
+
+DEFINE_HASHMAP(cloneMap, struct entry)
+DECLARE_HASHMAP(cloneMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool copyByPut(cloneMap *dst, const cloneMap *src) {
+	cloneMapNew(dst);
+	if(!cloneMapEnsureSize(dst, src->size)) {
+		return false;
+	}
+	struct entry *entry;
+	HASHMAP_FOR_EACH(cloneMap, entry, *src) {
+		struct entry copy = *entry, *copyPtr = &copy;
+		if(cloneMapPut(dst, &copyPtr, HMDR_STACK) != HMPR_PUT) {
+			return false;
+		}
+	} HASHMAP_FOR_EACH_END
+	return true;
+}
+
+int main(int argc, char **argv) {
+	size_t entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 4000000;
+	unsigned rounds = argc > 2 ? strtoul(argv[2], NULL, 10) : 5;
+
+	cloneMap map;
+	cloneMapNew(&map);
+	for(uint64_t i = 0; i < entries; ++i) {
+		struct entry entry = { mix(i), i }, *entryPtr = &entry;
+		if(cloneMapPut(&map, &entryPtr, HMDR_FAIL) != HMPR_PUT) {
+			abort();
+		}
+	}
+
+	double cloneTime = 0, putTime = 0;
+	for(unsigned round = 0; round < rounds; ++round) {
+		cloneMap copy;
+		double start = now();
+		if(!cloneMapClone(&copy, &map)) {
+			abort();
+		}
+		cloneTime += now() - start;
+		if(copy.size != map.size) {
+			abort();
+		}
+		cloneMapDestroy(&copy);
+
+		start = now();
+		if(!copyByPut(&copy, &map)) {
+			abort();
+		}
+		putTime += now() - start;
+		cloneMapDestroy(&copy);
+	}
+	cloneMapDestroy(&map);
+
+	printf("%zu entries, %u rounds\n", entries, rounds);
+	printf("Clone: %8.3f s\n", cloneTime / rounds);
+	printf("Put:   %8.3f s\n", putTime / rounds);
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Counts ITEMS random keys out of KEYS distinct ones with NAME##CountParallel()
+// using 1 to THREADS threads, and checks every result against the counters of
+// a single-threaded NAME##Increment() loop. Exits with 1 on a mismatch.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 -pthread count-parallel.c -o count-parallel
+//
+// Usage: ./count-parallel [ITEMS [KEYS [THREADS]]]
+
+#include "../../countermap.h"
+#include "../../hashmapParallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+#define KEY_CMP(left, right) (*(left) != *(right))
+#define KEY_HASH(key) ((size_t) mix(*(key)))
+
+DEFINE_COUNTER_MAP(keyCounter, uint64_t)
+DECLARE_COUNTER_MAP(keyCounter, KEY_CMP, KEY_HASH, free, realloc)
+DEFINE_COUNTER_MAP_PARALLEL(keyCounter)
+DECLARE_COUNTER_MAP_PARALLEL(keyCounter)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t keys;
+
+static bool countItems(keyCounter *local, size_t begin, size_t end,
+                       void *ctx) {
+	(void) ctx;
+	for(size_t i = begin; i < end; ++i) {
+		uint64_t key = mix(i) % keys;
+		if(!keyCounterIncrement(local, &key, 1)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool sameCounts(const keyCounter *expected, const keyCounter *actual) {
+	if(expected->size != actual->size) {
+		return false;
+	}
+	keyCounterEntry *iter;
+	HASHMAP_FOR_EACH(keyCounter, iter, *expected) {
+		keyCounterEntry *found = iter;
+		if(!keyCounterFind(actual, &found) || found->count != iter->count) {
+			return false;
+		}
+	} HASHMAP_FOR_EACH_END
+	return true;
+}
+
+int main(int argc, char **argv) {
+	size_t items = argc > 1 ? strtoull(argv[1], NULL, 10) : 4000000;
+	keys = argc > 2 ? strtoull(argv[2], NULL, 10) : 100000;
+	unsigned threads = argc > 3 ? strtoul(argv[3], NULL, 10) : 16;
+	if(!keys) {
+		keys = 1;
+	}
+
+	keyCounter expected;
+	keyCounterNew(&expected);
+	double start = now();
+	if(!countItems(&expected, 0, items, NULL)) {
+		abort();
+	}
+	printf("serial         %8.3f s  %9zu keys\n", now() - start,
+	       expected.size);
+
+	int result = 0;
+	for(unsigned nthreads = 1; nthreads <= threads; ++nthreads) {
+		keyCounter actual;
+		keyCounterNew(&actual);
+		start = now();
+		if(!keyCounterCountParallel(&actual, nthreads, items, countItems,
+		                            NULL)) {
+			abort();
+		}
+		double time = now() - start;
+		bool same = sameCounts(&expected, &actual);
+		printf("%2u threads     %8.3f s  %9zu keys  %s\n", nthreads, time,
+		       actual.size, same ? "ok" : "MISMATCH");
+		if(!same) {
+			result = 1;
+		}
+		keyCounterDestroy(&actual);
+	}
+	keyCounterDestroy(&expected);
+	return result;
+}
@@ -0,0 +1,111 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Inserts, hits and misses on hashmap::HashMap against std::unordered_map,
+// with integer and with string keys.
+//
+// Compile:
+// c++ -Wall -Wextra -pedantic -std=c++17 -O3 unordered-map.cpp -o unordered-map
+//
+// Usage: ./unordered-map [ENTRIES [LOOKUPS]]
+
+#include "../../hashmap.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static std::uint64_t mix(std::uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static double now() {
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char *name, const char *what, double seconds,
+                   std::uint64_t count, std::uint64_t found) {
+	std::printf("%-20s %-6s %8.3f s  %6.1f ns/op  (%llu found)\n", name, what,
+	            seconds, seconds * 1e9 / count, (unsigned long long) found);
+}
+
+// Keys are odd, even keys miss.
+struct IntKeys {
+	using Key = std::uint64_t;
+	static Key key(std::uint64_t i) { return mix(i) | 1; }
+	static Key miss(std::uint64_t i) { return mix(i) & ~1ULL; }
+};
+
+struct StringKeys {
+	using Key = std::string;
+	static Key key(std::uint64_t i) {
+		return "key-" + std::to_string(mix(i) | 1);
+	}
+	static Key miss(std::uint64_t i) {
+		return "key-" + std::to_string(mix(i) & ~1ULL);
+	}
+};
+
+template <class Map, class Keys>
+static void measure(const char *name, std::uint64_t entries,
+                    std::uint64_t lookups) {
+	std::vector<typename Keys::Key> keys, hits, misses;
+	for(std::uint64_t i = 0; i < entries; ++i) {
+		keys.push_back(Keys::key(i));
+	}
+	for(std::uint64_t i = 0; i < lookups; ++i) {
+		hits.push_back(Keys::key(mix(i) % entries));
+		misses.push_back(Keys::miss(i));
+	}
+
+	Map map;
+	double start = now();
+	for(std::uint64_t i = 0; i < entries; ++i) {
+		map.try_emplace(keys[i], i);
+	}
+	report(name, "insert", now() - start, entries, map.size());
+
+	std::uint64_t found = 0;
+	start = now();
+	for(const auto &key : hits) {
+		found += map.find(key) != map.end();
+	}
+	report(name, "hit", now() - start, lookups, found);
+
+	found = 0;
+	start = now();
+	for(const auto &key : misses) {
+		found += map.find(key) != map.end();
+	}
+	report(name, "miss", now() - start, lookups, found);
+}
+
+int main(int argc, char **argv) {
+	std::uint64_t entries = argc > 1 ? std::strtoull(argv[1], NULL, 10)
+	                                 : 2000000;
+	std::uint64_t lookups = argc > 2 ? std::strtoull(argv[2], NULL, 10)
+	                                 : 5000000;
+
+	std::printf("%llu entries, %llu lookups\n\n",
+	            (unsigned long long) entries, (unsigned long long) lookups);
+
+	measure<hashmap::HashMap<std::uint64_t, std::uint64_t>, IntKeys>(
+			"HashMap<int>", entries, lookups);
+	measure<std::unordered_map<std::uint64_t, std::uint64_t>, IntKeys>(
+			"unordered_map<int>", entries, lookups);
+	std::printf("\n");
+	measure<hashmap::HashMap<std::string, std::uint64_t>, StringKeys>(
+			"HashMap<string>", entries, lookups);
+	measure<std::unordered_map<std::string, std::uint64_t>, StringKeys>(
+			"unordered_map<string>", entries, lookups);
+
+	return 0;
+}
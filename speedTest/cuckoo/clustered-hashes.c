@@ -0,0 +1,99 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Puts sequential keys into maps of DEFINE_CUCKOO_HASHMAP(...) whose hash is
+// key / DIV, so that DIV keys at a time have the same hash, for DIV = 1 to 16.
+// Clusters of more than 8 keys need the stash, and their random walks collide,
+// so some puts fail. Checks that a failed put leaves the map unchanged, that
+// the map keeps taking keys after that, and that every key that was put is
+// found.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 clustered-hashes.c -o clustered-hashes
+//
+// Usage: ./clustered-hashes [KEYS]
+
+#include "../../cuckoohashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static size_t divisor;
+
+#define KEY_CMP(left, right) ((left)->key != (right)->key)
+#define KEY_HASH(entry) ((entry)->key / divisor)
+
+struct entry {
+	size_t key;
+};
+
+DEFINE_CUCKOO_HASHMAP(clusterMap, struct entry)
+DECLARE_CUCKOO_HASHMAP(clusterMap, KEY_CMP, KEY_HASH, free, realloc)
+
+int main(int argc, char **argv) {
+	size_t keys = argc > 1 ? strtoull(argv[1], NULL, 10) : 20000;
+	bool *put = malloc(keys ? keys : 1);
+	if(!put) {
+		perror("malloc");
+		return 1;
+	}
+
+	printf("%4s %8s %8s %12s %12s %8s %6s\n", "DIV", "put", "failed",
+	       "first fail", "put after", "buckets", "load");
+	for(divisor = 1; divisor <= 16; ++divisor) {
+		clusterMap map;
+		clusterMapNew(&map);
+		size_t failed = 0, firstFail = keys, putAfter = 0;
+		for(size_t k = 0; k < keys; ++k) {
+			struct entry entry = { k }, *entryPtr = &entry;
+			size_t size = map.size;
+			put[k] = clusterMapPut(&map, &entryPtr, HMDR_FAIL) == HMPR_PUT;
+			if(!put[k]) {
+				if(map.size != size) {
+					printf("DIV %zu: a failed put of %zu changed the size\n",
+					       divisor, k);
+					return 1;
+				}
+				firstFail = failed++ ? firstFail : k;
+			} else if(entryPtr->key != k) {
+				printf("DIV %zu: put returned the wrong slot\n", divisor);
+				return 1;
+			} else if(failed) {
+				++putAfter;
+			}
+		}
+
+		size_t iterated = 0;
+		struct entry *iter;
+		CUCKOO_HASHMAP_FOR_EACH(clusterMap, iter, map) {
+			iterated += put[iter->key];
+		} CUCKOO_HASHMAP_FOR_EACH_END
+		for(size_t k = 0; k < keys; ++k) {
+			struct entry entry = { k }, *entryPtr = &entry;
+			if(clusterMapFind(&map, &entryPtr) != put[k]) {
+				printf("DIV %zu: key %zu is %sfound\n", divisor, k,
+				       put[k] ? "not " : "");
+				return 1;
+			}
+		}
+		if(iterated != map.size || map.size != keys - failed) {
+			printf("DIV %zu: size %zu, iterated %zu\n", divisor, map.size,
+			       iterated);
+			return 1;
+		}
+		if(failed && !putAfter && firstFail + 1 < keys) {
+			printf("DIV %zu: no key was put after the first failure\n",
+			       divisor);
+			return 1;
+		}
+
+		printf("%4zu %8zu %8zu %12zu %12zu %8zu %6.3f\n", divisor,
+		       map.size, failed, firstFail, putAfter, map.mask + 1,
+		       (double) map.size / ((map.mask + 1) * _CUCKOO_HASHMAP_SLOTS));
+		clusterMapDestroy(&map);
+	}
+
+	free(put);
+	return 0;
+}
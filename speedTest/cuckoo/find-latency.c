@@ -0,0 +1,139 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Measures the latency of single NAME##Find() calls of a map of
+// DEFINE_HASHMAP(...) and of a map of DEFINE_CUCKOO_HASHMAP(...), both with
+// the same entries, and prints the percentiles. Every lookup is timed on its
+// own, with rdtsc on x86, with clock_gettime() elsewhere.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 find-latency.c -o find-latency
+//
+// Usage: ./find-latency [ENTRIES [LOOKUPS]]
+
+#include "../../hashmap.h"
+#include "../../cuckoohashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#   define UNIT "cycles"
+static inline uint64_t ticks(void) {
+	_mm_lfence();
+	uint64_t t = __rdtsc();
+	_mm_lfence();
+	return t;
+}
+#else
+#   define UNIT "ns"
+static inline uint64_t ticks(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+struct entry {
+	uint32_t key;
+	uint32_t value;
+};
+
+#define ENTRY_CMP(left, right) left->key == right->key ? 0 : 1
+#define ENTRY_HASH(entry) mix(entry->key)
+
+DEFINE_HASHMAP(chainMap, struct entry)
+DECLARE_HASHMAP(chainMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+DEFINE_CUCKOO_HASHMAP(cuckooMap, struct entry)
+DECLARE_CUCKOO_HASHMAP(cuckooMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+static int compareTicks(const void *left, const void *right) {
+	uint64_t l = *(const uint64_t *) left, r = *(const uint64_t *) right;
+	return l < r ? -1 : l > r;
+}
+
+static void report(const char *name, uint64_t *samples, size_t count,
+                   size_t misses) {
+	qsort(samples, count, sizeof(uint64_t), compareTicks);
+	printf("%-7s %8llu %8llu %8llu %8llu %8llu %8zu\n", name,
+	       (unsigned long long) samples[count / 2],
+	       (unsigned long long) samples[count * 99 / 100],
+	       (unsigned long long) samples[count * 999 / 1000],
+	       (unsigned long long) samples[count * 9999 / 10000],
+	       (unsigned long long) samples[count - 1],
+	       misses);
+}
+
+int main(int argc, char **argv) {
+	size_t entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 4000000;
+	size_t lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 4000000;
+
+	chainMap chain;
+	cuckooMap cuckoo;
+	chainMapNew(&chain);
+	cuckooMapNew(&cuckoo);
+	for(uint32_t i = 0; i < entries; ++i) {
+		struct entry entry = { i, i }, *entryPtr = &entry;
+		if(chainMapPut(&chain, &entryPtr, HMDR_FAIL) != HMPR_PUT) {
+			abort();
+		}
+		entryPtr = &entry;
+		if(cuckooMapPut(&cuckoo, &entryPtr, HMDR_FAIL) != HMPR_PUT) {
+			abort();
+		}
+	}
+
+	uint32_t *keys = malloc(lookups * sizeof(uint32_t));
+	uint64_t *chainTicks = malloc(lookups * sizeof(uint64_t));
+	uint64_t *cuckooTicks = malloc(lookups * sizeof(uint64_t));
+	if(!keys || !chainTicks || !cuckooTicks) {
+		abort();
+	}
+	for(size_t i = 0; i < lookups; ++i) {
+		// every 8th lookup misses
+		keys[i] = (uint32_t) (mix(i) % (entries + entries / 7));
+	}
+
+	size_t chainMisses = 0, cuckooMisses = 0;
+	for(size_t i = 0; i < lookups; ++i) {
+		struct entry key = { keys[i], 0 }, *entryPtr = &key;
+		uint64_t start = ticks();
+		bool found = chainMapFind(&chain, &entryPtr);
+		chainTicks[i] = ticks() - start;
+		chainMisses += !found;
+	}
+	for(size_t i = 0; i < lookups; ++i) {
+		struct entry key = { keys[i], 0 }, *entryPtr = &key;
+		uint64_t start = ticks();
+		bool found = cuckooMapFind(&cuckoo, &entryPtr);
+		cuckooTicks[i] = ticks() - start;
+		cuckooMisses += !found;
+	}
+
+	printf("%zu entries, %zu lookups, in %s; cuckoo load %.2f, stash %zu\n",
+	       entries, lookups, UNIT,
+	       (double) cuckoo.size / ((cuckoo.mask + 1) * _CUCKOO_HASHMAP_SLOTS),
+	       cuckoo.stashSize);
+	printf("%-7s %8s %8s %8s %8s %8s %8s\n",
+	       "", "p50", "p99", "p99.9", "p99.99", "max", "misses");
+	report("hashmap", chainTicks, lookups, chainMisses);
+	report("cuckoo", cuckooTicks, lookups, cuckooMisses);
+
+	free(keys);
+	free(chainTicks);
+	free(cuckooTicks);
+	chainMapDestroy(&chain);
+	cuckooMapDestroy(&cuckoo);
+	return 0;
+}
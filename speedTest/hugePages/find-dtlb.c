@@ -0,0 +1,113 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Compares random NAME##Find() calls on a map whose top-level bucket array is
+// allocated with realloc() against one that is backed by transparent huge
+// pages, counting dTLB read misses with perf_event_open(2) (Linux only).
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 find-dtlb.c -o find-dtlb
+//
+// Usage: ./find-dtlb [ENTRIES [LOOKUPS]]
+
+#define HASHMAP_HUGE_PAGES
+#include "../../hashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+#define INT_CMP(left, right) *left==*right ? 0 : 1
+#define INT_HASH(entry) mix(*entry)
+
+DEFINE_HASHMAP(plainMap, uint64_t)
+DECLARE_HASHMAP(plainMap, INT_CMP, INT_HASH, free, realloc)
+
+DEFINE_HASHMAP(hugeMap, uint64_t)
+DECLARE_HASHMAP_ALIGNED(hugeMap, INT_CMP, INT_HASH, free, realloc,
+                        hashmapHugeTableAlloc, hashmapHugeTableFree)
+
+static int openDtlbCounter(void) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB |
+	              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define MEASURE(NAME, ENTRIES, LOOKUPS)                                        \
+	do {                                                                       \
+		NAME map;                                                              \
+		NAME##New(&map);                                                       \
+		if(!NAME##EnsureSize(&map, ENTRIES)) {                                 \
+			return 1;                                                          \
+		}                                                                      \
+		for(uint64_t i = 0; i < ENTRIES; ++i) {                                \
+			uint64_t key = i, *keyPtr = &key;                                  \
+			NAME##Put(&map, &keyPtr, HMDR_FAIL);                               \
+		}                                                                      \
+		int counter = openDtlbCounter();                                       \
+		uint64_t found = 0, misses = 0;                                        \
+		double start = now();                                                  \
+		if(counter >= 0) {                                                     \
+			ioctl(counter, PERF_EVENT_IOC_RESET, 0);                           \
+			ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);                          \
+		}                                                                      \
+		for(uint64_t i = 0; i < LOOKUPS; ++i) {                                \
+			uint64_t key = mix(i) % (2*ENTRIES), *keyPtr = &key;               \
+			found += NAME##Find(&map, &keyPtr);                                \
+		}                                                                      \
+		if(counter >= 0) {                                                     \
+			ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);                         \
+			if(read(counter, &misses, sizeof(misses)) != sizeof(misses)) {     \
+				misses = 0;                                                    \
+			}                                                                  \
+			close(counter);                                                    \
+		}                                                                      \
+		double seconds = now() - start;                                        \
+		printf("%-9s %8.3f s  %6.1f ns/find  ", #NAME, seconds,               \
+		       seconds * 1e9 / LOOKUPS);                                       \
+		if(counter >= 0) {                                                     \
+			printf("%6.3f dTLB misses/find", (double) misses / LOOKUPS);       \
+		} else {                                                               \
+			printf("dTLB misses n/a");                                         \
+		}                                                                      \
+		printf("  (%llu found)\n", (unsigned long long) found);                \
+		NAME##Destroy(&map);                                                   \
+	} while(0)
+
+int main(int argc, char **argv) {
+	uint64_t entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 50000000;
+	uint64_t lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 20000000;
+
+	printf("%llu entries, %llu lookups (50%% hits)\n\n",
+	       (unsigned long long) entries, (unsigned long long) lookups);
+	MEASURE(plainMap, entries, lookups);
+	MEASURE(hugeMap, entries, lookups);
+
+	return 0;
+}
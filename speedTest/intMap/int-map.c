@@ -0,0 +1,117 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Inserts, hits and misses on a map from int32_t to int32_t: the generic
+// DEFINE_HASHMAP map, set up like examples/intHashMap.c, against
+// DEFINE_INT_HASHMAP.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 -march=native int-map.c -o int-map
+//
+// Usage: ./int-map [ENTRIES [LOOKUPS]]
+
+#include "../../hashmap.h"
+#include "../../inthashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// Keys are odd, so even keys miss and 0 is free for the empty key.
+static int32_t key(uint64_t i) {
+	return (int32_t) (mix(i) | 1);
+}
+
+struct entry {
+	int32_t key;
+	int32_t value;
+};
+
+#define ENTRY_CMP(left, right) left->key==right->key ? 0 : 1
+#define ENTRY_HASH(entry) (uint32_t) entry->key
+
+DEFINE_HASHMAP(genericMap, struct entry)
+DECLARE_HASHMAP(genericMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+DEFINE_INT_HASHMAP(flatMap, int32_t, int32_t)
+DECLARE_INT_HASHMAP(flatMap, 0, free, realloc)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, const char *what, double seconds,
+                   uint64_t count, uint64_t found) {
+	printf("%-10s %-6s %8.3f s  %6.1f ns/op  (%llu found)\n", name, what,
+	       seconds, seconds * 1e9 / count, (unsigned long long) found);
+}
+
+int main(int argc, char **argv) {
+	uint64_t entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+	uint64_t lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 20000000;
+
+	printf("%llu entries, %llu lookups\n\n", (unsigned long long) entries,
+	       (unsigned long long) lookups);
+
+	double start;
+	uint64_t found;
+
+	genericMap generic;
+	genericMapNew(&generic);
+	start = now();
+	for(uint64_t i = 0; i < entries; ++i) {
+		struct entry entry = { key(i), (int32_t) i }, *entryPtr = &entry;
+		genericMapPut(&generic, &entryPtr, HMDR_REPLACE);
+	}
+	report("generic", "insert", now() - start, entries, generic.size);
+	found = 0;
+	start = now();
+	for(uint64_t i = 0; i < lookups; ++i) {
+		struct entry entry = { .key = key(i % entries) }, *entryPtr = &entry;
+		found += genericMapFind(&generic, &entryPtr);
+	}
+	report("generic", "hit", now() - start, lookups, found);
+	found = 0;
+	start = now();
+	for(uint64_t i = 0; i < lookups; ++i) {
+		struct entry entry = { .key = key(i) - 1 }, *entryPtr = &entry;
+		found += genericMapFind(&generic, &entryPtr);
+	}
+	report("generic", "miss", now() - start, lookups, found);
+	genericMapDestroy(&generic);
+	printf("\n");
+
+	flatMap flat;
+	flatMapNew(&flat);
+	start = now();
+	for(uint64_t i = 0; i < entries; ++i) {
+		int32_t value = (int32_t) i, *valuePtr = &value;
+		flatMapPut(&flat, key(i), &valuePtr, HMDR_REPLACE);
+	}
+	report("flat", "insert", now() - start, entries, flat.size);
+	found = 0;
+	start = now();
+	for(uint64_t i = 0; i < lookups; ++i) {
+		found += flatMapFind(&flat, key(i % entries), NULL);
+	}
+	report("flat", "hit", now() - start, lookups, found);
+	found = 0;
+	start = now();
+	for(uint64_t i = 0; i < lookups; ++i) {
+		found += flatMapFind(&flat, key(i) - 1, NULL);
+	}
+	report("flat", "miss", now() - start, lookups, found);
+	flatMapDestroy(&flat);
+
+	return 0;
+}
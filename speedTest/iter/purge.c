@@ -0,0 +1,88 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Removes every second entry of a map, once with NAME##IterErase(), once with
+// NAME##Remove() in a HASHMAP_FOR_EACH_SAFE_TO_DELETE(...) loop, which hashes
+// every removed entry again.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 purge.c -o purge
+//
+// Usage: ./purge [ENTRIES]
+
+#include "../../hashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+struct entry {
+	uint64_t key;
+	uint64_t value;
+};
+
+#define ENTRY_CMP(left, right) left->key == right->key ? 0 : 1
+#define ENTRY_HASH(entry) mix(entry->key)
+
+DEFINE_HASHMAP(purgeMap, struct entry)
+DECLARE_HASHMAP(purgeMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void fill(purgeMap *map, size_t entries) {
+	purgeMapNew(map);
+	for(uint64_t i = 0; i < entries; ++i) {
+		struct entry entry = { i, i }, *entryPtr = &entry;
+		if(purgeMapPut(map, &entryPtr, HMDR_FAIL) != HMPR_PUT) {
+			abort();
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	size_t entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 4000000;
+
+	purgeMap map;
+	fill(&map, entries);
+	double start = now();
+	purgeMapIter iter;
+	for(struct entry *entry = purgeMapIterBegin(&map, &iter); entry;
+	                  entry = purgeMapIterNext(&iter)) {
+		if(entry->value % 2) {
+			purgeMapIterErase(&iter, NULL);
+		}
+	}
+	double iterTime = now() - start;
+	size_t iterSize = map.size;
+	purgeMapDestroy(&map);
+
+	fill(&map, entries);
+	start = now();
+	struct entry *entry;
+	HASHMAP_FOR_EACH_SAFE_TO_DELETE(purgeMap, entry, map) {
+		if(entry->value % 2) {
+			struct entry removed = *entry;
+			purgeMapRemove(&map, &removed);
+		}
+	} HASHMAP_FOR_EACH_SAFE_TO_DELETE_END
+	double removeTime = now() - start;
+	size_t removeSize = map.size;
+	purgeMapDestroy(&map);
+
+	printf("%zu entries, %zu and %zu left\n", entries, iterSize, removeSize);
+	printf("IterErase: %8.3f s\n", iterTime);
+	printf("Remove:    %8.3f s\n", removeTime);
+	return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Scans a map with NAME##Scan() while putting new entries between the calls,
+// so that the map grows during the scan, and removes every third entry it
+// visits. Checks that the scan ends after at most as many calls as the map had
+// buckets when it started, that every entry that was in the map before is
+// visited, and that the removed ones are gone.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 scan-puts.c -o scan-puts
+//
+// Usage: ./scan-puts [ENTRIES [BUDGET]]
+
+#include "../../hashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+struct entry {
+	uint64_t key;
+	uint64_t value;
+};
+
+#define ENTRY_CMP(left, right) left->key == right->key ? 0 : 1
+#define ENTRY_HASH(entry) mix(entry->key)
+
+DEFINE_HASHMAP(scanMap, struct entry)
+DECLARE_HASHMAP(scanMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+struct scan {
+	scanMap       *map;
+	unsigned char *visited;
+	size_t         entries;
+};
+
+static void visit(struct entry *entry, void *ctx) {
+	struct scan *scan = ctx;
+	if(entry->key >= scan->entries) {
+		return;
+	}
+	scan->visited[entry->key] = 1;
+	if(entry->key % 3 == 0) {
+		struct entry removed = *entry;
+		scanMapRemove(scan->map, &removed);
+	}
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+	size_t entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 100000;
+	size_t budget = argc > 2 ? strtoull(argv[2], NULL, 10) : 200;
+	static const size_t rates[] = { 0, 30, 50, 100, 150, 250, 1000 };
+	unsigned char *visited = malloc(entries ? entries : 1);
+	if(!visited) {
+		perror("malloc");
+		return 1;
+	}
+
+	printf("%8s %8s %10s %10s %10s\n", "puts", "calls", "buckets",
+	       "entries", "seconds");
+	for(size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); ++r) {
+		scanMap map;
+		scanMapNew(&map);
+		for(uint64_t i = 0; i < entries; ++i) {
+			struct entry entry = { i, i }, *entryPtr = &entry;
+			if(scanMapPut(&map, &entryPtr, HMDR_FAIL) != HMPR_PUT) {
+				abort();
+			}
+		}
+		memset(visited, 0, entries ? entries : 1);
+		struct scan scan = { &map, visited, entries };
+		size_t buckets = _scanMapPrimes[map.nth_prime], calls = 0;
+		uint64_t next = entries;
+		scanMapScanCursor cursor = { 0 };
+		double start = now();
+		while(scanMapScan(&map, &cursor, budget, visit, &scan)) {
+			if(++calls > buckets) {
+				printf("%zu puts per call: no end after %zu calls\n",
+				       rates[r], calls);
+				return 1;
+			}
+			for(size_t i = 0; i < rates[r]; ++i, ++next) {
+				struct entry entry = { next, next }, *entryPtr = &entry;
+				if(scanMapPut(&map, &entryPtr, HMDR_FAIL) != HMPR_PUT) {
+					abort();
+				}
+			}
+		}
+		double seconds = now() - start;
+
+		for(uint64_t i = 0; i < entries; ++i) {
+			struct entry entry = { i, 0 }, *entryPtr = &entry;
+			if(!visited[i] || scanMapFind(&map, &entryPtr) != (i % 3 != 0)) {
+				printf("%zu puts per call: entry %llu is wrong\n", rates[r],
+				       (unsigned long long) i);
+				return 1;
+			}
+		}
+		printf("%8zu %8zu %10zu %10zu %10.3f\n", rates[r], calls + 1,
+		       (size_t) _scanMapPrimes[map.nth_prime], map.size, seconds);
+		scanMapDestroy(&map);
+	}
+
+	free(visited);
+	return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Measures memory and throughput of maps declared with DECLARE_HASHMAP_EX(...)
+// and different growth policies, counting the words of a file and putting
+// random integers.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 policy-matrix.c -o policy-matrix
+//
+// Usage: ./policy-matrix [ENTRIES [FILE]]
+// e.g. ./policy-matrix 4000000 ../wordCount/Clarissa.txt
+
+#include "../../hashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Allocator that counts the bytes in use, and the peak of them.
+static size_t allocated, peak;
+
+static void *countingRealloc(void *ptr, size_t size) {
+	size_t *header = ptr ? (size_t *) ptr - 2 : NULL;
+	size_t oldSize = header ? header[0] : 0;
+	if(!size) {
+		free(header);
+		allocated -= oldSize;
+		return NULL;
+	}
+	header = realloc(header, size + 2*sizeof(size_t));
+	if(!header) {
+		return NULL;
+	}
+	header[0] = size;
+	allocated += size - oldSize;
+	if(allocated > peak) {
+		peak = allocated;
+	}
+	return header + 2;
+}
+
+static void countingFree(void *ptr) {
+	if(ptr) {
+		countingRealloc(ptr, 0);
+	}
+}
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// http://www.cse.yorku.ca/~oz/hash.html
+static uint64_t djb2(const char *str) {
+	unsigned long hash = 5381;
+	char c;
+	while( (c = *str++) ) {
+		hash = ((hash << 5) + hash) + c;
+	}
+	return hash;
+}
+
+struct intEntry {
+	uint64_t key;
+	uint64_t value;
+};
+
+struct wordEntry {
+	uint64_t    hash;
+	const char *word;
+	uint64_t    counter;
+};
+
+#define INT_CMP(left, right) left->key == right->key ? 0 : 1
+#define INT_HASH(entry) mix(entry->key)
+#define WORD_CMP(left, right)                                                  \
+	left->hash == right->hash ? strcmp(left->word, right->word) : 1
+#define WORD_HASH(entry) entry->hash
+
+static const size_t linearBuckets[] = {
+	1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 16, 20, 24, 28, 32, 40, 48, 56, 64,
+	96, 128, 192, 256, 384, 512, 768, 1024, 0
+};
+
+static const HashMapPolicy defaultPolicy = { 75, 100, NULL };
+static const HashMapPolicy sparsePolicy = { 50, 100, NULL };
+static const HashMapPolicy densePolicy = { 200, 100, NULL };
+static const HashMapPolicy denseLinearPolicy = { 200, 100, linearBuckets };
+static const HashMapPolicy fastGrowthPolicy = { 75, 400, NULL };
+
+#define POLICY_MAPS(NAME, POLICY)                                              \
+	DEFINE_HASHMAP(NAME##Int, struct intEntry)                                 \
+	DECLARE_HASHMAP_EX(NAME##Int, INT_CMP, INT_HASH,                           \
+	                   countingFree, countingRealloc, POLICY)                  \
+	DEFINE_HASHMAP(NAME##Word, struct wordEntry)                               \
+	DECLARE_HASHMAP_EX(NAME##Word, WORD_CMP, WORD_HASH,                        \
+	                   countingFree, countingRealloc, POLICY)
+
+POLICY_MAPS(defaultMap, defaultPolicy)
+POLICY_MAPS(sparseMap, sparsePolicy)
+POLICY_MAPS(denseMap, densePolicy)
+POLICY_MAPS(denseLinearMap, denseLinearPolicy)
+POLICY_MAPS(fastGrowthMap, fastGrowthPolicy)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t entries;
+static char **words;
+static size_t wordCount;
+
+static void report(const char *policy, const char *workload, size_t size,
+                   size_t operations, double putTime, double findTime) {
+	printf("%-13s %-5s %9zu  %8.1f  %8.1f  %8.1f\n", policy, workload, size,
+	       (double) peak / size, operations / putTime / 1e6,
+	       operations / findTime / 1e6);
+}
+
+#define MEASURE(NAME, POLICY_NAME)                                             \
+	do {                                                                       \
+		NAME##Int intMap;                                                      \
+		NAME##IntNew(&intMap);                                                 \
+		allocated = peak = 0;                                                  \
+		double start = now();                                                  \
+		for(uint64_t i = 0; i < entries; ++i) {                                \
+			struct intEntry entry = { mix(i), i }, *entryPtr = &entry;         \
+			if(NAME##IntPut(&intMap, &entryPtr, HMDR_FAIL) != HMPR_PUT) {      \
+				abort();                                                       \
+			}                                                                  \
+		}                                                                      \
+		double putTime = now() - start;                                        \
+		start = now();                                                         \
+		for(uint64_t i = 0; i < entries; ++i) {                                \
+			struct intEntry entry = { mix(i), 0 }, *entryPtr = &entry;         \
+			if(!NAME##IntFind(&intMap, &entryPtr)) {                           \
+				abort();                                                       \
+			}                                                                  \
+		}                                                                      \
+		report(POLICY_NAME, "int", intMap.size, entries, putTime,              \
+		       now() - start);                                                 \
+		NAME##IntDestroy(&intMap);                                             \
+                                                                               \
+		if(!wordCount) {                                                       \
+			break;                                                             \
+		}                                                                      \
+		NAME##Word wordMap;                                                    \
+		NAME##WordNew(&wordMap);                                               \
+		allocated = peak = 0;                                                  \
+		start = now();                                                         \
+		for(size_t i = 0; i < wordCount; ++i) {                                \
+			struct wordEntry entry = { djb2(words[i]), words[i], 0 };          \
+			struct wordEntry *entryPtr = &entry;                               \
+			if(NAME##WordPut(&wordMap, &entryPtr, HMDR_FIND) == HMPR_FAILED) { \
+				abort();                                                       \
+			}                                                                  \
+			++entryPtr->counter;                                               \
+		}                                                                      \
+		putTime = now() - start;                                               \
+		start = now();                                                         \
+		for(size_t i = 0; i < wordCount; ++i) {                                \
+			struct wordEntry entry = { djb2(words[i]), words[i], 0 };          \
+			struct wordEntry *entryPtr = &entry;                               \
+			if(!NAME##WordFind(&wordMap, &entryPtr)) {                         \
+				abort();                                                       \
+			}                                                                  \
+		}                                                                      \
+		report(POLICY_NAME, "words", wordMap.size, wordCount, putTime,         \
+		       now() - start);                                                 \
+		NAME##WordDestroy(&wordMap);                                           \
+	} while(0)
+
+static void readWords(const char *path) {
+	FILE *input = fopen(path, "r");
+	if(!input) {
+		perror(path);
+		exit(1);
+	}
+	size_t capacity = 0;
+	char word[129];
+	while(fscanf(input, "%128s", word) == 1) {
+		if(wordCount == capacity) {
+			capacity = capacity ? 2*capacity : 1024;
+			words = realloc(words, capacity * sizeof(char *));
+		}
+		words[wordCount++] = strdup(word);
+	}
+	fclose(input);
+}
+
+int main(int argc, char **argv) {
+	entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 4000000;
+	if(argc > 2) {
+		readWords(argv[2]);
+	}
+
+	printf("policy        load  growth  bucket sizes\n");
+	printf("default         75     100  primes\n");
+	printf("sparse          50     100  primes\n");
+	printf("dense          200     100  primes\n");
+	printf("dense-linear   200     100  1, 2, 3, 4, ...\n");
+	printf("fast-growth     75     400  primes\n\n");
+
+	printf("policy        work       size  B/entry  M puts/s  M finds/s\n");
+	MEASURE(defaultMap, "default");
+	MEASURE(sparseMap, "sparse");
+	MEASURE(denseMap, "dense");
+	MEASURE(denseLinearMap, "dense-linear");
+	MEASURE(fastGrowthMap, "fast-growth");
+
+	for(size_t i = 0; i < wordCount; ++i) {
+		free(words[i]);
+	}
+	free(words);
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Measures how long NAME##EnsureSizeParallel() takes to double the capacity of
+// a map, depending on the number of threads.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 -pthread rehash-threads.c -o rehash-threads
+//
+// Usage: ./rehash-threads [ENTRIES [MAX_THREADS]]
+
+#include "../../hashmapParallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct entry {
+	uint64_t key;
+	uint64_t value;
+};
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+#define ENTRY_CMP(left, right) left->key == right->key ? 0 : 1
+#define ENTRY_HASH(entry) mix(entry->key)
+
+DEFINE_HASHMAP(hashMap, struct entry)
+DEFINE_HASHMAP_PARALLEL(hashMap)
+DECLARE_HASHMAP(hashMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+DECLARE_HASHMAP_PARALLEL(hashMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+	size_t entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+	unsigned maxThreads = argc > 2 ? strtoul(argv[2], NULL, 10) : 16;
+
+	printf("Rehashing %zu entries\n\n", entries);
+	printf("threads  seconds\n");
+	for(unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+		hashMap map;
+		hashMapNew(&map);
+		if(!hashMapEnsureSize(&map, entries)) {
+			return 1;
+		}
+		for(uint64_t i = 0; i < entries; ++i) {
+			struct entry entry = { i, i }, *entryPtr = &entry;
+			if(hashMapPut(&map, &entryPtr, HMDR_FAIL) != HMPR_PUT) {
+				return 1;
+			}
+		}
+
+		double start = now();
+		if(!hashMapEnsureSizeParallel(&map, 2*entries, threads)) {
+			return 1;
+		}
+		printf("%7u  %7.3f\n", threads, now() - start);
+
+		hashMapDestroy(&map);
+	}
+
+	return 0;
+}
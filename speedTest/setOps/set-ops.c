@@ -0,0 +1,165 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Compares NAME##Union(), NAME##Intersect() and NAME##Difference(), and their
+// multi-threaded variants, against a HASHMAP_FOR_EACH(...) loop calling
+// NAME##Find() and NAME##Put() for every entry. The maps hold ENTRIES random
+// integers each, half of them in both maps.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 -pthread set-ops.c -o set-ops
+//
+// Usage: ./set-ops [ENTRIES [THREADS]]
+
+#include "../../hashmapParallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+struct entry {
+	uint64_t key;
+	uint64_t value;
+};
+
+#define ENTRY_CMP(left, right) left->key == right->key ? 0 : 1
+#define ENTRY_HASH(entry) mix(entry->key)
+
+DEFINE_HASHMAP(setMap, struct entry)
+DECLARE_HASHMAP(setMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+DEFINE_HASHMAP_PARALLEL(setMap)
+DECLARE_HASHMAP_PARALLEL(setMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void fill(setMap *map, uint64_t first, size_t entries) {
+	setMapNew(map);
+	for(uint64_t i = first; i < first + entries; ++i) {
+		struct entry entry = { mix(i), i }, *entryPtr = &entry;
+		if(setMapPut(map, &entryPtr, HMDR_FAIL) != HMPR_PUT) {
+			abort();
+		}
+	}
+}
+
+// the result of an operation into a new map, or into a copy of left
+typedef bool (*setOp)(setMap *out, const setMap *left, const setMap *right);
+typedef bool (*parallelSetOp)(setMap *out, const setMap *left,
+                              const setMap *right, unsigned nthreads);
+
+static setMap left, right;
+static size_t entries;
+static unsigned nthreads;
+
+static void report(const char *name, bool inPlace, double time, size_t size) {
+	printf("%-14s %-8s %8.3f s  %9zu entries\n",
+	       name, inPlace ? "in place" : "new map", time, size);
+}
+
+static void measure(const char *name, setOp op, parallelSetOp parallel,
+                    bool inPlace) {
+	setMap out;
+	if(inPlace) {
+		fill(&out, 0, entries);
+	} else {
+		setMapNew(&out);
+	}
+	double start = now();
+	bool ok = parallel ? parallel(&out, inPlace ? &out : &left, &right, nthreads)
+	                   : op(&out, inPlace ? &out : &left, &right);
+	double time = now() - start;
+	if(!ok) {
+		abort();
+	}
+	report(name, inPlace, time, out.size);
+	setMapDestroy(&out);
+}
+
+static bool naiveIntersect(setMap *out, const setMap *left,
+                           const setMap *right) {
+	struct entry *iter;
+	HASHMAP_FOR_EACH(setMap, iter, *left) {
+		struct entry *found = iter;
+		if(setMapFind(right, &found)) {
+			struct entry *entryPtr = iter;
+			if(setMapPut(out, &entryPtr, HMDR_FAIL) == HMPR_FAILED) {
+				return false;
+			}
+		}
+	} HASHMAP_FOR_EACH_END
+	return true;
+}
+
+static bool naiveUnion(setMap *out, const setMap *left, const setMap *right) {
+	struct entry *iter;
+	HASHMAP_FOR_EACH(setMap, iter, *left) {
+		struct entry *entryPtr = iter;
+		if(setMapPut(out, &entryPtr, HMDR_FAIL) == HMPR_FAILED) {
+			return false;
+		}
+	} HASHMAP_FOR_EACH_END
+	HASHMAP_FOR_EACH(setMap, iter, *right) {
+		struct entry *entryPtr = iter;
+		if(setMapPut(out, &entryPtr, HMDR_FIND) == HMPR_FAILED) {
+			return false;
+		}
+	} HASHMAP_FOR_EACH_END
+	return true;
+}
+
+static bool naiveDifference(setMap *out, const setMap *left,
+                            const setMap *right) {
+	struct entry *iter;
+	HASHMAP_FOR_EACH(setMap, iter, *left) {
+		struct entry *found = iter;
+		if(!setMapFind(right, &found)) {
+			struct entry *entryPtr = iter;
+			if(setMapPut(out, &entryPtr, HMDR_FAIL) == HMPR_FAILED) {
+				return false;
+			}
+		}
+	} HASHMAP_FOR_EACH_END
+	return true;
+}
+
+int main(int argc, char **argv) {
+	entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 4000000;
+	nthreads = argc > 2 ? strtoul(argv[2], NULL, 10) : 4;
+
+	fill(&left, 0, entries);
+	fill(&right, entries / 2, entries);
+
+	measure("naive union", naiveUnion, NULL, false);
+	measure("Union", setMapUnion, NULL, false);
+	measure("Union", setMapUnion, NULL, true);
+	measure("UnionParallel", NULL, setMapUnionParallel, false);
+	measure("UnionParallel", NULL, setMapUnionParallel, true);
+
+	measure("naive isect", naiveIntersect, NULL, false);
+	measure("Intersect", setMapIntersect, NULL, false);
+	measure("Intersect", setMapIntersect, NULL, true);
+	measure("IntersectPar.", NULL, setMapIntersectParallel, false);
+	measure("IntersectPar.", NULL, setMapIntersectParallel, true);
+
+	measure("naive diff", naiveDifference, NULL, false);
+	measure("Difference", setMapDifference, NULL, false);
+	measure("Difference", setMapDifference, NULL, true);
+	measure("DifferencePar.", NULL, setMapDifferenceParallel, false);
+	measure("DifferencePar.", NULL, setMapDifferenceParallel, true);
+
+	setMapDestroy(&left);
+	setMapDestroy(&right);
+	return 0;
+}
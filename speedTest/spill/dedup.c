@@ -0,0 +1,95 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Deduplicates random keys in a spilling map whose budget is a fraction of
+// the memory the keys need, once with NAME##Put() for every key, once with
+// NAME##PutBatch() for batches of keys, which reads every segment once per
+// batch instead of once per key that misses the resident segments.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 dedup.c -o dedup
+//
+// Usage: ./dedup [KEYS [BUDGET_MIB [SEGMENTS [BATCH]]]]
+
+#include "../../spillhashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+struct entry {
+	uint64_t key;
+	uint64_t value;
+};
+
+#define ENTRY_CMP(left, right) left->key == right->key ? 0 : 1
+#define ENTRY_HASH(entry) entry->key
+
+DEFINE_SPILL_HASHMAP(dedupMap, struct entry)
+DECLARE_SPILL_HASHMAP(dedupMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// every key occurs about twice
+static uint64_t keyOf(size_t i, size_t keys) {
+	return mix(mix(i) % (keys / 2 + 1));
+}
+
+static void report(const char *name, const dedupMap *map, double time) {
+	printf("%-9s %8.3f s, %zu unique, file %.1f MiB (%.1f MiB free)\n",
+	       name, time, map->size, map->end / 1048576.0,
+	       map->garbage / 1048576.0);
+}
+
+int main(int argc, char **argv) {
+	size_t keys = argc > 1 ? strtoull(argv[1], NULL, 10) : 2000000;
+	size_t budget = (argc > 2 ? strtoull(argv[2], NULL, 10) : 8) << 20;
+	size_t segments = argc > 3 ? strtoull(argv[3], NULL, 10) : 16384;
+	size_t batch = argc > 4 ? strtoull(argv[4], NULL, 10) : 1 << 20;
+
+	dedupMap map;
+	if(!dedupMapNew(&map, NULL, segments, budget)) {
+		abort();
+	}
+	double start = now();
+	for(size_t i = 0; i < keys; ++i) {
+		struct entry entry = { keyOf(i, keys), i }, *entryPtr = &entry;
+		if(dedupMapPut(&map, &entryPtr, HMDR_FIND) == HMPR_FAILED) {
+			abort();
+		}
+	}
+	report("Put", &map, now() - start);
+	dedupMapDestroy(&map);
+
+	struct entry *entries = malloc(batch * sizeof(struct entry));
+	if(!entries || !dedupMapNew(&map, NULL, segments, budget)) {
+		abort();
+	}
+	start = now();
+	for(size_t i = 0; i < keys; i += batch) {
+		size_t count = keys - i < batch ? keys - i : batch;
+		for(size_t j = 0; j < count; ++j) {
+			entries[j].key = keyOf(i + j, keys);
+			entries[j].value = i + j;
+		}
+		if(!dedupMapPutBatch(&map, entries, count, HMDR_FIND, NULL)) {
+			abort();
+		}
+	}
+	report("PutBatch", &map, now() - start);
+	dedupMapDestroy(&map);
+	free(entries);
+	return 0;
+}
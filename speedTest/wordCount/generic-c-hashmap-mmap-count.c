@@ -0,0 +1,169 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Same workload as generic-c-hashmap-count.c, but without stdio:
+// The input is mmap'd, split into words by a SSE2 whitespace scanner, and the
+// words are put into the map as (pointer, length) spans into the mapping.
+// Words are put in batches, the buckets of a batch are prefetched up front.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O3 generic-c-hashmap-mmap-count.c -o generic-c-hashmap-mmap-count
+
+#include "../../hashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+// fscanf("%128s") splits longer words, so do we.
+#define MAX_WORD_LENGTH 128
+#define BATCH_SIZE      16
+
+// http://www.cse.yorku.ca/~oz/hash.html
+static uint64_t djb2(const char *str, size_t length) {
+	unsigned long hash = 5381;
+	for(const char *end = str + length; str < end; ++str) {
+		hash = ((hash << 5) + hash) + *str;
+	}
+	return hash;
+}
+
+struct entry {
+	uint64_t hash;
+	const char *word;
+	uint32_t length;
+	int counter;
+};
+
+#define ENTRY_CMP(left, right) left->hash == right->hash &&                    \
+                               left->length == right->length ?                 \
+                               memcmp(left->word, right->word, left->length) : 1
+#define ENTRY_HASH(entry) entry->hash
+
+DEFINE_HASHMAP(hashMap, struct entry)
+DECLARE_HASHMAP(hashMap, ENTRY_CMP, ENTRY_HASH, free, realloc)
+
+// Same characters as isspace() in the "C" locale.
+static inline bool isSpace(char c) {
+	return c == ' ' || (unsigned char) (c - '\t') <= '\r' - '\t';
+}
+
+#ifdef __SSE2__
+// Bit n is set if chunk[n] is a whitespace.
+static inline unsigned spaceMask(const char *chunk) {
+	const __m128i c = _mm_loadu_si128((const __m128i*) chunk);
+	const __m128i shifted = _mm_sub_epi8(c, _mm_set1_epi8('\t'));
+	const __m128i control = _mm_cmpeq_epi8(
+			_mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')), shifted);
+	const __m128i space = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+	return (unsigned) _mm_movemask_epi8(_mm_or_si128(control, space));
+}
+#endif
+
+// Returns the first position in [pos, end) where isSpace(*pos) == wantSpace,
+// or end.
+static inline const char *skip(const char *pos, const char *end,
+                               bool wantSpace) {
+#ifdef __SSE2__
+	for(; pos + 16 <= end; pos += 16) {
+		unsigned mask = spaceMask(pos);
+		if(!wantSpace) {
+			mask = ~mask & 0xFFFF;
+		}
+		if(mask) {
+			return pos + __builtin_ctz(mask);
+		}
+	}
+#endif
+	while(pos < end && isSpace(*pos) != wantSpace) {
+		++pos;
+	}
+	return pos;
+}
+
+static bool putBatch(hashMap *map, struct entry *batch, size_t count) {
+	if(!hashMapEnsureSize(map, map->size + count)) {
+		return false;
+	}
+	for(size_t i = 0; i < count; ++i) {
+		__builtin_prefetch(&map->entries[batch[i].hash %
+		                                 _hashMapPrimes[map->nth_prime]]);
+	}
+	for(size_t i = 0; i < count; ++i) {
+		struct entry *entryFound = &batch[i];
+		HashMapPutResult result = hashMapPut(map, &entryFound, HMDR_FIND);
+		if(result == HMPR_FAILED) {
+			return false;
+		}
+		++entryFound->counter;
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	if(argc < 2) {
+		return 1;
+	}
+	int fd = open(argv[1], O_RDONLY);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) != 0) {
+		return 1;
+	}
+	const char *input = "";
+	if(st.st_size > 0) {
+		input = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(input == MAP_FAILED) {
+			return 1;
+		}
+		madvise((void*) input, st.st_size, MADV_SEQUENTIAL);
+	}
+
+	hashMap map;
+	hashMapNew(&map);
+
+	struct entry batch[BATCH_SIZE];
+	size_t batchSize = 0;
+	const char *pos = input, *end = input + st.st_size;
+	while((pos = skip(pos, end, false)) < end) {
+		const char *wordEnd = skip(pos, end, true);
+		for(; pos < wordEnd; pos += MAX_WORD_LENGTH) {
+			size_t length = wordEnd - pos;
+			if(length > MAX_WORD_LENGTH) {
+				length = MAX_WORD_LENGTH;
+			}
+			batch[batchSize++] = (struct entry) {
+				.hash = djb2(pos, length),
+				.word = pos,
+				.length = length,
+				.counter = 0,
+			};
+			if(batchSize == BATCH_SIZE) {
+				if(!putBatch(&map, batch, batchSize)) {
+					return 1;
+				}
+				batchSize = 0;
+			}
+		}
+		pos = wordEnd;
+	}
+	if(!putBatch(&map, batch, batchSize)) {
+		return 1;
+	}
+
+	struct entry *entryFound;
+	HASHMAP_FOR_EACH(hashMap, entryFound, map) {
+		char buffer[1024];
+		snprintf(buffer, sizeof(buffer), "%.5d %.*s\n", entryFound->counter,
+		         (int) entryFound->length, entryFound->word);
+	} HASHMAP_FOR_EACH_END
+
+	return 0;
+}
@@ -17,7 +17,7 @@ function measure() {
 	echo "$NAME: $(dc -e "3 k $SUM 25 / p")"
 }
 
-for contestant in generic-c-hashmap-count uthash-count; do
+for contestant in generic-c-hashmap-count generic-c-hashmap-mmap-count uthash-count; do
 	for optimization in O0 O1 O2 O3 Os Ofast; do
 		echo "Contestant: $contestant; optimization: -$optimization"
 		measure "Compiling" cc -std=gnu99 "-$optimization" "./$contestant.c" -o "./$contestant" 
@@ -0,0 +1,654 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+#ifndef SPILLHASHMAP_H__
+#define SPILLHASHMAP_H__
+
+// Maps that hold more entries than fit into memory, e.g. to deduplicate keys.
+// The entries are partitioned by their hash into a fixed number of segments,
+// each of which is a DEFINE_HASHMAP map. Only recently used segments are kept
+// in memory, up to a memory budget. The least recently used segments are
+// written to a file and read back when they are used again.
+//
+// A segment is stored as the plain array of its entries in an extent of the
+// file. It is only written if it changed since it was read, and it keeps its
+// extent as long as it fits. Otherwise the last extent of the file grows in
+// place, and other ones move to the smallest free range that fits, or to the
+// end of the file. The extent left behind becomes a free range, merged with
+// the adjacent ones. The entries are written byte by byte, so TYPE must not contain
+// pointers to memory that is freed meanwhile.
+// POSIX only, the file is accessed with pread(2) and pwrite(2).
+
+#include "hashmap.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+// End of the recency list of the segments in memory.
+#define _SPILL_HASHMAP_NIL UINT32_MAX
+
+// Bytes read or written at once.
+#define _SPILL_HASHMAP_CHUNK (64 * 1024)
+
+/**
+ * Writes or reads bytes at offset of a file, retrying short transfers.
+ * \return false on an I/O error or an unexpected end of the file.
+ */
+static inline bool _spillHashMapTransfer(int fd,
+                                         void *data,
+                                         size_t bytes,
+                                         uint64_t offset,
+                                         bool write) {
+    char *position = (char *) data;
+    while(bytes) {
+        ssize_t done = write ? pwrite(fd, position, bytes, (off_t) offset)
+                             : pread(fd, position, bytes, (off_t) offset);
+        if(done <= 0) {
+            return false;
+        }
+        position += done;
+        bytes -= (size_t) done;
+        offset += (uint64_t) done;
+    }
+    return true;
+}
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static inline uint64_t _spillHashMapMix(uint64_t hash) {
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    return hash ^ (hash >> 31);
+}
+
+// A free range of the file, left behind by a segment that moved.
+typedef struct {
+    uint64_t offset;
+    uint64_t bytes;
+} _SpillHashMapHole;
+
+/**
+ * Defines the types and function prototypes of a spilling map type NAME.
+ * \param NAME Name of the map type.
+ * \param TYPE Type of the entries, plain data without pointers.
+ */
+#define DEFINE_SPILL_HASHMAP(NAME, TYPE)                                       \
+                                                                               \
+typedef TYPE _SpillType##NAME;                                                 \
+                                                                               \
+DEFINE_HASHMAP(NAME##SegmentMap, TYPE)                                         \
+                                                                               \
+typedef struct {                                                               \
+    NAME##SegmentMap map;      /* the entries, if resident */                  \
+    size_t           size;     /* number of entries, resident or not */        \
+    uint64_t         offset;   /* extent in the file */                        \
+    size_t           extent;   /* capacity of the extent in entries */         \
+    uint32_t         newer;    /* recency links of resident segments */        \
+    uint32_t         older;                                                    \
+    bool             resident;                                                 \
+    bool             dirty;    /* the entries differ from the extent */        \
+} NAME##Segment;                                                               \
+                                                                               \
+typedef struct {                                                               \
+    size_t         size;                                                       \
+    NAME##Segment *segments;                                                   \
+    uint32_t       count;    /* number of segments */                          \
+    size_t         budget;   /* bytes of the resident segments */              \
+    size_t         resident; /* estimated bytes of the resident segments */    \
+    uint32_t       newest;                                                     \
+    uint32_t       oldest;                                                     \
+    FILE              *file;                                                   \
+    uint64_t           end;       /* end of the used part of the file */       \
+    uint64_t           garbage;   /* bytes of the free ranges */               \
+    _SpillHashMapHole *holes;     /* free ranges before end, by offset */      \
+    size_t             holeCount;                                              \
+} NAME;                                                                        \
+                                                                               \
+/* Initializes an empty map.                                                 */\
+/* \param map [Out] Map to initialize.                                       */\
+/* \param path File to spill the segments to, is truncated. NULL for an      */\
+/*             anonymous temporary file, see tmpfile(3).                     */\
+/* \param segments Number of segments, 1 to UINT32_MAX-1. A segment should   */\
+/*                 be a small part of the budget, e.g. 1/64.                 */\
+/* \param budget Memory for the resident segments in bytes. Segments are     */\
+/*               written out before another one is read if it would exceed   */\
+/*               the budget, but the segment in use always stays resident.   */\
+/* \return false, if memory is exhausted or the file could not be opened.    */\
+bool NAME##New(NAME *map,                                                      \
+               const char *path,                                               \
+               size_t segments,                                                \
+               size_t budget);                                                 \
+                                                                               \
+/* Frees the map and closes the file. A named file is not removed.           */\
+/* \param map Map to destroy.                                                */\
+void NAME##Destroy(NAME *map);                                                 \
+                                                                               \
+/* Looks up an entry in a map, reads its segment if needed.                  */\
+/* \param map Map to search in.                                              */\
+/* \param entry [In/Out] Entry to search, returns pointer to found item. It  */\
+/*              is valid until the map is used again, and you must not       */\
+/*              modify it, use NAME##Put(..., HMDR_REPLACE) instead.         */\
+/* \return false, if could not found, or on an I/O error.                    */\
+bool NAME##Find(NAME *map,                                                     \
+                TYPE **entry);                                                 \
+                                                                               \
+/* Adds an entry into a map, reads its segment if needed.                    */\
+/* \param map Map to add to.                                                 */\
+/* \param entry [In/Out] Entry add. If duplicate, return pointer to it in    */\
+/*              here. Valid as for NAME##Find().                             */\
+/* \param dr What to do with duplicates.                                     */\
+/* \return HMPR_FAILED as for NAME##Put() of DEFINE_HASHMAP(...), or on an   */\
+/*         I/O error.                                                        */\
+HashMapPutResult NAME##Put(NAME *map,                                          \
+                           TYPE **entry,                                       \
+                           HashMapDuplicateResolution dr);                     \
+                                                                               \
+/* Removes an entry for the list, reads its segment if needed.               */\
+/* \param map Map to remove from.                                            */\
+/* \param entry [In/out] Entry to remove, returns removed entry.             */\
+/* \return false, if did not exist, or on an I/O error.                      */\
+bool NAME##Remove(NAME *map,                                                   \
+                  TYPE *entry);                                                \
+                                                                               \
+/* Puts many entries, grouped by their segments: every segment that is       */\
+/* needed is read at most once, and entries of the same segment are put in   */\
+/* the order they are given.                                                 */\
+/* \param map Map to add to.                                                 */\
+/* \param entries [In/Out] Entries to add. HMDR_SWAP returns the old entries */\
+/*                in here.                                                   */\
+/* \param count Number of entries.                                           */\
+/* \param dr What to do with duplicates.                                     */\
+/* \param results [Out] The result of every entry, as for NAME##Put(). May   */\
+/*                be NULL.                                                   */\
+/* \return false, if memory is exhausted or on an I/O error. Some entries    */\
+/*         may have been put.                                                */\
+bool NAME##PutBatch(NAME *map,                                                 \
+                    TYPE *entries,                                             \
+                    size_t count,                                              \
+                    HashMapDuplicateResolution dr,                             \
+                    HashMapPutResult *results);                                \
+                                                                               \
+/* Calls fn for every entry, reads the segments one after another.           */\
+/* fn must not modify the map.                                               */\
+/* \param map Map to iterate over.                                           */\
+/* \param fn Function to call for every entry.                               */\
+/* \param ctx Passed to fn.                                                  */\
+/* \return false, on an I/O error.                                           */\
+bool NAME##ForEach(NAME *map,                                                  \
+                   void (*fn)(TYPE *entry, void *ctx),                         \
+                   void *ctx);
+
+
+/**
+ * Declares the functions of spilling map type NAME.
+ * The parameters are the same as for DECLARE_HASHMAP(...).
+ */
+#define DECLARE_SPILL_HASHMAP(NAME, CMP, GET_HASH, FREE, REALLOC)              \
+                                                                               \
+DECLARE_HASHMAP(NAME##SegmentMap, CMP, GET_HASH, FREE, REALLOC)                \
+                                                                               \
+bool NAME##New(NAME *map,                                                      \
+               const char *path,                                               \
+               size_t segments,                                                \
+               size_t budget) {                                                \
+    if(segments < 1 || segments >= _SPILL_HASHMAP_NIL ||                       \
+                       segments > SIZE_MAX / sizeof(NAME##Segment)) {          \
+        return false;                                                          \
+    }                                                                          \
+    map->segments = REALLOC(NULL, sizeof(NAME##Segment[segments]));            \
+    if(!map->segments) {                                                       \
+        return false;                                                          \
+    }                                                                          \
+    /* there is a free range before every extent at most, and one more */      \
+    /* while one is given back                                         */      \
+    map->holes = REALLOC(NULL, sizeof(_SpillHashMapHole[segments + 1]));       \
+    map->file = map->holes ? path ? fopen(path, "w+b") : tmpfile() : NULL;     \
+    if(!map->file) {                                                           \
+        if(map->holes) {                                                       \
+            FREE(map->holes);                                                  \
+        }                                                                      \
+        FREE(map->segments);                                                   \
+        return false;                                                          \
+    }                                                                          \
+    for(size_t i = 0; i < segments; ++i) {                                     \
+        NAME##Segment *segment = &map->segments[i];                            \
+        NAME##SegmentMapNew(&segment->map);                                    \
+        segment->size = 0;                                                     \
+        segment->offset = 0;                                                   \
+        segment->extent = 0;                                                   \
+        segment->resident = false;                                             \
+        segment->dirty = false;                                                \
+    }                                                                          \
+    map->size = 0;                                                             \
+    map->count = (uint32_t) segments;                                          \
+    map->budget = budget;                                                      \
+    map->resident = 0;                                                         \
+    map->newest = _SPILL_HASHMAP_NIL;                                          \
+    map->oldest = _SPILL_HASHMAP_NIL;                                          \
+    map->end = 0;                                                              \
+    map->garbage = 0;                                                          \
+    map->holeCount = 0;                                                        \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+void NAME##Destroy(NAME *map) {                                                \
+    if(map->segments) {                                                        \
+        for(uint32_t i = 0; i < map->count; ++i) {                             \
+            NAME##SegmentMapDestroy(&map->segments[i].map);                    \
+        }                                                                      \
+        FREE(map->segments);                                                   \
+        FREE(map->holes);                                                      \
+        fclose(map->file);                                                     \
+    }                                                                          \
+    map->size = 0;                                                             \
+    map->segments = NULL;                                                      \
+    map->holes = NULL;                                                         \
+    map->holeCount = 0;                                                        \
+    map->count = 0;                                                            \
+    map->resident = 0;                                                         \
+    map->file = NULL;                                                          \
+}                                                                              \
+                                                                               \
+/* Estimated bytes of a resident segment: its table and its entries.         */\
+static inline size_t _##NAME##Bytes(const NAME##SegmentMap *map) {             \
+    size_t table = map->entries ? _##NAME##SegmentMapPrimes[map->nth_prime] *  \
+                                  sizeof(NAME##SegmentMapBucket) : 0;          \
+    return table + map->size * sizeof(_SpillType##NAME);                       \
+}                                                                              \
+                                                                               \
+/* Index of the segment of an entry.                                         */\
+static inline uint32_t _##NAME##SegmentOf(const NAME *map,                     \
+                                          _SpillType##NAME *entry) {           \
+    uint64_t hash = _spillHashMapMix((uint64_t) (GET_HASH(entry)));            \
+    return (uint32_t) (((hash >> 32) * map->count) >> 32);                     \
+}                                                                              \
+                                                                               \
+/* Removes segment i from the recency list.                                  */\
+static void _##NAME##Unlink(NAME *map,                                         \
+                            uint32_t i) {                                      \
+    NAME##Segment *segment = &map->segments[i];                                \
+    if(segment->newer != _SPILL_HASHMAP_NIL) {                                 \
+        map->segments[segment->newer].older = segment->older;                  \
+    } else {                                                                   \
+        map->newest = segment->older;                                          \
+    }                                                                          \
+    if(segment->older != _SPILL_HASHMAP_NIL) {                                 \
+        map->segments[segment->older].newer = segment->newer;                  \
+    } else {                                                                   \
+        map->oldest = segment->newer;                                          \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* Puts segment i at the front of the recency list.                          */\
+static void _##NAME##PushNewest(NAME *map,                                     \
+                                uint32_t i) {                                  \
+    NAME##Segment *segment = &map->segments[i];                                \
+    segment->newer = _SPILL_HASHMAP_NIL;                                       \
+    segment->older = map->newest;                                              \
+    if(map->newest != _SPILL_HASHMAP_NIL) {                                    \
+        map->segments[map->newest].newer = i;                                  \
+    } else {                                                                   \
+        map->oldest = i;                                                       \
+    }                                                                          \
+    map->newest = i;                                                           \
+}                                                                              \
+                                                                               \
+/* Takes bytes from the smallest free range they fit into, or from the end   */\
+/* of the file.                                                              */\
+/* \return the offset of the bytes.                                          */\
+static uint64_t _##NAME##Take(NAME *map,                                       \
+                              uint64_t bytes) {                                \
+    size_t best = map->holeCount;                                              \
+    for(size_t h = 0; h < map->holeCount; ++h) {                               \
+        _SpillHashMapHole *hole = &map->holes[h];                              \
+        if(hole->bytes >= bytes && (best == map->holeCount ||                  \
+                                    hole->bytes < map->holes[best].bytes)) {   \
+            best = h;                                                          \
+        }                                                                      \
+    }                                                                          \
+    if(best == map->holeCount) {                                               \
+        map->end += bytes;                                                     \
+        return map->end - bytes;                                               \
+    }                                                                          \
+    _SpillHashMapHole *hole = &map->holes[best];                               \
+    uint64_t offset = hole->offset;                                            \
+    hole->offset += bytes;                                                     \
+    hole->bytes -= bytes;                                                      \
+    map->garbage -= bytes;                                                     \
+    if(!hole->bytes) {                                                         \
+        memmove(hole, hole + 1,                                                \
+                sizeof(_SpillHashMapHole[map->holeCount - best - 1]));         \
+        --map->holeCount;                                                      \
+    }                                                                          \
+    return offset;                                                             \
+}                                                                              \
+                                                                               \
+/* Gives the bytes at offset back, merges them with the adjacent free        */\
+/* ranges, and with the end of the file.                                     */\
+static void _##NAME##Give(NAME *map,                                           \
+                          uint64_t offset,                                     \
+                          uint64_t bytes) {                                    \
+    if(!bytes) {                                                               \
+        return;                                                                \
+    }                                                                          \
+    size_t h = 0;                                                              \
+    while(h < map->holeCount && map->holes[h].offset < offset) {               \
+        ++h;                                                                   \
+    }                                                                          \
+    _SpillHashMapHole *holes = map->holes;                                     \
+    if(h && holes[h-1].offset + holes[h-1].bytes == offset) {                  \
+        holes[--h].bytes += bytes;                                             \
+    } else {                                                                   \
+        memmove(&holes[h+1], &holes[h],                                        \
+                sizeof(_SpillHashMapHole[map->holeCount - h]));                \
+        holes[h].offset = offset;                                              \
+        holes[h].bytes = bytes;                                                \
+        ++map->holeCount;                                                      \
+    }                                                                          \
+    map->garbage += bytes;                                                     \
+    if(h + 1 < map->holeCount &&                                               \
+                   holes[h].offset + holes[h].bytes == holes[h+1].offset) {    \
+        holes[h].bytes += holes[h+1].bytes;                                    \
+        memmove(&holes[h+1], &holes[h+2],                                      \
+                sizeof(_SpillHashMapHole[map->holeCount - h - 2]));            \
+        --map->holeCount;                                                      \
+    }                                                                          \
+    if(holes[h].offset + holes[h].bytes == map->end) {                         \
+        /* the last free range */                                              \
+        map->end = holes[h].offset;                                            \
+        map->garbage -= holes[h].bytes;                                        \
+        --map->holeCount;                                                      \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* Writes segment i to its extent if it changed, and frees its entries.      */\
+/* \return false, if memory is exhausted or on an I/O error. The segment     */\
+/*         stays resident then.                                              */\
+static bool _##NAME##Spill(NAME *map,                                          \
+                           uint32_t i) {                                       \
+    NAME##Segment *segment = &map->segments[i];                                \
+    size_t size = segment->map.size;                                           \
+    if(segment->dirty && size) {                                               \
+        bool moved = size > segment->extent;                                   \
+        /* grow by half, so that a growing segment moves a few times only */   \
+        size_t extent = moved ? size + size / 2 : segment->extent;             \
+        size_t chunk = _SPILL_HASHMAP_CHUNK / sizeof(_SpillType##NAME) + 1;    \
+        chunk = chunk < size ? chunk : size;                                   \
+        _SpillType##NAME *buffer = REALLOC(NULL,                               \
+                                           sizeof(_SpillType##NAME[chunk]));   \
+        if(!buffer) {                                                          \
+            return false;                                                      \
+        }                                                                      \
+        /* the last extent of the file grows where it is */                    \
+        bool inPlace = !moved || segment->offset +                             \
+                         sizeof(_SpillType##NAME[segment->extent]) == map->end;\
+        uint64_t offset = inPlace ? segment->offset : _##NAME##Take(map,       \
+                                          sizeof(_SpillType##NAME[extent]));   \
+        bool written = true;                                                   \
+        size_t buffered = 0;                                                   \
+        uint64_t position = offset;                                            \
+        _SpillType##NAME *iter;                                                \
+        HASHMAP_FOR_EACH(NAME##SegmentMap, iter, segment->map) {               \
+            buffer[buffered++] = *iter;                                        \
+            if(buffered == chunk) {                                            \
+                written = _spillHashMapTransfer(fileno(map->file), buffer,     \
+                                    sizeof(_SpillType##NAME[buffered]),        \
+                                    position, true);                           \
+                position += sizeof(_SpillType##NAME[buffered]);                \
+                buffered = 0;                                                  \
+                if(!written) {                                                 \
+                    break;                                                     \
+                }                                                              \
+            }                                                                  \
+        } HASHMAP_FOR_EACH_END                                                 \
+        if(written && buffered) {                                              \
+            written = _spillHashMapTransfer(fileno(map->file), buffer,         \
+                                            sizeof(_SpillType##NAME[buffered]),\
+                                            position, true);                   \
+        }                                                                      \
+        FREE(buffer);                                                          \
+        if(!written) {                                                         \
+            if(!inPlace) {                                                     \
+                _##NAME##Give(map, offset, sizeof(_SpillType##NAME[extent]));  \
+            }                                                                  \
+            return false;                                                      \
+        }                                                                      \
+        if(inPlace && moved) {                                                 \
+            map->end = offset + sizeof(_SpillType##NAME[extent]);              \
+        } else if(moved) {                                                     \
+            _##NAME##Give(map, segment->offset,                                \
+                          sizeof(_SpillType##NAME[segment->extent]));          \
+        }                                                                      \
+        segment->offset = offset;                                              \
+        segment->extent = extent;                                              \
+    }                                                                          \
+    map->resident -= _##NAME##Bytes(&segment->map);                            \
+    NAME##SegmentMapDestroy(&segment->map);                                    \
+    _##NAME##Unlink(map, i);                                                   \
+    segment->resident = false;                                                 \
+    segment->dirty = false;                                                    \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Spills the least recently used segments until bytes more fit into the     */\
+/* budget, but not segment keep.                                             */\
+/* \return false, if memory is exhausted or on an I/O error.                 */\
+static bool _##NAME##Trim(NAME *map,                                           \
+                          size_t bytes,                                        \
+                          uint32_t keep) {                                     \
+    while(map->oldest != _SPILL_HASHMAP_NIL && map->oldest != keep &&          \
+                         map->resident + bytes > map->budget) {                \
+        if(!_##NAME##Spill(map, map->oldest)) {                                \
+            return false;                                                      \
+        }                                                                      \
+    }                                                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Makes segment i resident and the most recently used one. If reading it    */\
+/* would exceed the budget, spills the least recently used segments first.   */\
+/* \return the map of the segment, NULL if memory is exhausted or on an I/O  */\
+/*         error.                                                            */\
+static NAME##SegmentMap *_##NAME##Touch(NAME *map,                             \
+                                        uint32_t i) {                          \
+    NAME##Segment *segment = &map->segments[i];                                \
+    if(segment->resident) {                                                    \
+        if(map->newest != i) {                                                 \
+            _##NAME##Unlink(map, i);                                           \
+            _##NAME##PushNewest(map, i);                                       \
+        }                                                                      \
+        return &segment->map;                                                  \
+    }                                                                          \
+    /* an estimate: the entries, and a table of about the same size */         \
+    if(!_##NAME##Trim(map, 2 * sizeof(_SpillType##NAME) * segment->size,       \
+                      _SPILL_HASHMAP_NIL)) {                                   \
+        return NULL;                                                           \
+    }                                                                          \
+    NAME##SegmentMap *segmentMap = &segment->map;                              \
+    if(segment->size) {                                                        \
+        if(!NAME##SegmentMapEnsureSize(segmentMap, segment->size)) {           \
+            return NULL;                                                       \
+        }                                                                      \
+        size_t chunk = _SPILL_HASHMAP_CHUNK / sizeof(_SpillType##NAME) + 1;    \
+        chunk = chunk < segment->size ? chunk : segment->size;                 \
+        _SpillType##NAME *buffer = REALLOC(NULL,                               \
+                                           sizeof(_SpillType##NAME[chunk]));   \
+        bool read = buffer != NULL;                                            \
+        for(size_t done = 0; read && done < segment->size; done += chunk) {    \
+            size_t n = segment->size - done < chunk ? segment->size - done     \
+                                                    : chunk;                   \
+            read = _spillHashMapTransfer(fileno(map->file), buffer,            \
+                          sizeof(_SpillType##NAME[n]),                         \
+                          segment->offset + sizeof(_SpillType##NAME[done]),    \
+                          false);                                              \
+            for(size_t j = 0; read && j < n; ++j) {                            \
+                /* restores stacked entries in their order, too */             \
+                _SpillType##NAME *entry = &buffer[j];                          \
+                read = NAME##SegmentMapPut(segmentMap, &entry,                 \
+                                           HMDR_STACK) != HMPR_FAILED;         \
+            }                                                                  \
+        }                                                                      \
+        if(buffer) {                                                           \
+            FREE(buffer);                                                      \
+        }                                                                      \
+        if(!read) {                                                            \
+            NAME##SegmentMapDestroy(segmentMap);                               \
+            return NULL;                                                       \
+        }                                                                      \
+    }                                                                          \
+    map->resident += _##NAME##Bytes(segmentMap);                               \
+    segment->resident = true;                                                  \
+    segment->dirty = false;                                                    \
+    _##NAME##PushNewest(map, i);                                               \
+    return segmentMap;                                                         \
+}                                                                              \
+                                                                               \
+/* Updates the bookkeeping after segment i was modified, and spills other    */\
+/* segments if it grew beyond the budget. If that fails, the next            */\
+/* _##NAME##Touch() tries again and reports the error.                       */\
+/* \param bytes _##NAME##Bytes() of the segment before.                      */\
+static void _##NAME##Modified(NAME *map,                                       \
+                              uint32_t i,                                      \
+                              size_t bytes) {                                  \
+    NAME##Segment *segment = &map->segments[i];                                \
+    map->resident = map->resident - bytes + _##NAME##Bytes(&segment->map);     \
+    map->size = map->size - segment->size + segment->map.size;                 \
+    segment->size = segment->map.size;                                         \
+    segment->dirty = true;                                                     \
+    _##NAME##Trim(map, 0, i);                                                  \
+}                                                                              \
+                                                                               \
+bool NAME##Find(NAME *map,                                                     \
+                _SpillType##NAME **entry) {                                    \
+    NAME##SegmentMap *segmentMap = _##NAME##Touch(map,                         \
+                                          _##NAME##SegmentOf(map, *entry));    \
+    return segmentMap && NAME##SegmentMapFind(segmentMap, entry);              \
+}                                                                              \
+                                                                               \
+HashMapPutResult NAME##Put(NAME *map,                                          \
+                           _SpillType##NAME **entry,                           \
+                           HashMapDuplicateResolution dr) {                    \
+    uint32_t i = _##NAME##SegmentOf(map, *entry);                              \
+    NAME##SegmentMap *segmentMap = _##NAME##Touch(map, i);                     \
+    if(!segmentMap) {                                                          \
+        return HMPR_FAILED;                                                    \
+    }                                                                          \
+    size_t bytes = _##NAME##Bytes(segmentMap);                                 \
+    HashMapPutResult result = NAME##SegmentMapPut(segmentMap, entry, dr);      \
+    if(result != HMPR_FAILED && result != HMPR_FOUND) {                        \
+        _##NAME##Modified(map, i, bytes);                                      \
+    }                                                                          \
+    return result;                                                             \
+}                                                                              \
+                                                                               \
+bool NAME##Remove(NAME *map,                                                   \
+                  _SpillType##NAME *entry) {                                   \
+    uint32_t i = _##NAME##SegmentOf(map, entry);                               \
+    NAME##SegmentMap *segmentMap = _##NAME##Touch(map, i);                     \
+    if(!segmentMap) {                                                          \
+        return false;                                                          \
+    }                                                                          \
+    size_t bytes = _##NAME##Bytes(segmentMap);                                 \
+    if(!NAME##SegmentMapRemove(segmentMap, entry)) {                           \
+        return false;                                                          \
+    }                                                                          \
+    _##NAME##Modified(map, i, bytes);                                          \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+bool NAME##PutBatch(NAME *map,                                                 \
+                    _SpillType##NAME *entries,                                 \
+                    size_t count,                                              \
+                    HashMapDuplicateResolution dr,                             \
+                    HashMapPutResult *results) {                               \
+    if(!count) {                                                               \
+        return true;                                                           \
+    }                                                                          \
+    /* counting sort of the entries by their segments */                       \
+    uint32_t *segmentOf = count <= SIZE_MAX / sizeof(size_t)                   \
+                        ? REALLOC(NULL, sizeof(uint32_t[count])) : NULL;       \
+    size_t *order = segmentOf ? REALLOC(NULL, sizeof(size_t[count])) : NULL;   \
+    size_t *starts = order ? REALLOC(NULL, sizeof(size_t[map->count + 1]))     \
+                           : NULL;                                             \
+    if(!starts) {                                                              \
+        if(order) {                                                            \
+            FREE(order);                                                       \
+        }                                                                      \
+        if(segmentOf) {                                                        \
+            FREE(segmentOf);                                                   \
+        }                                                                      \
+        return false;                                                          \
+    }                                                                          \
+    memset(starts, 0, sizeof(size_t[map->count + 1]));                         \
+    for(size_t j = 0; j < count; ++j) {                                        \
+        segmentOf[j] = _##NAME##SegmentOf(map, &entries[j]);                   \
+        ++starts[segmentOf[j] + 1];                                            \
+    }                                                                          \
+    for(uint32_t i = 0; i < map->count; ++i) {                                 \
+        starts[i + 1] += starts[i];                                            \
+    }                                                                          \
+    for(size_t j = 0; j < count; ++j) {                                        \
+        order[starts[segmentOf[j]]++] = j;                                     \
+    }                                                                          \
+    /* starts[i] is the end of segment i now */                                \
+    bool success = true;                                                       \
+    size_t begin = 0;                                                          \
+    for(uint32_t i = 0; success && i < map->count; ++i) {                      \
+        size_t end = starts[i];                                                \
+        if(begin == end) {                                                     \
+            continue;                                                          \
+        }                                                                      \
+        NAME##SegmentMap *segmentMap = _##NAME##Touch(map, i);                 \
+        if(!segmentMap) {                                                      \
+            success = false;                                                   \
+            break;                                                             \
+        }                                                                      \
+        size_t bytes = _##NAME##Bytes(segmentMap);                             \
+        bool modified = false;                                                 \
+        for(; begin < end; ++begin) {                                          \
+            size_t j = order[begin];                                           \
+            _SpillType##NAME *entry = &entries[j];                             \
+            HashMapPutResult result = NAME##SegmentMapPut(segmentMap, &entry,  \
+                                                          dr);                 \
+            if(results) {                                                      \
+                results[j] = result;                                           \
+            }                                                                  \
+            if(result == HMPR_FAILED && entry == &entries[j]) {                \
+                /* not a duplicate, memory is exhausted */                     \
+                success = false;                                               \
+                break;                                                         \
+            }                                                                  \
+            modified |= result != HMPR_FAILED && result != HMPR_FOUND;         \
+        }                                                                      \
+        if(modified) {                                                         \
+            _##NAME##Modified(map, i, bytes);                                  \
+        }                                                                      \
+    }                                                                          \
+    FREE(starts);                                                              \
+    FREE(order);                                                               \
+    FREE(segmentOf);                                                           \
+    return success;                                                            \
+}                                                                              \
+                                                                               \
+bool NAME##ForEach(NAME *map,                                                  \
+                   void (*fn)(_SpillType##NAME *entry, void *ctx),             \
+                   void *ctx) {                                                \
+    for(uint32_t i = 0; i < map->count; ++i) {                                 \
+        if(!map->segments[i].size) {                                           \
+            continue;                                                          \
+        }                                                                      \
+        NAME##SegmentMap *segmentMap = _##NAME##Touch(map, i);                 \
+        if(!segmentMap) {                                                      \
+            return false;                                                      \
+        }                                                                      \
+        _SpillType##NAME *iter;                                                \
+        HASHMAP_FOR_EACH(NAME##SegmentMap, iter, *segmentMap) {                \
+            fn(iter, ctx);                                                     \
+        } HASHMAP_FOR_EACH_END                                                 \
+    }                                                                          \
+    return true;                                                               \
+}
+
+
+#endif // ifndef SPILLHASHMAP_H__
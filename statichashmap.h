@@ -0,0 +1,478 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+#ifndef STATICHASHMAP_H__
+#define STATICHASHMAP_H__
+
+// Read-only maps over a fixed set of entries. The entries are indexed by a
+// minimal perfect hash function (BBHash, https://arxiv.org/abs/1702.03154),
+// i.e. every entry has its own index in [0, size), so a lookup hashes once and
+// compares a single entry.
+// tools/staticHashMapGen.c generates the tables of a static map at build
+// time, so they are constant data and need no set up at run time.
+
+#include "hashmap.h"
+
+#include <stdlib.h>
+
+#define _STATIC_HASHMAP_MAX_LEVELS 64
+#define _STATIC_HASHMAP_RANK_WORDS 8
+
+/**
+ * Minimal perfect hash function.
+ * Level l are the bits [offsets[l], offsets[l+1]) of bits. A hash gets a
+ * position in every level. The first level, where the bit of this position is
+ * set, gives the index of the hash: the number of set bits before the
+ * position.
+ */
+typedef struct {
+    size_t          levels;  // number of levels
+    const size_t   *offsets; // levels+1 bit offsets of the levels
+    const uint64_t *bits;    // bits of all levels
+    const size_t   *ranks;   // number of set bits before every 8th word
+} StaticHashMapMph;
+
+/**
+ * The hash the generator uses for string keys (FNV-1a).
+ * Use it in GET_HASH if you generated a map with string keys. Maps with
+ * integer keys need GET_HASH to return the key, converted to uint64_t.
+ */
+static inline uint64_t staticHashMapStringHash(const char *str) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(; *str; ++str) {
+        hash = (hash ^ (unsigned char) *str) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// http://xorshift.di.unimi.it/splitmix64.c
+static inline uint64_t _staticHashMapMix(uint64_t hash, size_t level) {
+    hash += (uint64_t) (level + 1) * 0x9e3779b97f4a7c15ull;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    return hash ^ (hash >> 31);
+}
+
+static inline size_t _staticHashMapPosition(uint64_t hash,
+                                            size_t level,
+                                            size_t length) {
+    return (size_t) (_staticHashMapMix(hash, level) % length);
+}
+
+/**
+ * Looks up the index of a hash.
+ * \param mph Minimal perfect hash function.
+ * \param hash Hash to look up.
+ * \param index [Out] Index of the hash, if found.
+ * \return false, if hash is not in the set. Other hashes might get the index
+ *         of an entry, so you have to compare the entry anyway.
+ */
+static inline bool _staticHashMapMphIndex(const StaticHashMapMph *mph,
+                                          uint64_t hash,
+                                          size_t *index) {
+    for(size_t level = 0; level < mph->levels; ++level) {
+        size_t offset = mph->offsets[level];
+        size_t bit = offset + _staticHashMapPosition(
+                hash, level, mph->offsets[level+1] - offset);
+        size_t word = bit / 64;
+        uint64_t mask = (uint64_t) 1 << (bit % 64);
+        if(mph->bits[word] & mask) {
+            size_t rank = mph->ranks[word / _STATIC_HASHMAP_RANK_WORDS];
+            for(size_t w = word - word % _STATIC_HASHMAP_RANK_WORDS;
+                w < word; ++w) {
+                rank += (size_t) __builtin_popcountll(mph->bits[w]);
+            }
+            rank += (size_t) __builtin_popcountll(mph->bits[word] & (mask-1));
+            *index = rank;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Frees the arrays of a minimal perfect hash function built by
+ * _staticHashMapMphBuild(...).
+ */
+static inline void _staticHashMapMphFree(StaticHashMapMph *mph,
+                                         void (*freeFn)(void *)) {
+    freeFn((void *) mph->offsets);
+    freeFn((void *) mph->bits);
+    freeFn((void *) mph->ranks);
+    mph->levels = 0;
+    mph->offsets = NULL;
+    mph->bits = NULL;
+    mph->ranks = NULL;
+}
+
+/**
+ * Builds a minimal perfect hash function.
+ * \param mph [Out] Minimal perfect hash function.
+ * \param hashes Distinct hashes of the entries, get overwritten.
+ * \param size Number of hashes.
+ * \param gamma Bits per hash in every level, at least 1. Lookups in larger
+ *              levels end earlier, but take more memory: about 3 bits per
+ *              hash for gamma = 1, 4 bits for gamma = 2.
+ * \param reallocFn Allocator of the arrays.
+ * \param freeFn Deallocator of the arrays.
+ * \return false, if memory is exhausted or hashes are not distinct.
+ */
+static inline bool _staticHashMapMphBuild(StaticHashMapMph *mph,
+                                          uint64_t *hashes,
+                                          size_t size,
+                                          double gamma,
+                                          void *(*reallocFn)(void *, size_t),
+                                          void (*freeFn)(void *)) {
+    size_t *offsets = (size_t *) reallocFn(
+            NULL, (_STATIC_HASHMAP_MAX_LEVELS + 1) * sizeof(size_t));
+    uint64_t *bits = NULL, *collisions = NULL;
+    size_t *ranks = NULL;
+    size_t levels = 0, words = 0, collisionWords = 0;
+    if(!offsets) {
+        return false;
+    }
+    offsets[0] = 0;
+    while(size) {
+        if(levels == _STATIC_HASHMAP_MAX_LEVELS) {
+            goto fail; // equal hashes
+        }
+        size_t length = (size_t) (gamma * (double) size);
+        length = length < 64 ? 64 : (length + 63) / 64 * 64;
+        size_t levelWords = length / 64;
+
+        uint64_t *newBits = (uint64_t *) reallocFn(
+                bits, (words + levelWords) * sizeof(uint64_t));
+        if(!newBits) {
+            goto fail;
+        }
+        bits = newBits;
+        if(collisionWords < levelWords) {
+            uint64_t *newCollisions = (uint64_t *) reallocFn(
+                    collisions, levelWords * sizeof(uint64_t));
+            if(!newCollisions) {
+                goto fail;
+            }
+            collisions = newCollisions;
+            collisionWords = levelWords;
+        }
+
+        uint64_t *level = &bits[words];
+        memset(level, 0, levelWords * sizeof(uint64_t));
+        memset(collisions, 0, levelWords * sizeof(uint64_t));
+        for(size_t i = 0; i < size; ++i) {
+            size_t bit = _staticHashMapPosition(hashes[i], levels, length);
+            uint64_t mask = (uint64_t) 1 << (bit % 64);
+            if(level[bit / 64] & mask) {
+                collisions[bit / 64] |= mask;
+            } else {
+                level[bit / 64] |= mask;
+            }
+        }
+        // hashes that collided go to the next level
+        size_t remaining = 0;
+        for(size_t i = 0; i < size; ++i) {
+            size_t bit = _staticHashMapPosition(hashes[i], levels, length);
+            if(collisions[bit / 64] & ((uint64_t) 1 << (bit % 64))) {
+                hashes[remaining++] = hashes[i];
+            }
+        }
+        for(size_t w = 0; w < levelWords; ++w) {
+            level[w] &= ~collisions[w];
+        }
+        words += levelWords;
+        offsets[++levels] = words * 64;
+        size = remaining;
+    }
+
+    if(words) {
+        size_t blocks = (words + _STATIC_HASHMAP_RANK_WORDS - 1) /
+                        _STATIC_HASHMAP_RANK_WORDS;
+        ranks = (size_t *) reallocFn(NULL, blocks * sizeof(size_t));
+        if(!ranks) {
+            goto fail;
+        }
+        size_t rank = 0;
+        for(size_t w = 0; w < words; ++w) {
+            if(w % _STATIC_HASHMAP_RANK_WORDS == 0) {
+                ranks[w / _STATIC_HASHMAP_RANK_WORDS] = rank;
+            }
+            rank += (size_t) __builtin_popcountll(bits[w]);
+        }
+    }
+    freeFn(collisions);
+    mph->levels = levels;
+    mph->offsets = offsets;
+    mph->bits = bits;
+    mph->ranks = ranks;
+    return true;
+
+fail:
+    freeFn(offsets);
+    freeFn(bits);
+    freeFn(collisions);
+    return false;
+}
+
+/**
+ * Looks up the first of the sorted hashes that is not less than hash.
+ */
+static inline size_t _staticHashMapLowerBound(const uint64_t *hashes,
+                                              size_t size,
+                                              uint64_t hash) {
+    size_t low = 0;
+    while(size) {
+        size_t half = size / 2;
+        if(hashes[low + half] < hash) {
+            low += half + 1;
+            size -= half + 1;
+        } else {
+            size = half;
+        }
+    }
+    return low;
+}
+
+// The hash of an entry and its position while a map gets frozen.
+typedef struct {
+    uint64_t hash;
+    size_t   index;
+} _StaticHashMapPair;
+
+static inline int _staticHashMapPairCmp(const void *left, const void *right) {
+    const _StaticHashMapPair *l = (const _StaticHashMapPair *) left;
+    const _StaticHashMapPair *r = (const _StaticHashMapPair *) right;
+    if(l->hash != r->hash) {
+        return l->hash < r->hash ? -1 : 1;
+    }
+    return l->index < r->index ? -1 : l->index > r->index;
+}
+
+/**
+ * Defines the type and the function prototypes of a static map type NAME.
+ * The instances are generated by tools/staticHashMapGen.c.
+ * \param NAME Name of the map type.
+ * \param TYPE Type of the entries.
+ */
+#define DEFINE_STATIC_HASHMAP(NAME, TYPE)                                      \
+                                                                               \
+typedef TYPE _StaticHashType##NAME;                                            \
+                                                                               \
+typedef struct {                                                               \
+    size_t           size;    /* number of entries */                          \
+    StaticHashMapMph mph;     /* index of the entries */                       \
+    const TYPE      *entries; /* entries, ordered by their index, then the */  \
+                              /* extra ones */                                 \
+    size_t           extra;   /* number of entries that have the hash of */    \
+                              /* an indexed one, see NAME##Freeze() */         \
+    const uint64_t  *extraHashes; /* their hashes, ascending */                \
+} NAME;                                                                        \
+                                                                               \
+/* Looks up an entry in a map. It takes one hash and one comparison, plus a  */\
+/* binary search over the extra entries if the compared one is not equal.    */\
+/* \param map Map to search in.                                              */\
+/* \param entry [In/Out] Entry to search, returns pointer to found item.     */\
+/*              You must not modify the found item.                          */\
+/* \return false, if could not found.                                        */\
+bool NAME##Find(const NAME *map,                                               \
+                TYPE **entry);
+
+
+/**
+ * Declares the functions of static map type NAME.
+ * \param NAME Name of the map type.
+ * \param CMP Same as for DECLARE_HASHMAP(...).
+ * \param GET_HASH Same as for DECLARE_HASHMAP(...), but it has to return the
+ *                 hash the map was generated with, i.e.
+ *                 staticHashMapStringHash(...) of string keys, or the integer
+ *                 key.
+ */
+#define DECLARE_STATIC_HASHMAP(NAME, CMP, GET_HASH)                            \
+                                                                               \
+bool NAME##Find(const NAME *map,                                               \
+                _StaticHashType##NAME **entry) {                               \
+    uint64_t hash = (uint64_t)(GET_HASH((*entry)));                            \
+    size_t index;                                                              \
+    if(!_staticHashMapMphIndex(&map->mph, hash, &index)) {                     \
+        return false;                                                          \
+    }                                                                          \
+    _StaticHashType##NAME *found =                                             \
+            (_StaticHashType##NAME *) &map->entries[index];                    \
+    if((CMP(found, (*entry))) != 0) {                                          \
+        size_t first = map->size - map->extra;                                 \
+        size_t i = _staticHashMapLowerBound(map->extraHashes, map->extra,      \
+                                            hash);                             \
+        for(;; ++i) {                                                          \
+            if(i >= map->extra || map->extraHashes[i] != hash) {               \
+                return false;                                                  \
+            }                                                                  \
+            found = (_StaticHashType##NAME *) &map->entries[first + i];        \
+            if((CMP(found, (*entry))) == 0) {                                  \
+                break;                                                         \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+    *entry = found;                                                            \
+    return true;                                                               \
+}
+
+
+/**
+ * Defines the type and the function prototypes to freeze maps of type NAME
+ * into static maps of type NAME##Frozen. Use it after DEFINE_HASHMAP(...).
+ * \param NAME Name of the map type.
+ */
+#define DEFINE_FROZEN_HASHMAP(NAME)                                            \
+                                                                               \
+DEFINE_STATIC_HASHMAP(NAME##Frozen, _HashType##NAME)                           \
+                                                                               \
+/* Copies the entries of a map into a static map. The entries are packed     */\
+/* in one array, indexed by a minimal perfect hash function of about 3 bits  */\
+/* per entry, so NAME##FrozenFind() mostly compares a single entry.          */\
+/* The entries are copied bytewise, so frozen uses the memory they point to. */\
+/* The map is not modified, you may destroy it if you don't need it anymore. */\
+/* \param map Map to freeze.                                                 */\
+/* \param frozen [Out] Static map to initialize.                             */\
+/* Entries whose hash another one has already are not indexed, but kept      */\
+/* after the indexed ones, sorted by their hash. Hashes of 32 bits start to  */\
+/* collide after some ten thousand entries, only those few take a search.    */\
+/* \return false, if memory is exhausted.                                    */\
+bool NAME##Freeze(const NAME *map,                                             \
+                  NAME##Frozen *frozen);                                       \
+                                                                               \
+/* Frees the memory of a frozen map.                                         */\
+/* \param frozen Frozen map to destroy.                                      */\
+void NAME##FrozenDestroy(NAME##Frozen *frozen);
+
+/**
+ * Declares the functions to freeze maps of type NAME.
+ * The parameters are the same as for DECLARE_HASHMAP(...).
+ */
+#define DECLARE_FROZEN_HASHMAP(NAME, CMP, GET_HASH, FREE, REALLOC)             \
+                                                                               \
+DECLARE_STATIC_HASHMAP(NAME##Frozen, CMP, GET_HASH)                            \
+                                                                               \
+static void *_##NAME##FrozenRealloc(void *ptr,                                 \
+                                    size_t size) {                             \
+    return REALLOC(ptr, size);                                                 \
+}                                                                              \
+                                                                               \
+static void _##NAME##FrozenFree(void *ptr) {                                   \
+    FREE(ptr);                                                                 \
+}                                                                              \
+                                                                               \
+bool NAME##Freeze(const NAME *map,                                             \
+                  NAME##Frozen *frozen) {                                      \
+    size_t size = map->size;                                                   \
+    size_t count = size ? size : 1;                                            \
+    _StaticHashMapPair *pairs = (_StaticHashMapPair *) REALLOC(                \
+            NULL, count * sizeof(_StaticHashMapPair));                         \
+    uint64_t *hashes = (uint64_t *) REALLOC(NULL, count * sizeof(uint64_t));   \
+    size_t *indices = (size_t *) REALLOC(NULL, count * sizeof(size_t));        \
+    _HashType##NAME *entries = (_HashType##NAME *) REALLOC(                    \
+            NULL, count * sizeof(_HashType##NAME));                            \
+    uint64_t *extraHashes = NULL;                                              \
+    StaticHashMapMph mph;                                                      \
+    if(!pairs || !hashes || !indices || !entries) {                            \
+        goto fail;                                                             \
+    }                                                                          \
+    size_t i = 0;                                                              \
+    _HashType##NAME *iter;                                                     \
+    HASHMAP_FOR_EACH(NAME, iter, *map) {                                       \
+        pairs[i].hash = (uint64_t)(GET_HASH(iter));                            \
+        pairs[i].index = i;                                                    \
+        entries[i] = *iter;                                                    \
+        ++i;                                                                   \
+    } HASHMAP_FOR_EACH_END                                                     \
+    /* the first entry of every hash gets indexed, the others are extra */     \
+    qsort(pairs, size, sizeof(_StaticHashMapPair), _staticHashMapPairCmp);     \
+    size_t indexed = 0, extra = 0;                                             \
+    for(i = 0; i < size; ++i) {                                                \
+        if(i && pairs[i].hash == pairs[i-1].hash) {                            \
+            ++extra;                                                           \
+        } else {                                                               \
+            hashes[indexed++] = pairs[i].hash;                                 \
+        }                                                                      \
+    }                                                                          \
+    if(extra && !(extraHashes = (uint64_t *) REALLOC(                          \
+                          NULL, extra * sizeof(uint64_t)))) {                  \
+        goto fail;                                                             \
+    }                                                                          \
+    if(!_staticHashMapMphBuild(&mph, hashes, indexed, 1,                       \
+                               _##NAME##FrozenRealloc,                         \
+                               _##NAME##FrozenFree)) {                         \
+        goto fail;                                                             \
+    }                                                                          \
+    extra = 0;                                                                 \
+    for(i = 0; i < size; ++i) {                                                \
+        if(i && pairs[i].hash == pairs[i-1].hash) {                            \
+            extraHashes[extra] = pairs[i].hash;                                \
+            indices[pairs[i].index] = indexed + extra++;                       \
+        } else {                                                               \
+            _staticHashMapMphIndex(&mph, pairs[i].hash,                        \
+                                   &indices[pairs[i].index]);                  \
+        }                                                                      \
+    }                                                                          \
+    /* move every entry to its index, following the cycles of the            */\
+    /* permutation                                                           */\
+    for(i = 0; i < size; ++i) {                                                \
+        while(indices[i] != i) {                                               \
+            size_t index = indices[i];                                         \
+            _HashType##NAME entry = entries[index];                            \
+            entries[index] = entries[i];                                       \
+            entries[i] = entry;                                                \
+            indices[i] = indices[index];                                       \
+            indices[index] = index;                                            \
+        }                                                                      \
+    }                                                                          \
+    FREE(pairs);                                                               \
+    FREE(hashes);                                                              \
+    FREE(indices);                                                             \
+    frozen->size = size;                                                       \
+    frozen->mph = mph;                                                         \
+    frozen->entries = entries;                                                 \
+    frozen->extra = extra;                                                     \
+    frozen->extraHashes = extraHashes;                                         \
+    return true;                                                               \
+                                                                               \
+fail:                                                                          \
+    FREE(pairs);                                                               \
+    FREE(hashes);                                                              \
+    FREE(indices);                                                             \
+    FREE(entries);                                                             \
+    FREE(extraHashes);                                                         \
+    return false;                                                              \
+}                                                                              \
+                                                                               \
+void NAME##FrozenDestroy(NAME##Frozen *frozen) {                               \
+    FREE((void *) frozen->entries);                                            \
+    FREE((void *) frozen->extraHashes);                                        \
+    _staticHashMapMphFree(&frozen->mph, _##NAME##FrozenFree);                  \
+    frozen->size = 0;                                                          \
+    frozen->entries = NULL;                                                    \
+    frozen->extra = 0;                                                         \
+    frozen->extraHashes = NULL;                                                \
+}
+
+
+/**
+ * Iterates over all entries of a static map, ordered by their index.
+ * \param NAME Name of the map type.
+ * \param ITER const TYPE* variable to assign the entries to.
+ * \param MAP The map.
+ */
+#define STATIC_HASHMAP_FOR_EACH(NAME, ITER, MAP)                               \
+    for(size_t __i = 0, __broke = 0; !__broke && __i < (MAP).size; ++__i) {    \
+        ITER = &(MAP).entries[__i];                                            \
+        __broke = 1;                                                           \
+        do
+
+/**
+ * Closes a STATIC_HASHMAP_FOR_EACH(...)
+ */
+#define STATIC_HASHMAP_FOR_EACH_END                                            \
+        while( __broke = 0, __broke );                                         \
+    }
+
+#endif // ifndef STATICHASHMAP_H__
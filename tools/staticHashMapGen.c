@@ -0,0 +1,236 @@
+/*
+ * AUTHOR:  René Kijewski  (rene.<surname>@fu-berlin.de)
+ * LICENSE: MIT
+ */
+
+// Generates a static map, see statichashmap.h.
+//
+// Compile:
+// cc -Wall -Wextra -pedantic -std=gnu99 -O2 staticHashMapGen.c -o staticHashMapGen
+//
+// Usage: ./staticHashMapGen [-i] [-g GAMMA] NAME VARIABLE < keys > VARIABLE.inc
+//
+// Every line of the input is a key, optionally followed by the initializer
+// of its entry. Without an initializer the entry is { "key" }, or { key } for
+// integer keys (-i). Empty lines and lines starting with # are skipped.
+//
+//     if     { "if",    TOKEN_IF }
+//     else   { "else",  TOKEN_ELSE }
+//     while  { "while", TOKEN_WHILE }
+//
+// The output defines "const NAME VARIABLE", include it after
+// DEFINE_STATIC_HASHMAP(NAME, ...):
+//
+//     DEFINE_STATIC_HASHMAP(keywordMap, keyword)
+//     DECLARE_STATIC_HASHMAP(keywordMap, KEYWORD_CMP, KEYWORD_HASH)
+//     #include "keywords.inc"
+
+#include "../statichashmap.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+	char     *key;
+	char     *initializer;
+	uint64_t  hash;
+} Line;
+
+static void *xrealloc(void *ptr, size_t size) {
+	void *result = realloc(ptr, size);
+	if(!result) {
+		perror("realloc");
+		exit(EXIT_FAILURE);
+	}
+	return result;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s [-i] [-g GAMMA] NAME VARIABLE < keys\n", argv0);
+	exit(EXIT_FAILURE);
+}
+
+static char *trim(char *str) {
+	while(isspace((unsigned char) *str)) {
+		++str;
+	}
+	size_t length = strlen(str);
+	while(length && isspace((unsigned char) str[length-1])) {
+		str[--length] = '\0';
+	}
+	return str;
+}
+
+static bool parseHash(const char *key, bool integers, uint64_t *hash) {
+	if(!integers) {
+		*hash = staticHashMapStringHash(key);
+		return true;
+	}
+	char *end;
+	if(*key == '-') {
+		*hash = (uint64_t) strtoll(key, &end, 0);
+	} else {
+		*hash = (uint64_t) strtoull(key, &end, 0);
+	}
+	return !*end;
+}
+
+static void printString(const char *str) {
+	putchar('"');
+	for(; *str; ++str) {
+		if(*str == '"' || *str == '\\') {
+			putchar('\\');
+		}
+		putchar(*str);
+	}
+	putchar('"');
+}
+
+int main(int argc, char **argv) {
+	bool integers = false;
+	double gamma = 2;
+	for(int opt; (opt = getopt(argc, argv, "ig:")) != -1; ) {
+		switch(opt) {
+			case 'i':
+				integers = true;
+				break;
+			case 'g':
+				gamma = atof(optarg);
+				if(gamma < 1) {
+					usage(argv[0]);
+				}
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(argc - optind != 2) {
+		usage(argv[0]);
+	}
+	const char *name = argv[optind], *variable = argv[optind+1];
+
+	Line *lines = NULL;
+	size_t size = 0, capacity = 0, number = 0;
+	char buffer[4096];
+	while(fgets(buffer, sizeof(buffer), stdin)) {
+		++number;
+		char *key = trim(buffer);
+		if(!*key || *key == '#') {
+			continue;
+		}
+		char *initializer = key;
+		while(*initializer && !isspace((unsigned char) *initializer)) {
+			++initializer;
+		}
+		if(*initializer) {
+			*initializer++ = '\0';
+			initializer = trim(initializer);
+		}
+
+		if(size == capacity) {
+			capacity = capacity ? 2*capacity : 64;
+			lines = xrealloc(lines, capacity * sizeof(Line));
+		}
+		Line *line = &lines[size++];
+		if(!parseHash(key, integers, &line->hash)) {
+			fprintf(stderr, "line %zu: %s is no integer\n", number, key);
+			return EXIT_FAILURE;
+		}
+		line->key = strdup(key);
+		line->initializer = *initializer ? strdup(initializer) : NULL;
+		if(!line->key || (*initializer && !line->initializer)) {
+			perror("strdup");
+			return EXIT_FAILURE;
+		}
+	}
+
+	uint64_t *hashes = xrealloc(NULL, (size ? size : 1) * sizeof(uint64_t));
+	for(size_t i = 0; i < size; ++i) {
+		hashes[i] = lines[i].hash;
+	}
+	StaticHashMapMph mph;
+	if(!_staticHashMapMphBuild(&mph, hashes, size, gamma, xrealloc, free)) {
+		// memory exhaustion exits in xrealloc()
+		fprintf(stderr, "duplicate keys or hashes\n");
+		return EXIT_FAILURE;
+	}
+
+	Line **ordered = xrealloc(NULL, (size ? size : 1) * sizeof(Line*));
+	memset(ordered, 0, (size ? size : 1) * sizeof(Line*));
+	for(size_t i = 0; i < size; ++i) {
+		size_t index;
+		if(!_staticHashMapMphIndex(&mph, lines[i].hash, &index) ||
+				ordered[index]) {
+			fprintf(stderr, "duplicate keys or hashes\n");
+			return EXIT_FAILURE;
+		}
+		ordered[index] = &lines[i];
+	}
+
+	printf("// Generated by staticHashMapGen, do not edit.\n\n");
+
+	size_t words = mph.levels ? mph.offsets[mph.levels] / 64 : 0;
+	size_t blocks = (words + _STATIC_HASHMAP_RANK_WORDS - 1) /
+	                _STATIC_HASHMAP_RANK_WORDS;
+	printf("static const size_t _%sOffsets[] = {", variable);
+	for(size_t i = 0; i <= mph.levels; ++i) {
+		printf("%s%zu", i % 8 ? ", " : "\n    ", mph.offsets[i]);
+	}
+	printf("\n};\n\n");
+	if(words) {
+		printf("static const uint64_t _%sBits[] = {", variable);
+		for(size_t i = 0; i < words; ++i) {
+			printf("%s0x%016" PRIx64 "ull", i % 3 ? ", " : "\n    ",
+			       mph.bits[i]);
+		}
+		printf("\n};\n\n");
+		printf("static const size_t _%sRanks[] = {", variable);
+		for(size_t i = 0; i < blocks; ++i) {
+			printf("%s%zu", i % 8 ? ", " : "\n    ", mph.ranks[i]);
+		}
+		printf("\n};\n\n");
+
+		printf("static const _StaticHashType%s _%sEntries[] = {\n",
+		       name, variable);
+		for(size_t i = 0; i < size; ++i) {
+			printf("    ");
+			if(ordered[i]->initializer) {
+				printf("%s", ordered[i]->initializer);
+			} else if(integers) {
+				printf("{ %s }", ordered[i]->key);
+			} else {
+				printf("{ ");
+				printString(ordered[i]->key);
+				printf(" }");
+			}
+			printf(",\n");
+		}
+		printf("};\n\n");
+	}
+
+	printf("const %s %s = {\n", name, variable);
+	printf("    .size = %zu,\n", size);
+	printf("    .mph = {\n");
+	printf("        .levels = %zu,\n", mph.levels);
+	printf("        .offsets = _%sOffsets,\n", variable);
+	printf("        .bits = %s%s%s,\n",
+	       words ? "_" : "", words ? variable : "NULL", words ? "Bits" : "");
+	printf("        .ranks = %s%s%s,\n",
+	       words ? "_" : "", words ? variable : "NULL", words ? "Ranks" : "");
+	printf("    },\n");
+	printf("    .entries = %s%s%s,\n",
+	       words ? "_" : "", words ? variable : "NULL", words ? "Entries" : "");
+	printf("};\n");
+
+	_staticHashMapMphFree(&mph, free);
+	for(size_t i = 0; i < size; ++i) {
+		free(lines[i].key);
+		free(lines[i].initializer);
+	}
+	free(lines);
+	free(hashes);
+	free(ordered);
+	return EXIT_SUCCESS;
+}